@@ -0,0 +1,470 @@
+/* goatvrd - local VR compositor daemon, built on libgoatvr.
+ * Owns the actual display module, and composites the frames of any number of
+ * client programs using the goatvr "remote" module, on top of each other in
+ * connection order. See src/remote.h in the libgoatvr source tree for the
+ * protocol.
+ *
+ * usage: goatvrd [-s <socket path>]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+#include "goatvr.h"
+#include "remote.h"
+
+#define MAX_CLIENTS	16
+/* largest client framebuffer we accept, in each dimension */
+#define MAX_FB_SIZE	16384
+
+struct client {
+	int sock;
+	void *fb_mem[REMOTE_FRAME_SLOTS];
+	size_t fb_size[REMOTE_FRAME_SLOTS];
+
+	unsigned int tex;
+	int tex_width, tex_height;	/* allocated texture size */
+	int width, height;			/* last frame size */
+	uint64_t frame;
+};
+
+static int init(void);
+static void cleanup(void);
+static int create_poses(void);
+static int open_socket(const char *fname);
+static void accept_clients(void);
+static int handle_client(struct client *c);
+static size_t fb_bytes(uint32_t width, uint32_t height);
+static void remove_client(int idx);
+static void update_poses(void);
+static void draw(void);
+static void reshape(int x, int y);
+
+static SDL_Window *win;
+static SDL_GLContext ctx;
+static int width, height;
+static int done;
+
+static const char *sock_path;
+static int lis = -1;
+static int poses_fd = -1;
+static struct remote_poses *poses;
+
+static struct client clients[MAX_CLIENTS];
+static int num_clients;
+
+int main(int argc, char **argv)
+{
+	int i, pos = SDL_WINDOWPOS_UNDEFINED;
+
+	if(!(sock_path = getenv("GOATVR_REMOTE_SOCKET"))) {
+		sock_path = REMOTE_DEF_SOCKET;
+	}
+	for(i=1; i<argc; i++) {
+		if(strcmp(argv[i], "-s") == 0 && argv[i + 1]) {
+			sock_path = argv[++i];
+		} else {
+			fprintf(stderr, "usage: %s [-s <socket path>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if(SDL_Init(SDL_INIT_VIDEO) == -1) {
+		fprintf(stderr, "failed to initialize SDL\n");
+		goto quit;
+	}
+	if(!(win = SDL_CreateWindow("goatvrd", pos, pos, 800, 600, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE))) {
+		fprintf(stderr, "failed to create window\n");
+		goto quit;
+	}
+	if(!(ctx = SDL_GL_CreateContext(win))) {
+		fprintf(stderr, "failed to create OpenGL context\n");
+		goto quit;
+	}
+
+	if(init() == -1) {
+		goto quit;
+	}
+
+	SDL_GetWindowSize(win, &width, &height);
+	reshape(width, height);
+
+	while(!done) {
+		SDL_Event ev;
+		while(SDL_PollEvent(&ev)) {
+			if(ev.type == SDL_QUIT || (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_ESCAPE)) {
+				done = 1;
+			} else if(ev.type == SDL_WINDOWEVENT && ev.window.event == SDL_WINDOWEVENT_RESIZED) {
+				reshape(ev.window.data1, ev.window.data2);
+			}
+		}
+
+		accept_clients();
+		for(i=0; i<num_clients; i++) {
+			if(handle_client(clients + i) == -1) {
+				remove_client(i--);
+			}
+		}
+		draw();
+	}
+
+quit:
+	cleanup();
+	return 0;
+}
+
+static int init(void)
+{
+	/* we're the one presenting for the remote modules, don't try to be one */
+	setenv("GOATVR_NO_REMOTE", "1", 1);
+
+	if(goatvr_init() == -1) {
+		return -1;
+	}
+	goatvr_set_origin_mode(GOATVR_HEAD);
+	goatvr_startvr();
+	if(!goatvr_invr()) {
+		fprintf(stderr, "failed to enter VR mode\n");
+		return -1;
+	}
+
+	if(create_poses() == -1) {
+		return -1;
+	}
+	if((lis = open_socket(sock_path)) == -1) {
+		return -1;
+	}
+	printf("goatvrd: listening on %s\n", sock_path);
+	return 0;
+}
+
+static void cleanup(void)
+{
+	while(num_clients > 0) {
+		remove_client(num_clients - 1);
+	}
+	if(lis != -1) {
+		close(lis);
+		unlink(sock_path);
+	}
+	if(poses) {
+		munmap(poses, sizeof *poses);
+	}
+	if(poses_fd != -1) {
+		close(poses_fd);
+	}
+
+	goatvr_shutdown();
+
+	if(ctx) {
+		SDL_GL_DeleteContext(ctx);
+	}
+	if(win) {
+		SDL_DestroyWindow(win);
+	}
+	SDL_Quit();
+}
+
+/* the pose block is passed to the clients by file descriptor, so the shared
+ * memory object doesn't need to keep a name
+ */
+static int create_poses(void)
+{
+	char name[64];
+	sprintf(name, "/goatvrd-poses-%d", (int)getpid());
+
+	if((poses_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) == -1) {
+		fprintf(stderr, "failed to create pose shared memory: %s\n", strerror(errno));
+		return -1;
+	}
+	shm_unlink(name);
+
+	if(ftruncate(poses_fd, sizeof *poses) == -1) {
+		fprintf(stderr, "failed to resize pose shared memory: %s\n", strerror(errno));
+		return -1;
+	}
+	poses = mmap(0, sizeof *poses, PROT_READ | PROT_WRITE, MAP_SHARED, poses_fd, 0);
+	if(poses == MAP_FAILED) {
+		fprintf(stderr, "failed to map pose shared memory: %s\n", strerror(errno));
+		poses = 0;
+		return -1;
+	}
+	memset(poses, 0, sizeof *poses);
+	update_poses();
+	return 0;
+}
+
+static int open_socket(const char *fname)
+{
+	int s;
+	struct sockaddr_un addr;
+
+	if((s = socket(AF_UNIX, SOCK_SEQPACKET, 0)) == -1) {
+		fprintf(stderr, "failed to create socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, fname, sizeof addr.sun_path - 1);
+
+	unlink(fname);	/* left behind by a previous instance */
+	if(bind(s, (struct sockaddr*)&addr, sizeof addr) == -1 || listen(s, 8) == -1) {
+		fprintf(stderr, "failed to listen on %s: %s\n", fname, strerror(errno));
+		close(s);
+		return -1;
+	}
+	fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+	return s;
+}
+
+static void accept_clients(void)
+{
+	int s;
+	struct remote_msg msg;
+
+	while((s = accept(lis, 0, 0)) != -1) {
+		if(num_clients >= MAX_CLIENTS) {
+			fprintf(stderr, "goatvrd: too many clients, rejecting connection\n");
+			close(s);
+			continue;
+		}
+
+		memset(&msg, 0, sizeof msg);
+		msg.type = REMOTE_MSG_HELLO;
+		if(remote_send(s, &msg, poses_fd) == -1) {
+			close(s);
+			continue;
+		}
+
+		memset(clients + num_clients, 0, sizeof *clients);
+		clients[num_clients++].sock = s;
+		printf("goatvrd: client connected (%d total)\n", num_clients);
+	}
+}
+
+/* upload the frames the client submitted, and give the slots right back:
+ * glTexSubImage2D is done with the memory when it returns
+ */
+static int handle_client(struct client *c)
+{
+	int res, fd;
+	struct remote_msg msg;
+
+	size_t size;
+	struct stat st;
+
+	while((res = remote_recv(c->sock, &msg, &fd)) == 0) {
+		if(msg.slot >= REMOTE_FRAME_SLOTS) {
+			if(fd != -1) close(fd);
+			continue;
+		}
+
+		switch(msg.type) {
+		case REMOTE_MSG_FRAMEBUF:
+			if(fd == -1) break;
+			if(c->fb_mem[msg.slot]) {
+				munmap(c->fb_mem[msg.slot], c->fb_size[msg.slot]);
+				c->fb_mem[msg.slot] = 0;
+				c->fb_size[msg.slot] = 0;
+			}
+			/* don't take the client's word for the size, reading past the end
+			 * of the shared memory object would get us killed by SIGBUS
+			 */
+			size = fb_bytes(msg.width, msg.height);
+			if(!size || fstat(fd, &st) == -1 || (uint64_t)st.st_size < (uint64_t)size) {
+				fprintf(stderr, "goatvrd: invalid client framebuffer (%ux%u)\n",
+						(unsigned int)msg.width, (unsigned int)msg.height);
+				break;
+			}
+			c->fb_mem[msg.slot] = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+			if(c->fb_mem[msg.slot] == MAP_FAILED) {
+				fprintf(stderr, "goatvrd: failed to map client framebuffer\n");
+				c->fb_mem[msg.slot] = 0;
+				break;
+			}
+			c->fb_size[msg.slot] = size;
+			break;
+
+		case REMOTE_MSG_FRAME:
+			size = fb_bytes(msg.width, msg.height);
+			if(c->fb_mem[msg.slot] && size && size <= c->fb_size[msg.slot]) {
+				if(!c->tex) {
+					glGenTextures(1, &c->tex);
+					glBindTexture(GL_TEXTURE_2D, c->tex);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				}
+				glBindTexture(GL_TEXTURE_2D, c->tex);
+				if((int)msg.width != c->tex_width || (int)msg.height != c->tex_height) {
+					c->tex_width = msg.width;
+					c->tex_height = msg.height;
+					glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, msg.width, msg.height, 0,
+							GL_RGBA, GL_UNSIGNED_BYTE, c->fb_mem[msg.slot]);
+				} else {
+					glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, msg.width, msg.height,
+							GL_RGBA, GL_UNSIGNED_BYTE, c->fb_mem[msg.slot]);
+				}
+				c->width = msg.width;
+				c->height = msg.height;
+				c->frame = msg.frame;
+			}
+
+			msg.type = REMOTE_MSG_RELEASE;
+			if(remote_send(c->sock, &msg, -1) == -1) {
+				return -1;
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		if(fd != -1) {
+			close(fd);
+		}
+	}
+	return res == -1 ? -1 : 0;
+}
+
+/* size in bytes of a width x height RGBA framebuffer, or 0 if the size is
+ * invalid or too large
+ */
+static size_t fb_bytes(uint32_t width, uint32_t height)
+{
+	uint64_t size;
+
+	if(!width || !height || width > MAX_FB_SIZE || height > MAX_FB_SIZE) {
+		return 0;
+	}
+	size = (uint64_t)width * (uint64_t)height * 4;
+	if(size > (uint64_t)SIZE_MAX) {
+		return 0;
+	}
+	return (size_t)size;
+}
+
+static void remove_client(int idx)
+{
+	int i;
+	struct client *c = clients + idx;
+
+	close(c->sock);
+	for(i=0; i<REMOTE_FRAME_SLOTS; i++) {
+		if(c->fb_mem[i]) {
+			munmap(c->fb_mem[i], c->fb_size[i]);
+		}
+	}
+	if(c->tex) {
+		glDeleteTextures(1, &c->tex);
+	}
+
+	if(idx < --num_clients) {
+		memmove(c, c + 1, (num_clients - idx) * sizeof *c);
+	}
+	printf("goatvrd: client disconnected (%d left)\n", num_clients);
+}
+
+/* the poses of the frame we're about to draw, for the clients' next frame.
+ * Written under a sequence lock, see struct remote_poses.
+ */
+static void update_poses(void)
+{
+	int i;
+	float scale = goatvr_get_fb_scale();
+
+	poses->seq++;
+	__sync_synchronize();
+
+	poses->eye_width = (uint32_t)(goatvr_get_fb_eye_width(0) / scale);
+	poses->eye_height = (uint32_t)(goatvr_get_fb_eye_height(0) / scale);
+	poses->frame++;
+	goatvr_head_position(poses->head_pos);
+	goatvr_head_orientation(poses->head_rot);
+
+	for(i=0; i<2; i++) {
+		float *proj = goatvr_projection_matrix(i, 0.5f, 500.0f);
+		memcpy(poses->view[i], goatvr_view_matrix(i), 16 * sizeof(float));
+
+		/* frustum tangents at distance 1, out of the projection matrix */
+		poses->fov[i][0] = (proj[8] - 1.0f) / proj[0];
+		poses->fov[i][1] = (proj[8] + 1.0f) / proj[0];
+		poses->fov[i][2] = (proj[9] - 1.0f) / proj[5];
+		poses->fov[i][3] = (proj[9] + 1.0f) / proj[5];
+	}
+
+	__sync_synchronize();
+	poses->seq++;
+}
+
+static void draw(void)
+{
+	int i, j;
+
+	goatvr_draw_start();
+	update_poses();
+
+	glClearColor(0, 0, 0, 1);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_LIGHTING);
+	glEnable(GL_TEXTURE_2D);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	for(i=0; i<2; i++) {
+		float u0 = i * 0.5f;
+		float u1 = u0 + 0.5f;
+
+		goatvr_draw_eye(i);
+
+		/* each client frame has both eyes side by side */
+		for(j=0; j<num_clients; j++) {
+			if(!clients[j].tex || !clients[j].width) continue;
+
+			glBindTexture(GL_TEXTURE_2D, clients[j].tex);
+			glBegin(GL_QUADS);
+			glTexCoord2f(u0, 0);
+			glVertex2f(-1, -1);
+			glTexCoord2f(u1, 0);
+			glVertex2f(1, -1);
+			glTexCoord2f(u1, 1);
+			glVertex2f(1, 1);
+			glTexCoord2f(u0, 1);
+			glVertex2f(-1, 1);
+			glEnd();
+		}
+	}
+
+	glDisable(GL_BLEND);
+	glDisable(GL_TEXTURE_2D);
+
+	goatvr_draw_done();
+
+	if(goatvr_should_swap()) {
+		SDL_GL_SwapWindow(win);
+	}
+}
+
+static void reshape(int x, int y)
+{
+	width = x;
+	height = y;
+
+	glViewport(0, 0, x, y);
+	goatvr_set_fb_size(x, y, 1.0f);
+}
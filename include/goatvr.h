@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 typedef void goatvr_module;
 typedef void goatvr_source;
 #endif
+typedef struct goatvr_layer goatvr_layer;
 
 enum goatvr_origin_mode { GOATVR_FLOOR, GOATVR_HEAD };
 enum { GOATVR_LEFT, GOATVR_RIGHT };
@@ -51,6 +52,61 @@ enum {
 
 #define GOATVR_ALL_BUTTONS		0xffffffff
 
+/* projection mode flags, see goatvr_set_projection_mode */
+enum {
+	GOATVR_PROJ_REVERSE_Z	= 1,
+	GOATVR_PROJ_INFINITE	= 2
+};
+
+/* instanced stereo modes, returned by goatvr_draw_instanced_stereo */
+enum {
+	GOATVR_STEREO_VIEWPORT_ARRAY	= 1,
+	GOATVR_STEREO_CLIP_DISTANCE		= 2
+};
+
+/* multi-resolution tiles, see goatvr_set_multires. Tile indices go from the
+ * bottom-left to the top-right of each eye, row by row.
+ */
+#define GOATVR_NUM_TILES	9
+#define GOATVR_CENTER_TILE	4
+
+/* hidden area prefill modes, see goatvr_set_hidden_area */
+enum {
+	GOATVR_HIDDEN_AREA_OFF,
+	GOATVR_HIDDEN_AREA_DEPTH,
+	GOATVR_HIDDEN_AREA_STENCIL
+};
+
+/* stereo reprojection modes, see goatvr_set_reprojection */
+enum {
+	GOATVR_REPROJ_OFF,
+	GOATVR_REPROJ_STRETCH,
+	GOATVR_REPROJ_STENCIL
+};
+
+/* overlay layer types, see goatvr_layer_create */
+enum {
+	GOATVR_LAYER_QUAD,
+	GOATVR_LAYER_CYLINDER,
+
+	GOATVR_LAYER_HEAD_LOCKED	= 0x100	// flag, or-ed with the type
+};
+
+/* mirror window modes, see goatvr_set_mirror_mode */
+enum {
+	GOATVR_MIRROR_BOTH,		// both eyes side by side
+	GOATVR_MIRROR_LEFT,
+	GOATVR_MIRROR_RIGHT,
+	GOATVR_MIRROR_CROPPED	// center of the left eye, at the window aspect ratio
+};
+
+enum goatvr_depth_format {
+	GOATVR_DEPTH16,
+	GOATVR_DEPTH24,
+	GOATVR_DEPTH24_STENCIL8,
+	GOATVR_DEPTH32F
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -73,6 +129,14 @@ void goatvr_startvr(void);	/* enter virtual reality */
 void goatvr_stopvr(void);	/* exit virtual reality */
 int goatvr_invr(void);		/* are we in VR? */
 
+/* Exit virtual reality, but keep textures, framebuffers and (where the VR
+ * runtime allows it) the VR session alive, so that the next goatvr_startvr is
+ * quick. Call goatvr_trim to release them while out of VR. goatvr_stopvr also
+ * releases anything kept alive by a previous goatvr_suspendvr.
+ */
+void goatvr_suspendvr(void);
+void goatvr_trim(void);
+
 /* GOATVR_FLOOR: the origin height is always at the user's floor level, and
  *  goatvr_recenter affects only the x/z components of the origin (default).
  * GOATVR_HEAD: the origin is at the users head, and is reset to the current
@@ -101,6 +165,15 @@ float goatvr_get_units_scale(void);
 void goatvr_set_fb_size(int width, int height, float scale);
 float goatvr_get_fb_scale(void);
 
+/* Allocate the VR render targets large enough for the given framebuffer scale
+ * (default: 0, allocate for the current scale only). Changing the scale with
+ * goatvr_set_fb_size up to this maximum, only changes the eye viewports and
+ * the region of the texture submitted to the VR runtime, without reallocating
+ * anything. Call before goatvr_startvr.
+ */
+void goatvr_set_fb_max_scale(float scale);
+float goatvr_get_fb_max_scale(void);
+
 /* framebuffer width and height (both viewports) */
 int goatvr_get_fb_width(void);
 int goatvr_get_fb_height(void);
@@ -122,6 +195,45 @@ int goatvr_get_fb_texture_height(void);
  */
 unsigned int goatvr_get_fbo(void);
 
+/* Use an application-provided framebuffer object as the VR render target,
+ * instead of the one created by goatvr (pass 0 to revert). The application is
+ * responsible for the depth attachment; goatvr won't allocate one, and looks
+ * up its format the first time it needs to copy depth (call goatvr_set_fbo
+ * again after replacing the depth attachment). Unless a color texture was also
+ * provided with goatvr_set_fb_texture, the render texture of the display
+ * module (which might be a different swap chain image every frame) is attached
+ * to color attachment 0 of this FBO by goatvr_draw_start.
+ */
+void goatvr_set_fbo(unsigned int fbo);
+
+/* Render directly into an application texture: the display module submits
+ * this texture as is, without any intermediate copies. width/height is the
+ * size of the texture, which must be at least as large as the framebuffer
+ * (see goatvr_get_fb_width/goatvr_get_fb_height), with the eyes laid out at
+ * the usual offsets. Pass 0 to revert to the module's own render texture.
+ * Returns -1 if the display module can't submit arbitrary textures (oculus);
+ * use goatvr_set_fbo in that case, to have its swap chain images attached to
+ * your FBO instead.
+ */
+int goatvr_set_fb_texture(unsigned int tex, int width, int height);
+
+/* select the format of the depth buffer attached to the VR framebuffer object
+ * (default: GOATVR_DEPTH24). If as_texture is non-zero, a depth texture is
+ * allocated instead of a renderbuffer, and can be retrieved with
+ * goatvr_get_fb_depth_texture, to be sampled after drawing.
+ */
+void goatvr_set_fb_depth(enum goatvr_depth_format fmt, int as_texture);
+/* returns 0 if the depth buffer is not a texture */
+unsigned int goatvr_get_fb_depth_texture(void);
+
+/* enable single-pass stereo rendering with goatvr_draw_both_eyes (default: 0).
+ * Returns -1 if the GL_OVR_multiview2 extension is not available.
+ */
+int goatvr_set_multiview(int enable);
+int goatvr_get_multiview(void);
+/* the GL_TEXTURE_2D_ARRAY color texture used by goatvr_draw_both_eyes */
+unsigned int goatvr_get_multiview_texture(void);
+
 /* call glViewport for this eye */
 void goatvr_viewport(int eye);
 
@@ -133,10 +245,233 @@ float *goatvr_view_matrix(int eye);
 /* return the projection matrix for each eye */
 float *goatvr_projection_matrix(int eye, float znear, float zfar);
 
+/* select the kind of projection matrices returned by goatvr_projection_matrix.
+ * flags is a bitwise OR of the following (default: 0, conventional projection):
+ *  - GOATVR_PROJ_REVERSE_Z: znear maps to depth 1 and zfar to depth 0, with a
+ *    [0, 1] clip-space depth range. goatvr_draw_start calls
+ *    glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE) if ARB_clip_control is
+ *    available, and goatvr_draw_done restores it. The application should clear
+ *    the depth buffer to 0 and use glDepthFunc(GL_GREATER).
+ *  - GOATVR_PROJ_INFINITE: the far clipping plane is at infinity, and the zfar
+ *    argument of goatvr_projection_matrix is ignored.
+ */
+void goatvr_set_projection_mode(unsigned int flags);
+unsigned int goatvr_get_projection_mode(void);
+
+/* Temporal antialiasing support. When enabled, every frame all projection
+ * matrices returned by goatvr (and the stereo uniform buffer) are offset by
+ * the next sub-pixel jitter of a Halton(2, 3) sequence, identical for both
+ * eyes (default: disabled).
+ */
+void goatvr_set_jitter(int enable);
+int goatvr_get_jitter(void);
+/* jitter of the current and previous frame in pixels, in [-0.5, 0.5].
+ * Either pointer can be null.
+ */
+void goatvr_get_jitter_offset(float *offs, float *prev_offs);
+/* view and projection matrices of each eye during the previous frame, for
+ * computing motion vectors. The previous projection includes the jitter of
+ * the previous frame.
+ */
+float *goatvr_prev_view_matrix(int eye);
+float *goatvr_prev_projection_matrix(int eye, float znear, float zfar);
+
+/* near/far clipping planes for the projection matrices in the stereo uniform
+ * buffer (default: 0.5, 500)
+ */
+void goatvr_set_clip_planes(float znear, float zfar);
+void goatvr_get_clip_planes(float *znear, float *zfar);
+
+/* Uniform buffer with the matrices and viewports of both eyes, updated once
+ * per frame by goatvr_draw_start, with the following std140 layout:
+ *
+ *   layout(std140) uniform goatvr_stereo {
+ *       mat4 view[2];
+ *       mat4 proj[2];
+ *       mat4 viewproj[2];
+ *       vec4 viewport[2];      // x, y, width, height in pixels
+ *       vec4 clip_xform[2];    // see goatvr_draw_instanced_stereo
+ *   };
+ *
+ * The buffer is created on first use. Returns 0 if uniform buffer objects are
+ * not supported (GL 3.1).
+ */
+unsigned int goatvr_get_stereo_ubo(void);
+/* glBindBufferBase the stereo uniform buffer to a uniform block binding point */
+void goatvr_bind_stereo_ubo(unsigned int binding);
+
+/* Late latching of the eye poses in the stereo uniform buffer. Instead of
+ * uploading the matrices computed by goatvr_draw_start, the buffer is filled
+ * by a GPU copy out of a persistently mapped staging buffer, which
+ * goatvr_draw_done rewrites with a fresh pose prediction right before the
+ * frame is submitted, if the GPU hasn't started on the frame yet. The display
+ * module submits the frame with the fresh pose, for a consistent timewarp.
+ * goatvr_draw_done never waits for the GPU, so whether the GPU actually
+ * picked up the fresh pose is checked in the following frames. Only rendering
+ * which takes the view matrices from the stereo uniform buffer benefits;
+ * anything drawn with goatvr_view_matrix keeps the goatvr_draw_start pose, so
+ * avoid mixing the two with late latching enabled.
+ * Returns -1 if not supported (needs GL 4.4 or GL_ARB_buffer_storage)
+ * (default: off).
+ */
+int goatvr_set_late_latch(int enable);
+int goatvr_get_late_latch(void);
+/* returns 1 if the last frame the GPU got through was drawn with late-latched
+ * poses. It lags one or two frames behind, since it's checked without
+ * waiting for the GPU.
+ */
+int goatvr_late_latched(void);
+
+/* Single frustum enclosing both eyes, for culling once per frame instead of
+ * once per eye. planes receives 6 planes (left, right, bottom, top, near, far)
+ * of 4 floats each (a, b, c, d), normalized and facing inwards, in the space
+ * the view matrices transform from. Points with ax + by + cz + d < 0 for any
+ * plane are outside. view/proj receive the matrices of the matching "culling
+ * eye", which sits slightly behind the real eyes (conventional projection,
+ * regardless of goatvr_set_projection_mode). Near and far are the planes set
+ * with goatvr_set_clip_planes. Any of the pointers can be null.
+ */
+void goatvr_combined_frustum(float *planes, float *view, float *proj);
+
+/* Hybrid mono/stereo rendering: beyond a few tens of meters stereo disparity
+ * is sub-pixel, so everything further than the split distance can be drawn
+ * once, from a center eye, into a mono "far" layer, which goatvr_draw_done
+ * composites behind the near-field content of both eyes (wherever the depth
+ * buffer was left cleared). A split distance of 0 disables the far layer
+ * (default). Needs OpenGL 3.2.
+ */
+void goatvr_set_far_split(float dist);
+float goatvr_get_far_split(void);
+/* call after goatvr_draw_start, and before drawing the eyes, to bind the far
+ * layer framebuffer and set the viewport. Clear it, and draw the far-field
+ * geometry with the matrices below. Then draw each eye as usual, with a
+ * projection whose zfar is the split distance. Returns -1 if the far layer
+ * is disabled, or not available with the current display module. With
+ * multiview enabled, it's also unavailable when the depth buffer of the VR
+ * framebuffer is user-supplied, in a format goatvr can't determine.
+ */
+int goatvr_draw_far(void);
+/* center eye matrices for drawing the far layer. The projection covers both
+ * eye frusta, with znear at the split distance.
+ */
+float *goatvr_far_view_matrix(void);
+float *goatvr_far_projection_matrix(float zfar);
+
+/* Spatial upscaling: draw the eyes at a fraction (scale) of the size of the
+ * VR framebuffer, into a separate low resolution framebuffer bound by
+ * goatvr_draw_start, and let goatvr_draw_done upscale them to the VR
+ * framebuffer with an edge-adaptive upsampling and sharpening pass (similar to
+ * AMD FSR 1). goatvr_viewport, goatvr_get_fbo, and the goatvr_get_fb_eye_*
+ * functions refer to the low resolution framebuffer while upscaling.
+ * sharpness is in stops, 0 is the sharpest (default: 0.2). A scale of 1
+ * disables upscaling (default). Returns -1 if scale is not in (0, 1], or if
+ * OpenGL 3.2 is not available. Not used together with multi-resolution
+ * rendering (see goatvr_set_multires). If the low resolution framebuffer
+ * can't be created, upscaling is turned off, and goatvr_get_upscale returns 1.
+ */
+int goatvr_set_upscale(float scale, float sharpness);
+float goatvr_get_upscale(void);
+
+/* Multi-resolution eye buffers: each eye is split into a 3x3 grid of tiles.
+ * The center tile covers the center fraction of the eye's field of view (in
+ * each dimension) at full pixel density, and the periphery tiles are rendered
+ * at periph_scale of that density. All tiles are packed in a smaller render
+ * target, which goatvr_draw_done stretches back to the VR framebuffer.
+ * center 0 disables multi-resolution rendering (default). Returns -1 if the
+ * arguments are out of range: center in (0, 1], periph_scale in (0, 1].
+ * Multiview, instanced stereo, hidden area masking, and stereo reprojection
+ * are not available while multi-resolution rendering is enabled, and the far
+ * layer needs an application framebuffer depth format matching one of the
+ * goatvr_depth_format values.
+ */
+int goatvr_set_multires(float center, float periph_scale);
+int goatvr_get_multires(float *center, float *periph_scale);
+/* When multi-resolution is enabled, goatvr_draw_start binds the packed tile
+ * framebuffer instead (clear it as usual), and instead of goatvr_draw_eye,
+ * call goatvr_draw_tile for each tile of each eye, and draw it with the eye's
+ * view matrix and the tile's projection matrix. Sets the tile viewport, and
+ * returns -1 if multi-resolution rendering isn't enabled or available.
+ */
+int goatvr_draw_tile(int eye, int tile);
+/* viewport of a tile in the packed framebuffer: x, y, width, height. It
+ * includes a border of one pixel around the tile, and the tile's projection
+ * matrix covers it too, so always use the two together.
+ */
+void goatvr_get_tile_viewport(int eye, int tile, int *vp);
+float *goatvr_tile_projection_matrix(int eye, int tile, float znear, float zfar);
+
+/* Depth-based stereo reprojection: draw only the left eye, then call
+ * goatvr_reproject_eye instead of drawing the right eye, to synthesize it by
+ * warping the left eye color and depth with the inter-eye transform. The
+ * left eye must be drawn with the projection matrix for the near/far planes
+ * set with goatvr_set_clip_planes. Disocclusions (areas not seen by the left
+ * eye) are handled according to the mode:
+ *  - GOATVR_REPROJ_STRETCH: stretch the background (the far side of each depth
+ *    discontinuity) over them.
+ *  - GOATVR_REPROJ_STENCIL: leave them empty, and mark them with stencil 1,
+ *    for the application to re-render only those regions of the right eye
+ *    with glStencilFunc(GL_EQUAL, 1, 0xff). Needs a stencil buffer, see
+ *    goatvr_set_fb_depth.
+ * With an application framebuffer (see goatvr_set_fbo) of a depth format other
+ * than the goatvr_depth_format ones, its depth attachment must be a texture.
+ * Returns -1 if the mode isn't supported (needs OpenGL 3.2).
+ */
+int goatvr_set_reprojection(int mode);
+int goatvr_get_reprojection(void);
+/* synthesize the right eye from the left, and set up the right eye viewport
+ * like goatvr_draw_eye(GOATVR_RIGHT). Returns 1 if the application must fill
+ * the disocclusions (GOATVR_REPROJ_STENCIL), 0 if the right eye is complete,
+ * or -1 if reprojection is disabled or failed, and the right eye must be drawn
+ * normally.
+ */
+int goatvr_reproject_eye(void);
+
+/* Mask out the parts of each eye's viewport which can't be seen through the
+ * HMD lenses, so that the fragment shaders don't run there. goatvr_draw_eye
+ * draws the hidden area mesh of the eye (provided by the VR runtime, or
+ * derived from the lens field of view) into the depth or stencil buffer:
+ *  - GOATVR_HIDDEN_AREA_DEPTH: at the near plane, failing any subsequent
+ *    depth test (GL_LESS/GL_LEQUAL, or GL_GREATER/GL_GEQUAL with reverse-Z).
+ *  - GOATVR_HIDDEN_AREA_STENCIL: sets the stencil to 1, draw with
+ *    glStencilFunc(GL_EQUAL, 0, 0xff). Needs a stencil buffer, see
+ *    goatvr_set_fb_depth.
+ * The depth and stencil buffers must be cleared after goatvr_draw_start and
+ * before goatvr_draw_eye. Has no effect with display modules without lenses
+ * (default: GOATVR_HIDDEN_AREA_OFF). Needs OpenGL 3.2.
+ */
+void goatvr_set_hidden_area(int mode);
+int goatvr_get_hidden_area(void);
+
 /* start drawing prepares for VR drawing, and binds FBO. */
 void goatvr_draw_start(void);
  /* call before drawing each eye. calls glViewport internally */
 void goatvr_draw_eye(int eye);
+/* Single-pass stereo: draw both eyes at once, instead of calling
+ * goatvr_draw_eye for each one. Binds a framebuffer with two-layer texture
+ * array attachments (one layer per eye) set up for GL_OVR_multiview2, and
+ * sets the viewport. Vertex shaders must declare layout(num_views = 2) in;
+ * and select the per-eye matrices with gl_ViewID_OVR. goatvr_draw_done copies
+ * the layers to the VR framebuffer.
+ * Returns -1 if multiview isn't enabled (see goatvr_set_multiview) or not
+ * possible with the current display module; draw each eye separately then.
+ */
+int goatvr_draw_both_eyes(void);
+/* Instanced stereo: draw both eyes with a single instanced draw call, with
+ * twice the instance count, using eye = gl_InstanceID & 1 to index the stereo
+ * uniform buffer (see goatvr_get_stereo_ubo). Call after goatvr_draw_start
+ * instead of goatvr_draw_eye, and returns the mode which the vertex shader
+ * must implement:
+ *  - GOATVR_STEREO_VIEWPORT_ARRAY: a viewport is set up for each eye, write
+ *    gl_ViewportIndex = eye (ARB_shader_viewport_layer_array).
+ *  - GOATVR_STEREO_CLIP_DISTANCE: a single viewport covers both eyes, and
+ *    GL_CLIP_DISTANCE0-3 are enabled. Given p = viewproj[eye] * vertex:
+ *      gl_Position = vec4(p.xy * clip_xform[eye].xy + clip_xform[eye].zw * p.w, p.zw);
+ *      gl_ClipDistance[0] = p.w - p.x;  gl_ClipDistance[1] = p.w + p.x;
+ *      gl_ClipDistance[2] = p.w - p.y;  gl_ClipDistance[3] = p.w + p.y;
+ * Returns -1 if instanced stereo is not possible with the current display
+ * module or OpenGL context; draw each eye separately then.
+ */
+int goatvr_draw_instanced_stereo(void);
 /* done drawing both eyes, the frame is ready to be presented */
 void goatvr_draw_done(void);
 
@@ -144,7 +479,8 @@ void goatvr_draw_done(void);
  * window buffer swapping, and won't work properly if the user does a swap
  * at the end of every frame. This function returns true (non-zero) if the
  * user should perform buffer swaps on their window, or false (zero) if the
- * VR module needs to handle them.
+ * VR module needs to handle them, or the mirror wasn't updated this frame
+ * (see goatvr_set_mirror_interval).
  * example:
  *   if(goatvr_should_swap()) {
  *       SDL_GL_SwapWindow(win);
@@ -152,6 +488,156 @@ void goatvr_draw_done(void);
  */
 int goatvr_should_swap(void);
 
+/* what the HMD modules present in the application window, as a mirror of
+ * the HMD view (default: GOATVR_MIRROR_BOTH). The mirror is copied to the
+ * window framebuffer by goatvr_draw_done, without disturbing any GL state.
+ */
+void goatvr_set_mirror_mode(int mode);
+int goatvr_get_mirror_mode(void);
+/* mirror update rate, for display modules where the window is only a mirror
+ * of the HMD (Oculus and OpenVR), to keep the mirror and the window buffer
+ * swap from competing with the HMD frame. The mirror is updated every nframes
+ * HMD frames (default: 1, 0 disables it), and no more often than rate times
+ * per second (default: 0, unlimited). goatvr_should_swap returns 0 for the
+ * frames without a mirror update, so call it every frame after
+ * goatvr_draw_done.
+ */
+void goatvr_set_mirror_interval(int nframes);
+int goatvr_get_mirror_interval(void);
+void goatvr_set_mirror_rate(float rate);
+float goatvr_get_mirror_rate(void);
+/* present from a compositor thread, with a second OpenGL context sharing
+ * objects with the current one, instead of from goatvr_draw_done. The
+ * application thread then only renders the eye buffers, and presentation
+ * never waits for the application frame: the last complete frame is shown
+ * again if a new one isn't ready in time. The compositor thread also does the
+ * window buffer swaps, so goatvr_should_swap returns 0, and the application
+ * must not draw to the window itself. On X11 the application must have
+ * called XInitThreads. Returns -1 if the display module or the OpenGL context
+ * can't do that (currently only the openhmd and 3dtv modules can). Default: off.
+ */
+int goatvr_set_compositor_thread(int enable);
+int goatvr_get_compositor_thread(void);
+
+/* ---- eye buffer export ---- */
+
+#define GOATVR_EXPORT_BUFFERS	3
+
+/* an exported eye buffer: a single-plane dma-buf, with the pixel format and
+ * layout given as DRM fourcc and format modifier. The eyes are laid out as
+ * returned by goatvr_get_fb_eye_*, and the first row is the bottom one.
+ */
+struct goatvr_export_buffer {
+	int fd;			/* owned by goatvr, dup it to keep it past a serial change */
+	unsigned int fourcc;
+	unsigned long long modifier;
+	int stride, offset;
+	int width, height;
+	int serial;		/* changes every time the buffers are re-allocated */
+};
+
+/* share every finished frame with other processes without going through the
+ * CPU: goatvr_draw_done copies the eye buffers on the GPU to a ring of
+ * GOATVR_EXPORT_BUFFERS exportable textures, and the consumer imports them
+ * once (EGL_EXT_image_dma_buf_import, Vulkan external memory, ...).
+ * Buffers returned by goatvr_export_frame are not overwritten until they are
+ * released with goatvr_export_release; if none is free, frames are not
+ * exported. Needs a current EGL context with
+ * EGL_KHR_gl_texture_2D_image and EGL_MESA_image_dma_buf_export, and returns
+ * -1 otherwise. Linux only. Default: off.
+ */
+int goatvr_set_export(int enable);
+int goatvr_get_export(void);
+/* fills bufs (GOATVR_EXPORT_BUFFERS entries) and returns the number of
+ * exported buffers, which is 0 until the first exported frame. Call it again
+ * when goatvr_export_frame returns a buffer with a different serial.
+ */
+int goatvr_export_buffers(struct goatvr_export_buffer *bufs);
+/* returns the index of the most recently exported buffer, or -1 if there
+ * isn't one yet, and holds it until it's passed to goatvr_export_release. If fence_fd is not null, it gets a sync file which signals
+ * when the copy to that buffer is complete, or -1 if the driver lacks
+ * EGL_ANDROID_native_fence_sync (or it was already claimed), in which case
+ * the buffer is only guaranteed to be complete after the next goatvr_draw_done.
+ * The caller owns the returned fence and must close it.
+ */
+int goatvr_export_frame(int *fence_fd);
+/* call once for every buffer returned by goatvr_export_frame, when the
+ * consumer is done reading it. Re-allocating the buffers releases them all.
+ */
+void goatvr_export_release(int idx);
+
+/* ---- frame capture ---- */
+
+/* pixels are 8-bit RGBA, sRGB-encoded, bottom row first, with no padding
+ * between rows. null pixels means the frame could not be captured.
+ */
+typedef void (*goatvr_capture_callback)(const void *pixels, int width, int height, void *cls);
+
+/* capture the next frame finished by goatvr_draw_done, without stalling it:
+ * the eye buffers are read back asynchronously, and func is called a few
+ * frames later from a capture thread, with the eyes laid out as returned by
+ * goatvr_get_fb_eye_* (scaled by the capture scale). pixels are only valid
+ * until func returns, and func must not call OpenGL. To record video call
+ * this every frame; frames are dropped (func called from goatvr_draw_done
+ * with null pixels) if the previous captures are still in flight.
+ * Needs OpenGL 3.2 or ARB_sync.
+ */
+void goatvr_capture_frame(goatvr_capture_callback func, void *cls);
+/* downscale captured frames on the GPU before reading them back, 0 < scale <= 1.
+ * Default: 1
+ */
+void goatvr_set_capture_scale(float scale);
+float goatvr_get_capture_scale(void);
+
+/* ---- spectator output ---- */
+
+/* publish every frame in a ring of frames in POSIX shared memory, for other
+ * processes (video encoders, operator displays) to read without any locking.
+ * See goatvr_spectator.h for the layout, and a function to read frames.
+ * name defaults to GOATVR_SPECTATOR_DEF_NAME if null. Frames are downscaled
+ * on the GPU to fit in max_width x max_height, and read back asynchronously,
+ * so they appear in the ring a few frames late, with the time and poses of
+ * the frame they were rendered in. Unix only, needs OpenGL 3.2 or ARB_sync.
+ * Fails if the shared memory object already exists (another instance, or one
+ * left by a crashed process, which must be removed with shm_unlink first), or
+ * if the ring would not fit in 4GB. Returns -1 on failure.
+ */
+int goatvr_spectator_start(const char *name, int max_width, int max_height);
+void goatvr_spectator_stop(void);
+/* publish a spectator camera view rendered by the application in tex, instead
+ * of the eye buffers, for the next frame only (call it every frame). view_mat
+ * is stored in the frame (can be null).
+ */
+void goatvr_spectator_camera(unsigned int tex, int width, int height, const float *view_mat);
+
+/* ---- overlay layers ---- */
+
+/* Overlay layers show a texture on a quad, or a section of a cylinder, over
+ * the HMD view. The Oculus and OpenVR modules hand them to the runtime
+ * compositor (quad/cylinder layers, overlays), which samples the texture
+ * directly at the display resolution; with the rest of the display modules
+ * goatvr_draw_done composites them over the eye buffers.
+ * type is GOATVR_LAYER_QUAD or GOATVR_LAYER_CYLINDER, optionally or-ed with
+ * GOATVR_LAYER_HEAD_LOCKED to make the layer pose relative to the head,
+ * instead of the tracking origin. width and height are in world units (see
+ * goatvr_set_units_scale), and the width of cylinders is the arc length.
+ * Quads face +Z, cylinders are centered on the layer position, with the arc
+ * centered on -Z. Textures have the origin at the bottom-left, and are
+ * alpha-blended (non-premultiplied).
+ */
+goatvr_layer *goatvr_layer_create(int type, unsigned int tex, float width, float height);
+void goatvr_layer_destroy(goatvr_layer *layer);
+/* the texture is passed on to the runtime only when this is called, call it
+ * again after changing the contents of the texture
+ */
+void goatvr_layer_texture(goatvr_layer *layer, unsigned int tex);
+void goatvr_layer_size(goatvr_layer *layer, float width, float height);
+// cylinder radius in world units (default: 1 meter)
+void goatvr_layer_radius(goatvr_layer *layer, float radius);
+// pos: x, y, z, quat: x, y, z, w. Either can be null.
+void goatvr_layer_pose(goatvr_layer *layer, const float *pos, const float *quat);
+void goatvr_layer_visible(goatvr_layer *layer, int visible);
+
 /* ---- tracking and input ---- */
 
 /* valid if goatvr_have_headtracking() */
@@ -197,6 +683,24 @@ int goatvr_lookup_stick(const char *name);
 int goatvr_activate_module(goatvr_module *vrmod);
 int goatvr_deactivate_module(goatvr_module *vrmod);
 
+/* Output modules are secondary display modules, which show the eye buffers
+ * rendered for the active display module, without rendering the scene again
+ * (for instance an HMD, and an sbs or 3dtv projection for spectators).
+ * Outputs present to the application window every frame, in place of the
+ * mirror, so the display module must be one which only uses the window as a
+ * mirror (HMDs). They are not used with the compositor thread. Currently the
+ * sbs, stereo, and 3dtv modules can be outputs. Returns -1 if the module
+ * can't be an output, or is the active display module.
+ * Outputs can also be selected with the GOATVR_OUTPUT environment variable.
+ */
+int goatvr_activate_output(goatvr_module *mod);
+int goatvr_deactivate_output(goatvr_module *mod);
+int goatvr_module_output(goatvr_module *mod);
+/* size of the output window, detected from the viewport by goatvr_startvr
+ * otherwise. Call it when the window is resized.
+ */
+void goatvr_output_size(goatvr_module *mod, int width, int height);
+
 int goatvr_num_modules(void);
 goatvr_module *goatvr_get_module(int idx);
 goatvr_module *goatvr_find_module(const char *name);
@@ -225,6 +729,16 @@ void goatvr_util_quat_to_matrix(float *mat, const float *quat);
 /* invert a matrix. returns 0 on success, -1 if singular */
 int goatvr_util_invert_matrix(float *inv, const float *mat);
 
+/* Test a batch of bounding volumes against frustum planes (as returned by
+ * goatvr_combined_frustum), using SSE where available. visible receives 1 for
+ * each volume which is at least partially inside, 0 otherwise. Returns the
+ * number of visible volumes.
+ * spheres: 4 floats per sphere (center x, y, z, radius)
+ * boxes: 6 floats per axis-aligned box (min x, y, z, max x, y, z)
+ */
+int goatvr_util_cull_spheres(const float *planes, const float *spheres, int count, unsigned char *visible);
+int goatvr_util_cull_boxes(const float *planes, const float *boxes, int count, unsigned char *visible);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,98 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GOATVR_SPECTATOR_H_
+#define GOATVR_SPECTATOR_H_
+
+/* Layout of the spectator frame ring, for processes reading the frames
+ * published by goatvr_spectator_start. It doesn't need linking to libgoatvr:
+ * shm_open the name passed to goatvr_spectator_start (O_RDONLY), mmap
+ * the size in the header (PROT_READ), and call goatvr_spectator_read.
+ *
+ * There is a single writer, and any number of readers, without any locks:
+ * frames are written round-robin to the slots, each one under a sequence
+ * lock (seq is odd while the slot is being written), and latest is updated
+ * after the slot is complete. Readers retry if seq was odd, or changed while
+ * they were copying the frame.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define GOATVR_SPECTATOR_DEF_NAME	"/goatvr-spectator"
+#define GOATVR_SPECTATOR_MAGIC		0x53525647	/* "GVRS" */
+#define GOATVR_SPECTATOR_VERSION	1
+#define GOATVR_SPECTATOR_SLOTS		4
+
+/* frame sources */
+enum {
+	GOATVR_SPECTATOR_MIRROR,	/* both eye buffers, downscaled */
+	GOATVR_SPECTATOR_CAMERA		/* a spectator camera view rendered by the application */
+};
+
+struct goatvr_spectator_frame {
+	volatile uint32_t seq;
+	uint32_t source;
+	uint32_t width, height;		/* 8-bit sRGB RGBA, bottom row first, width * 4 bytes per row */
+	uint32_t offset;			/* offset of the pixels from the start of the shared memory */
+	uint64_t frame;				/* frame id, incremented for every published frame */
+	uint64_t time_ns;			/* CLOCK_MONOTONIC time the frame was finished */
+	float head_pos[3], head_rot[4];		/* head pose, rotation quaternion: x, y, z, w */
+	float view[2][16];			/* per-eye view matrices, or camera view matrix in view[0] */
+	int32_t eye_rect[2][4];		/* x, y, width, height of each eye in the image (mirror) */
+};
+
+struct goatvr_spectator_header {
+	uint32_t magic, version;
+	uint32_t size;				/* size of the shared memory, including the pixels */
+	uint32_t num_slots;
+	uint32_t max_width, max_height;
+	volatile uint64_t latest;	/* latest complete frame id + 1, 0 if there isn't one yet */
+	struct goatvr_spectator_frame slot[GOATVR_SPECTATOR_SLOTS];
+};
+
+/* copy the latest frame, if it's newer than the last one read (last_frame:
+ * frame id + 1, initially 0). pixels must fit max_width * max_height * 4
+ * bytes. Returns 1 if a frame was copied, 0 if there isn't a newer one.
+ */
+static inline int goatvr_spectator_read(const struct goatvr_spectator_header *hdr, uint64_t *last_frame,
+		struct goatvr_spectator_frame *frm, void *pixels)
+{
+	for(;;) {
+		uint64_t latest = hdr->latest;
+		const struct goatvr_spectator_frame *slot;
+		uint32_t seq;
+
+		if(latest <= *last_frame) {
+			return 0;
+		}
+		slot = hdr->slot + (latest - 1) % hdr->num_slots;
+
+		seq = slot->seq;
+		if(seq & 1) continue;	/* being written */
+		__sync_synchronize();
+		memcpy(frm, (const void*)slot, sizeof *frm);
+		memcpy(pixels, (const char*)hdr + frm->offset, frm->width * frm->height * 4);
+		__sync_synchronize();
+		if(slot->seq == seq) {
+			*last_frame = frm->frame + 1;
+			return 1;
+		}
+	}
+}
+
+#endif	/* GOATVR_SPECTATOR_H_ */
@@ -0,0 +1,25 @@
+// generated file, do not edit!
+namespace goatvr {
+
+void register_mod_anaglyph();
+void register_mod_oculus();
+void register_mod_oculus_old();
+void register_mod_openhmd();
+void register_mod_openvr();
+void register_mod_sball();
+void register_mod_sbs();
+void register_mod_stereo();
+
+void register_modules()
+{
+	register_mod_anaglyph();
+	register_mod_oculus();
+	register_mod_oculus_old();
+	register_mod_openhmd();
+	register_mod_openvr();
+	register_mod_sball();
+	register_mod_sbs();
+	register_mod_stereo();
+}
+
+} // namespace goat
@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "autocfg.h"
 #include "goatvr_impl.h"
 #include "modman.h"
@@ -70,4 +71,25 @@ void goatvr::activate_module()
 			printf("activating rendering module: %s\n", rmod->get_name());
 		}
 	}
+
+	// secondary output modules, presenting the eye buffers of the display module
+	char *out_env = getenv("GOATVR_OUTPUT");
+	if(out_env && display_module) {
+		char *names = (char*)malloc(strlen(out_env) + 1);
+		strcpy(names, out_env);
+
+		char *name = strtok(names, ", ");
+		while(name) {
+			Module *m = find_module(name);
+			if(!m || !m->usable()) {
+				printf("output module %s not found, or not usable\n", name);
+			} else if(!activate_output(m)) {
+				printf("module %s can't be used as an output\n", name);
+			} else {
+				printf("activating output module: %s\n", m->get_name());
+			}
+			name = strtok(0, ", ");
+		}
+		free(names);
+	}
 }
@@ -0,0 +1,217 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "opengl.h"
+#include "capture.h"
+#include "readback.h"
+#include "rtex.h"
+#include "goatvr.h"
+
+using namespace goatvr;
+
+struct Request {
+	goatvr_capture_callback func;
+	void *cls;
+};
+
+struct Pending {
+	long id;
+	std::vector<Request> req;
+};
+
+static void collect();
+static void drop(std::vector<Request> &req);
+static void cap_thread_func();
+
+static float cap_scale = 1.0f;
+static std::vector<Request> cap_next;	// requested for the next frame
+static std::deque<Pending> cap_pending;	// queued readbacks, oldest first
+static long cap_frame;
+
+static Readback readback;
+
+// handed over to the capture thread, protected by cap_lock
+static std::vector<Request> work_req;
+static const void *work_pixels;
+static int work_width, work_height;
+static bool work_busy;
+
+static std::thread cap_thread;
+static std::mutex cap_lock;
+static std::condition_variable cap_cond;
+static bool cap_running;
+
+void goatvr::destroy_capture()
+{
+	if(cap_running) {
+		std::unique_lock<std::mutex> lk(cap_lock);
+		cap_running = false;
+		cap_cond.notify_all();
+		lk.unlock();
+		cap_thread.join();
+	}
+	drop(work_req);
+	work_busy = false;
+
+	readback.destroy();
+
+	while(!cap_pending.empty()) {
+		drop(cap_pending.front().req);
+		cap_pending.pop_front();
+	}
+	drop(cap_next);
+}
+
+void goatvr::capture_frame(const RenderTexture *rtex)
+{
+	if(cap_pending.empty() && cap_next.empty()) {
+		return;
+	}
+	// hand the completed readbacks over first, freeing their buffers
+	collect();
+
+	if(cap_next.empty()) {
+		return;
+	}
+
+	if(!glcaps.sync) {
+		fprintf(stderr, "goatvr: frame capture needs fence sync objects (GL 3.2 or ARB_sync)\n");
+		drop(cap_next);
+		return;
+	}
+
+	if(!cap_running) {
+		cap_running = true;
+		cap_thread = std::thread(cap_thread_func);
+	}
+
+	int width = std::max((int)(rtex->width * cap_scale + 0.5f), 1);
+	int height = std::max((int)(rtex->height * cap_scale + 0.5f), 1);
+
+	if(!readback.read_scaled(rtex->tex, rtex->width, rtex->height, width, height, cap_frame, rtex)) {
+		// all the readback buffers are still in flight
+		drop(cap_next);
+		return;
+	}
+
+	Pending p;
+	p.id = cap_frame++;
+	p.req.swap(cap_next);
+	cap_pending.push_back(p);
+}
+
+/* pass the oldest completed readback to the capture thread, if it's done
+ * with the previous one (which stays mapped until then).
+ */
+static void collect()
+{
+	std::unique_lock<std::mutex> lk(cap_lock);
+	if(work_busy) {
+		return;
+	}
+	readback.unmap();
+
+	if(cap_pending.empty()) {
+		return;
+	}
+
+	int width, height;
+	long id;
+	const void *pixels = readback.map(&width, &height, &id, false);
+	if(!pixels) {
+		return;
+	}
+
+	// older ones can only be missing if their buffer failed to map
+	while(!cap_pending.empty() && cap_pending.front().id < id) {
+		drop(cap_pending.front().req);
+		cap_pending.pop_front();
+	}
+	if(cap_pending.empty() || cap_pending.front().id != id) {
+		readback.unmap();
+		return;
+	}
+
+	work_req.swap(cap_pending.front().req);
+	cap_pending.pop_front();
+	work_pixels = pixels;
+	work_width = width;
+	work_height = height;
+	work_busy = true;
+	cap_cond.notify_all();
+}
+
+static void drop(std::vector<Request> &req)
+{
+	for(size_t i=0; i<req.size(); i++) {
+		req[i].func(0, 0, 0, req[i].cls);
+	}
+	req.clear();
+}
+
+static void cap_thread_func()
+{
+	std::unique_lock<std::mutex> lk(cap_lock);
+	while(cap_running) {
+		if(!work_busy) {
+			cap_cond.wait(lk);
+			continue;
+		}
+
+		// the buffer stays mapped until collect sees work_busy cleared
+		lk.unlock();
+		for(size_t i=0; i<work_req.size(); i++) {
+			work_req[i].func(work_pixels, work_width, work_height, work_req[i].cls);
+		}
+		lk.lock();
+
+		work_req.clear();
+		work_busy = false;
+	}
+}
+
+extern "C" {
+
+void goatvr_capture_frame(goatvr_capture_callback func, void *cls)
+{
+	Request req;
+	req.func = func;
+	req.cls = cls;
+	cap_next.push_back(req);
+}
+
+void goatvr_set_capture_scale(float scale)
+{
+	if(scale <= 0.0f || scale > 1.0f) {
+		scale = 1.0f;
+	}
+	cap_scale = scale;
+}
+
+float goatvr_get_capture_scale(void)
+{
+	return cap_scale;
+}
+
+}	// extern "C"
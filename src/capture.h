@@ -0,0 +1,39 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+/* Asynchronous frame capture (see goatvr_capture_frame). The eye buffers are
+ * optionally downscaled on the GPU, and read back through a Readback ring.
+ * Completed readbacks are picked up a few frames later, and handed to a
+ * worker thread which calls the application callbacks with the mapped
+ * pixels, so neither the GPU nor the callbacks ever stall goatvr_draw_done.
+ */
+
+namespace goatvr {
+
+class RenderTexture;
+
+void destroy_capture();
+
+// queue the requested captures of this frame. Called by goatvr_draw_done.
+void capture_frame(const RenderTexture *rtex);
+
+}	// namespace goatvr
+
+#endif	// CAPTURE_H_
@@ -0,0 +1,494 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "opengl.h"
+#include "compositor.h"
+#include "module.h"
+#include "rtex.h"
+
+#if defined(__unix__) && !defined(__APPLE__)
+#define COMP_GLX
+#include <GL/glx.h>
+#elif defined(WIN32)
+#define COMP_WGL
+#include <windows.h>
+#endif
+
+#ifndef GL_DRAW_FRAMEBUFFER_BINDING
+#define GL_DRAW_FRAMEBUFFER_BINDING	0x8ca6
+#define GL_READ_FRAMEBUFFER_BINDING	0x8caa
+#endif
+#ifndef GL_CONTEXT_PROFILE_MASK
+#define GL_CONTEXT_PROFILE_MASK		0x9126
+#endif
+
+// same values for the GLX_ and WGL_ARB_create_context attributes
+#define CTX_MAJOR_VERSION	0x2091
+#define CTX_MINOR_VERSION	0x2092
+#define CTX_PROFILE_MASK	0x9126
+
+#define COMP_FRAMES	3
+
+using namespace goatvr;
+
+static bool create_context();
+static void destroy_context();
+static bool make_current(bool cur);
+static void swap_buffers();
+static void set_swap_interval(int n);
+static void comp_thread_func();
+static bool alloc_frame_tex(int idx, int width, int height);
+static bool copy_frame(int idx, const RenderTexture *rtex);
+
+struct Frame {
+	unsigned int tex;
+	int tex_width, tex_height;
+	RenderTexture layout;	// eye rectangles in tex
+	PresentParams params;	// module state to present with, taken by submit_frame
+	GLsync ready;	// signalled when the copy to tex is done (app -> compositor)
+	GLsync done;	// signalled when the compositor is done reading tex (compositor -> app)
+};
+
+static Frame frames[COMP_FRAMES];
+static int latest = -1;	// last submitted frame, not picked up by the compositor yet
+static int shown = -1;	// frame the compositor presents
+static unsigned int copy_fbo[2];
+
+static Module *comp_mod;
+static std::thread comp_thread;
+static std::mutex comp_lock;
+static std::condition_variable comp_cond;
+static bool comp_running;
+static bool comp_started;	// set by the thread once its context is current
+static Module *comp_failed_mod;	// don't keep retrying every frame
+
+#ifdef COMP_GLX
+typedef GLXContext (*GLXCreateContextAttribsFunc)(Display*, GLXFBConfig, GLXContext, Bool, const int*);
+typedef void (*GLXSwapIntervalEXTFunc)(Display*, GLXDrawable, int);
+
+static Display *dpy;
+static GLXDrawable drawable;
+static GLXContext ctx;
+#endif
+
+#ifdef COMP_WGL
+typedef HGLRC (WINAPI *WGLCreateContextAttribsFunc)(HDC, HGLRC, const int*);
+typedef BOOL (WINAPI *WGLSwapIntervalFunc)(int);
+
+static HDC hdc;
+static HGLRC ctx;
+#endif
+
+bool goatvr::start_compositor(Module *mod)
+{
+	if(comp_mod == mod) {
+		return true;
+	}
+	stop_compositor();
+
+	if(!glcaps.sync || !mod->can_present() || mod == comp_failed_mod) {
+		return false;
+	}
+	if(!create_context()) {
+		fprintf(stderr, "goatvr: failed to create the compositor OpenGL context\n");
+		comp_failed_mod = mod;
+		return false;
+	}
+
+	// anything the module kept for presenting in this context can't be used by the other
+	mod->release_present();
+
+	comp_mod = mod;
+	comp_running = true;
+	comp_started = false;
+	comp_thread = std::thread(comp_thread_func);
+
+	// wait for the thread to either start presenting, or give up
+	bool started;
+	{
+		std::unique_lock<std::mutex> lk(comp_lock);
+		comp_cond.wait(lk, []{ return comp_started || !comp_running; });
+		started = comp_started;
+	}
+	if(!started) {
+		stop_compositor();
+		comp_failed_mod = mod;
+		return false;
+	}
+	printf("goatvr: compositor thread started for module: %s\n", mod->get_name());
+	return true;
+}
+
+void goatvr::stop_compositor()
+{
+	if(!comp_mod) return;
+
+	{
+		std::lock_guard<std::mutex> lk(comp_lock);
+		comp_running = false;
+	}
+	comp_cond.notify_all();
+	comp_thread.join();
+	destroy_context();
+
+	for(int i=0; i<COMP_FRAMES; i++) {
+		if(frames[i].ready) {
+			glDeleteSync(frames[i].ready);
+		}
+		if(frames[i].done) {
+			glDeleteSync(frames[i].done);
+		}
+		if(frames[i].tex) {
+			glDeleteTextures(1, &frames[i].tex);
+		}
+		frames[i] = Frame();
+	}
+	latest = shown = -1;
+
+	if(copy_fbo[0]) {
+		glDeleteFramebuffers(2, copy_fbo);
+		copy_fbo[0] = copy_fbo[1] = 0;
+	}
+	comp_mod = 0;
+}
+
+Module *goatvr::compositor_module()
+{
+	return comp_mod;
+}
+
+void goatvr::submit_frame(const RenderTexture *rtex)
+{
+	if(!comp_mod || !rtex->tex) return;
+
+	// any frame which is neither waiting to be picked up, nor being presented
+	int idx;
+	{
+		std::lock_guard<std::mutex> lk(comp_lock);
+		for(idx=0; idx<COMP_FRAMES; idx++) {
+			if(idx != latest && idx != shown) break;
+		}
+	}
+	Frame *frm = frames + idx;
+
+	/* the compositor might still be reading this one from a previous frame,
+	 * make the GPU wait for it before overwriting it.
+	 */
+	if(frm->done) {
+		glWaitSync(frm->done, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(frm->done);
+		frm->done = 0;
+	}
+
+	if(!alloc_frame_tex(idx, rtex->tex_width, rtex->tex_height) || !copy_frame(idx, rtex)) {
+		return;
+	}
+	frm->layout = *rtex;
+	frm->layout.tex = frm->tex;
+	frm->layout.external = true;	// never owned by the layout copy
+	comp_mod->get_present_params(&frm->params);
+
+	frm->ready = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();	// the fence must reach the GPU before the other context waits on it
+
+	{
+		std::lock_guard<std::mutex> lk(comp_lock);
+		if(latest >= 0 && frames[latest].ready) {
+			// dropped without being presented
+			glDeleteSync(frames[latest].ready);
+			frames[latest].ready = 0;
+		}
+		latest = idx;
+	}
+	comp_cond.notify_all();
+}
+
+static void comp_thread_func()
+{
+	bool cur = make_current(true);
+	{
+		std::lock_guard<std::mutex> lk(comp_lock);
+		if(cur) {
+			comp_started = true;
+		} else {
+			comp_running = false;
+		}
+	}
+	comp_cond.notify_all();
+	if(!cur) {
+		fprintf(stderr, "goatvr: compositor thread failed to make its context current\n");
+		return;
+	}
+	set_swap_interval(1);
+
+	for(;;) {
+		int idx;
+		GLsync ready;
+		PresentParams par;
+		{
+			std::unique_lock<std::mutex> lk(comp_lock);
+			// nothing to show until the first frame arrives
+			comp_cond.wait(lk, []{ return !comp_running || latest >= 0 || shown >= 0; });
+			if(!comp_running) break;
+
+			if(latest >= 0) {
+				shown = latest;
+				latest = -1;
+			}
+			idx = shown;
+			ready = frames[idx].ready;
+			frames[idx].ready = 0;
+			par = frames[idx].params;
+		}
+
+		if(ready) {
+			glWaitSync(ready, 0, GL_TIMEOUT_IGNORED);
+			glDeleteSync(ready);
+		}
+		comp_mod->present(frames[idx].tex, &frames[idx].layout, &par);
+
+		GLsync done = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		{
+			std::lock_guard<std::mutex> lk(comp_lock);
+			if(frames[idx].done) {
+				glDeleteSync(frames[idx].done);
+			}
+			frames[idx].done = done;
+		}
+
+		swap_buffers();
+	}
+
+	comp_mod->release_present();
+	glFinish();
+	make_current(false);
+}
+
+static bool alloc_frame_tex(int idx, int width, int height)
+{
+	Frame *frm = frames + idx;
+
+	if(frm->tex && frm->tex_width == width && frm->tex_height == height) {
+		return true;
+	}
+	if(frm->tex) {
+		glDeleteTextures(1, &frm->tex);
+	}
+	frm->tex_width = width;
+	frm->tex_height = height;
+
+	if(glcaps.dsa) {
+		glCreateTextures(GL_TEXTURE_2D, 1, &frm->tex);
+		glTextureParameteri(frm->tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(frm->tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureStorage2D(frm->tex, 1, GL_SRGB8, width, height);
+	} else {
+		int prev_tex;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &prev_tex);
+
+		glGenTextures(1, &frm->tex);
+		glBindTexture(GL_TEXTURE_2D, frm->tex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+
+		glBindTexture(GL_TEXTURE_2D, prev_tex);
+	}
+	return frm->tex != 0;
+}
+
+static bool copy_frame(int idx, const RenderTexture *rtex)
+{
+#ifndef GL_VERSION_3_0
+	if(!glBlitFramebuffer) return false;
+#endif
+
+	if(!copy_fbo[0]) {
+		glGenFramebuffers(2, copy_fbo);
+	}
+
+	int prev_draw_fb, prev_read_fb;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_draw_fb);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_read_fb);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, copy_fbo[0]);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rtex->tex, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copy_fbo[1]);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frames[idx].tex, 0);
+
+	// blits are subject to the scissor test
+	bool scissor = glIsEnabled(GL_SCISSOR_TEST);
+	if(scissor) glDisable(GL_SCISSOR_TEST);
+
+	glBlitFramebuffer(0, 0, rtex->width, rtex->height, 0, 0, rtex->width, rtex->height,
+			GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	if(scissor) glEnable(GL_SCISSOR_TEST);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prev_draw_fb);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_read_fb);
+	return true;
+}
+
+/* The compositor context is created with the same version and profile as
+ * the application's, on the same framebuffer config, sharing its objects.
+ * It's made current on the application window from the compositor thread.
+ */
+#ifdef COMP_GLX
+static bool create_context()
+{
+	GLXContext app_ctx = glXGetCurrentContext();
+	dpy = glXGetCurrentDisplay();
+	drawable = glXGetCurrentDrawable();
+	if(!app_ctx || !dpy || !drawable) {
+		return false;
+	}
+
+	int cfgid, scr;
+	if(glXQueryContext(dpy, app_ctx, GLX_FBCONFIG_ID, &cfgid) != Success ||
+			glXQueryContext(dpy, app_ctx, GLX_SCREEN, &scr) != Success) {
+		return false;
+	}
+	int cfgattr[] = {GLX_FBCONFIG_ID, cfgid, None};
+	int num_cfg;
+	GLXFBConfig *cfg = glXChooseFBConfig(dpy, scr, cfgattr, &num_cfg);
+	if(!cfg) {
+		return false;
+	}
+
+	GLXCreateContextAttribsFunc create_ctx_attr = (GLXCreateContextAttribsFunc)
+		glXGetProcAddress((const unsigned char*)"glXCreateContextAttribsARB");
+	if(create_ctx_attr && glcaps.version >= 32) {
+		int profile;
+		glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+		int attr[] = {
+			CTX_MAJOR_VERSION, glcaps.version / 10,
+			CTX_MINOR_VERSION, glcaps.version % 10,
+			CTX_PROFILE_MASK, profile,
+			None
+		};
+		ctx = create_ctx_attr(dpy, cfg[0], app_ctx, True, attr);
+	} else {
+		ctx = glXCreateNewContext(dpy, cfg[0], GLX_RGBA_TYPE, app_ctx, True);
+	}
+	XFree(cfg);
+	return ctx != 0;
+}
+
+static void destroy_context()
+{
+	if(ctx) {
+		glXDestroyContext(dpy, ctx);
+		ctx = 0;
+	}
+}
+
+static bool make_current(bool cur)
+{
+	if(cur) {
+		return glXMakeContextCurrent(dpy, drawable, drawable, ctx);
+	}
+	return glXMakeContextCurrent(dpy, None, None, 0);
+}
+
+static void swap_buffers()
+{
+	glXSwapBuffers(dpy, drawable);
+}
+
+static void set_swap_interval(int n)
+{
+	GLXSwapIntervalEXTFunc swap_interval = (GLXSwapIntervalEXTFunc)
+		glXGetProcAddress((const unsigned char*)"glXSwapIntervalEXT");
+	if(swap_interval) {
+		swap_interval(dpy, drawable, n);
+	}
+}
+#endif	// COMP_GLX
+
+#ifdef COMP_WGL
+static bool create_context()
+{
+	HGLRC app_ctx = wglGetCurrentContext();
+	hdc = wglGetCurrentDC();
+	if(!app_ctx || !hdc) {
+		return false;
+	}
+
+	WGLCreateContextAttribsFunc create_ctx_attr = (WGLCreateContextAttribsFunc)
+		wglGetProcAddress("wglCreateContextAttribsARB");
+	if(create_ctx_attr && glcaps.version >= 32) {
+		int profile;
+		glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+		int attr[] = {
+			CTX_MAJOR_VERSION, glcaps.version / 10,
+			CTX_MINOR_VERSION, glcaps.version % 10,
+			CTX_PROFILE_MASK, profile,
+			0
+		};
+		ctx = create_ctx_attr(hdc, app_ctx, attr);
+	} else {
+		if((ctx = wglCreateContext(hdc)) && !wglShareLists(app_ctx, ctx)) {
+			wglDeleteContext(ctx);
+			ctx = 0;
+		}
+	}
+	return ctx != 0;
+}
+
+static void destroy_context()
+{
+	if(ctx) {
+		wglDeleteContext(ctx);
+		ctx = 0;
+	}
+}
+
+static bool make_current(bool cur)
+{
+	return wglMakeCurrent(cur ? hdc : 0, cur ? ctx : 0);
+}
+
+static void swap_buffers()
+{
+	SwapBuffers(hdc);
+}
+
+static void set_swap_interval(int n)
+{
+	WGLSwapIntervalFunc swap_interval = (WGLSwapIntervalFunc)wglGetProcAddress("wglSwapIntervalEXT");
+	if(swap_interval) {
+		swap_interval(n);
+	}
+}
+#endif	// COMP_WGL
+
+#if !defined(COMP_GLX) && !defined(COMP_WGL)
+static bool create_context()
+{
+	return false;	// not implemented on this platform
+}
+
+static void destroy_context() {}
+static bool make_current(bool cur) { return false; }
+static void swap_buffers() {}
+static void set_swap_interval(int n) {}
+#endif
@@ -0,0 +1,52 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef COMPOSITOR_H_
+#define COMPOSITOR_H_
+
+/* Compositor thread. Presentation (Module::present and the window buffer
+ * swap) runs on a thread of its own, with a second OpenGL context sharing
+ * objects with the application's, and drawing to the same window. The
+ * application thread only renders the eye buffers: submit_frame copies them
+ * to one of a few frame textures, and hands that over with a fence. The
+ * compositor thread presents the latest frame it got at every vsync, and
+ * repeats the previous one as is if the application didn't make it in time
+ * (there's no reprojection of stale frames).
+ */
+
+namespace goatvr {
+
+class Module;
+class RenderTexture;
+
+/* start presenting for mod, which must be able to (Module::can_present).
+ * Called with the application context current. Restarts the thread if it
+ * was running for another module. Returns false, and doesn't try again for
+ * the same module, if the thread can't get a context of its own to present
+ * with; goatvr_draw_done presents from the application thread instead.
+ */
+bool start_compositor(Module *mod);
+void stop_compositor();
+// module the compositor thread is presenting for, or null if it's not running
+Module *compositor_module();
+
+// hand over the frame rendered in rtex. Called by goatvr_draw_done.
+void submit_frame(const RenderTexture *rtex);
+
+}	// namespace goatvr
+
+#endif	// COMPOSITOR_H_
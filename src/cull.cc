@@ -0,0 +1,178 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <math.h>
+#include "goatvr_impl.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CULL_SSE
+#include <xmmintrin.h>
+#endif
+
+using namespace goatvr;
+
+static inline bool sphere_visible(const float *planes, const float *sph);
+static inline bool box_visible(const float *planes, const float *box);
+
+extern "C" {
+
+int goatvr_util_cull_spheres(const float *planes, const float *spheres, int count, unsigned char *visible)
+{
+	int num_vis = 0;
+	int i = 0;
+
+#ifdef CULL_SSE
+	// 4 spheres at a time, transposed to x/y/z/r vectors
+	__m128 zero = _mm_setzero_ps();
+	for(; i<(count & ~3); i+=4) {
+		__m128 x = _mm_loadu_ps(spheres);
+		__m128 y = _mm_loadu_ps(spheres + 4);
+		__m128 z = _mm_loadu_ps(spheres + 8);
+		__m128 r = _mm_loadu_ps(spheres + 12);
+		_MM_TRANSPOSE4_PS(x, y, z, r);
+		__m128 neg_r = _mm_sub_ps(zero, r);
+
+		__m128 outside = zero;
+		for(int j=0; j<6; j++) {
+			const float *p = planes + j * 4;
+			__m128 d = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(p[0])), _mm_mul_ps(y, _mm_set1_ps(p[1])));
+			d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(p[2])));
+			d = _mm_add_ps(d, _mm_set1_ps(p[3]));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(d, neg_r));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		for(int j=0; j<4; j++) {
+			visible[i + j] = (mask & (1 << j)) ? 0 : 1;
+			num_vis += visible[i + j];
+		}
+		spheres += 16;
+	}
+#endif
+
+	for(; i<count; i++) {
+		visible[i] = sphere_visible(planes, spheres) ? 1 : 0;
+		num_vis += visible[i];
+		spheres += 4;
+	}
+	return num_vis;
+}
+
+int goatvr_util_cull_boxes(const float *planes, const float *boxes, int count, unsigned char *visible)
+{
+	int num_vis = 0;
+	int i = 0;
+
+#ifdef CULL_SSE
+	/* 4 boxes at a time, as center/half-extent vectors. A box is outside if
+	 * its center is further behind a plane than its projected radius.
+	 */
+	__m128 zero = _mm_setzero_ps();
+	__m128 half = _mm_set1_ps(0.5f);
+	for(; i<(count & ~3); i+=4) {
+		const float *b = boxes;
+		__m128 cen[3], ext[3];
+		for(int k=0; k<3; k++) {
+			__m128 bmin = _mm_setr_ps(b[k], b[k + 6], b[k + 12], b[k + 18]);
+			__m128 bmax = _mm_setr_ps(b[k + 3], b[k + 9], b[k + 15], b[k + 21]);
+			cen[k] = _mm_mul_ps(_mm_add_ps(bmin, bmax), half);
+			ext[k] = _mm_mul_ps(_mm_sub_ps(bmax, bmin), half);
+		}
+
+		__m128 outside = zero;
+		for(int j=0; j<6; j++) {
+			const float *p = planes + j * 4;
+			__m128 d = _mm_add_ps(_mm_mul_ps(cen[0], _mm_set1_ps(p[0])), _mm_mul_ps(cen[1], _mm_set1_ps(p[1])));
+			d = _mm_add_ps(d, _mm_mul_ps(cen[2], _mm_set1_ps(p[2])));
+			d = _mm_add_ps(d, _mm_set1_ps(p[3]));
+
+			__m128 rad = _mm_add_ps(_mm_mul_ps(ext[0], _mm_set1_ps(fabs(p[0]))),
+					_mm_mul_ps(ext[1], _mm_set1_ps(fabs(p[1]))));
+			rad = _mm_add_ps(rad, _mm_mul_ps(ext[2], _mm_set1_ps(fabs(p[2]))));
+
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_sub_ps(zero, rad)));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		for(int j=0; j<4; j++) {
+			visible[i + j] = (mask & (1 << j)) ? 0 : 1;
+			num_vis += visible[i + j];
+		}
+		boxes += 24;
+	}
+#endif
+
+	for(; i<count; i++) {
+		visible[i] = box_visible(planes, boxes) ? 1 : 0;
+		num_vis += visible[i];
+		boxes += 6;
+	}
+	return num_vis;
+}
+
+}	// extern "C"
+
+void goatvr::calc_frustum_planes(float *planes, const Mat4 &m)
+{
+	/* Gribb/Hartmann plane extraction. Mat4 is in OpenGL order (m[col][row]),
+	 * so each plane is a combination of the w row with one of the other rows.
+	 */
+	static const float sign[] = {1, -1};
+	for(int i=0; i<6; i++) {
+		int row = i / 2;
+		float s = sign[i & 1];
+		float *p = planes + i * 4;
+
+		for(int j=0; j<4; j++) {
+			p[j] = m[j][3] + s * m[j][row];
+		}
+
+		float len = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+		if(len != 0.0f) {
+			for(int j=0; j<4; j++) {
+				p[j] /= len;
+			}
+		}
+	}
+}
+
+static inline bool sphere_visible(const float *planes, const float *sph)
+{
+	for(int i=0; i<6; i++) {
+		const float *p = planes + i * 4;
+		float d = p[0] * sph[0] + p[1] * sph[1] + p[2] * sph[2] + p[3];
+		if(d < -sph[3]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static inline bool box_visible(const float *planes, const float *box)
+{
+	for(int i=0; i<6; i++) {
+		const float *p = planes + i * 4;
+		// test the corner furthest along the plane normal
+		float x = p[0] >= 0.0f ? box[3] : box[0];
+		float y = p[1] >= 0.0f ? box[4] : box[1];
+		float z = p[2] >= 0.0f ? box[5] : box[2];
+		if(p[0] * x + p[1] * y + p[2] * z + p[3] < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,375 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "opengl.h"
+#include "export.h"
+#include "rtex.h"
+#include "goatvr.h"
+
+#if defined(__unix__)
+#include <unistd.h>
+#include <dlfcn.h>
+#endif
+
+#ifndef GL_DRAW_FRAMEBUFFER_BINDING
+#define GL_DRAW_FRAMEBUFFER_BINDING	0x8ca6
+#define GL_READ_FRAMEBUFFER_BINDING	0x8caa
+#endif
+
+// the bits of EGL we need, to avoid depending on the EGL headers
+typedef void *EGLDisplay;
+typedef void *EGLContext;
+typedef void *EGLImageKHR;
+typedef void *EGLSyncKHR;
+typedef void *EGLClientBuffer;
+typedef int32_t EGLint;
+typedef unsigned int EGLenum;
+typedef unsigned int EGLBoolean;
+typedef uint64_t EGLuint64KHR;
+
+#define EGL_NONE						0x3038
+#define EGL_EXTENSIONS					0x3055
+#define EGL_GL_TEXTURE_2D_KHR			0x30b1
+#define EGL_GL_TEXTURE_LEVEL_KHR		0x30bc
+#define EGL_SYNC_NATIVE_FENCE_ANDROID	0x3144
+
+using namespace goatvr;
+
+struct ExportBuffer {
+	unsigned int tex;
+	EGLImageKHR img;
+	goatvr_export_buffer info;
+	int held;	// returned by goatvr_export_frame and not released yet
+};
+
+static bool init_egl();
+static bool have_eglext(const char *name);
+static bool alloc_buffers(int width, int height);
+static void free_buffers();
+static void close_fd(int fd);
+
+static bool exp_enabled;
+static ExportBuffer expbuf[GOATVR_EXPORT_BUFFERS];
+static int num_expbuf;
+static int exp_width, exp_height;
+static int exp_serial;
+static int exp_cur = -1;		// last buffer written
+static int exp_fence = -1;		// sync file of the last frame, until claimed
+static unsigned int exp_fbo[2];
+
+static EGLDisplay dpy;
+
+static void *(*eglGetProcAddress)(const char *name);
+static EGLDisplay (*eglGetCurrentDisplay)();
+static EGLContext (*eglGetCurrentContext)();
+static const char *(*eglQueryString)(EGLDisplay dpy, EGLint name);
+
+static EGLImageKHR (*eglCreateImageKHR)(EGLDisplay dpy, EGLContext ctx, EGLenum target,
+		EGLClientBuffer buf, const EGLint *attr);
+static EGLBoolean (*eglDestroyImageKHR)(EGLDisplay dpy, EGLImageKHR img);
+static EGLBoolean (*eglExportDMABUFImageQueryMESA)(EGLDisplay dpy, EGLImageKHR img, int *fourcc,
+		int *num_planes, EGLuint64KHR *modifiers);
+static EGLBoolean (*eglExportDMABUFImageMESA)(EGLDisplay dpy, EGLImageKHR img, int *fds,
+		EGLint *strides, EGLint *offsets);
+
+// EGL_ANDROID_native_fence_sync (optional)
+static EGLSyncKHR (*eglCreateSyncKHR)(EGLDisplay dpy, EGLenum type, const EGLint *attr);
+static EGLBoolean (*eglDestroySyncKHR)(EGLDisplay dpy, EGLSyncKHR sync);
+static EGLint (*eglDupNativeFenceFDANDROID)(EGLDisplay dpy, EGLSyncKHR sync);
+
+void goatvr::destroy_export()
+{
+	free_buffers();
+	if(exp_fbo[0]) {
+		glDeleteFramebuffers(2, exp_fbo);
+		exp_fbo[0] = exp_fbo[1] = 0;
+	}
+	close_fd(exp_fence);
+	exp_fence = -1;
+	exp_cur = -1;
+}
+
+void goatvr::export_frame(const RenderTexture *rtex)
+{
+	if(!exp_enabled || !rtex->tex) return;
+
+	if(rtex->width != exp_width || rtex->height != exp_height || !num_expbuf) {
+		if(!alloc_buffers(rtex->width, rtex->height)) {
+			fprintf(stderr, "goatvr: failed to allocate the export buffers, disabling export\n");
+			free_buffers();
+			exp_enabled = false;
+			return;
+		}
+	}
+	// never overwrite a buffer the consumer may still be reading
+	int idx = -1;
+	for(int i=1; i<=num_expbuf; i++) {
+		int next = (exp_cur + i) % num_expbuf;
+		if(!expbuf[next].held) {
+			idx = next;
+			break;
+		}
+	}
+	if(idx < 0) {
+		return;	// all held, drop this frame
+	}
+
+	if(!exp_fbo[0]) {
+		glGenFramebuffers(2, exp_fbo);
+	}
+
+	int prev_draw_fb, prev_read_fb;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_draw_fb);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_read_fb);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, exp_fbo[0]);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rtex->tex, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, exp_fbo[1]);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, expbuf[idx].tex, 0);
+
+	/* blits are subject to the scissor test, and sRGB encoding on write. The
+	 * exported buffer gets the sRGB-encoded pixels as they are.
+	 */
+	bool scissor = glIsEnabled(GL_SCISSOR_TEST);
+	bool srgb = glIsEnabled(GL_FRAMEBUFFER_SRGB);
+	if(scissor) glDisable(GL_SCISSOR_TEST);
+	if(srgb) glDisable(GL_FRAMEBUFFER_SRGB);
+
+	glBlitFramebuffer(0, 0, exp_width, exp_height, 0, 0, exp_width, exp_height,
+			GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	if(scissor) glEnable(GL_SCISSOR_TEST);
+	if(srgb) glEnable(GL_FRAMEBUFFER_SRGB);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prev_draw_fb);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_read_fb);
+
+	// nobody claimed the previous frame's fence
+	close_fd(exp_fence);
+	exp_fence = -1;
+
+	if(eglDupNativeFenceFDANDROID) {
+		static const EGLint attr[] = {EGL_NONE};
+		EGLSyncKHR sync = eglCreateSyncKHR(dpy, EGL_SYNC_NATIVE_FENCE_ANDROID, attr);
+		glFlush();	// the native fence is only created when the commands are flushed
+		if(sync) {
+			exp_fence = eglDupNativeFenceFDANDROID(dpy, sync);
+			eglDestroySyncKHR(dpy, sync);
+		}
+	} else {
+		glFlush();
+	}
+	exp_cur = idx;
+}
+
+static bool init_egl()
+{
+#if defined(__unix__)
+	if(!eglGetProcAddress) {
+		eglGetProcAddress = (void *(*)(const char*))dlsym(RTLD_DEFAULT, "eglGetProcAddress");
+		eglGetCurrentDisplay = (EGLDisplay (*)())dlsym(RTLD_DEFAULT, "eglGetCurrentDisplay");
+		eglGetCurrentContext = (EGLContext (*)())dlsym(RTLD_DEFAULT, "eglGetCurrentContext");
+		eglQueryString = (const char *(*)(EGLDisplay, EGLint))dlsym(RTLD_DEFAULT, "eglQueryString");
+	}
+	if(!eglGetProcAddress || !eglGetCurrentDisplay || !eglGetCurrentContext || !eglQueryString) {
+		return false;	// libEGL is not loaded, so the context is not an EGL one
+	}
+	if(!eglGetCurrentContext() || !(dpy = eglGetCurrentDisplay())) {
+		return false;
+	}
+
+	if(!have_eglext("EGL_KHR_gl_texture_2D_image") || !have_eglext("EGL_MESA_image_dma_buf_export")) {
+		return false;
+	}
+	eglCreateImageKHR = (EGLImageKHR (*)(EGLDisplay, EGLContext, EGLenum, EGLClientBuffer, const EGLint*))
+		eglGetProcAddress("eglCreateImageKHR");
+	eglDestroyImageKHR = (EGLBoolean (*)(EGLDisplay, EGLImageKHR))eglGetProcAddress("eglDestroyImageKHR");
+	eglExportDMABUFImageQueryMESA = (EGLBoolean (*)(EGLDisplay, EGLImageKHR, int*, int*, EGLuint64KHR*))
+		eglGetProcAddress("eglExportDMABUFImageQueryMESA");
+	eglExportDMABUFImageMESA = (EGLBoolean (*)(EGLDisplay, EGLImageKHR, int*, EGLint*, EGLint*))
+		eglGetProcAddress("eglExportDMABUFImageMESA");
+	if(!eglCreateImageKHR || !eglDestroyImageKHR || !eglExportDMABUFImageQueryMESA || !eglExportDMABUFImageMESA) {
+		return false;
+	}
+
+	if(have_eglext("EGL_ANDROID_native_fence_sync")) {
+		eglCreateSyncKHR = (EGLSyncKHR (*)(EGLDisplay, EGLenum, const EGLint*))eglGetProcAddress("eglCreateSyncKHR");
+		eglDestroySyncKHR = (EGLBoolean (*)(EGLDisplay, EGLSyncKHR))eglGetProcAddress("eglDestroySyncKHR");
+		eglDupNativeFenceFDANDROID = (EGLint (*)(EGLDisplay, EGLSyncKHR))
+			eglGetProcAddress("eglDupNativeFenceFDANDROID");
+		if(!eglCreateSyncKHR || !eglDestroySyncKHR) {
+			eglDupNativeFenceFDANDROID = 0;
+		}
+	}
+	return true;
+#else
+	return false;	// dma-bufs are a Linux thing
+#endif
+}
+
+static bool have_eglext(const char *name)
+{
+	const char *extstr = eglQueryString(dpy, EGL_EXTENSIONS);
+	if(!extstr) return false;
+
+	int len = strlen(name);
+	const char *ptr = extstr;
+	while((ptr = strstr(ptr, name))) {
+		if((ptr == extstr || ptr[-1] == ' ') && (ptr[len] == ' ' || ptr[len] == 0)) {
+			return true;
+		}
+		ptr += len;
+	}
+	return false;
+}
+
+static bool alloc_buffers(int width, int height)
+{
+	free_buffers();
+
+	exp_width = width;
+	exp_height = height;
+	++exp_serial;
+
+	for(int i=0; i<GOATVR_EXPORT_BUFFERS; i++) {
+		ExportBuffer *buf = expbuf + num_expbuf++;
+		// free_buffers cleans up after a failure at any point below
+		memset(buf, 0, sizeof *buf);
+		buf->info.fd = -1;
+
+		// immutable storage, so the image can't be respecified under the consumer
+		if(glcaps.dsa) {
+			glCreateTextures(GL_TEXTURE_2D, 1, &buf->tex);
+			glTextureStorage2D(buf->tex, 1, GL_RGBA8, width, height);
+		} else {
+			int prev_tex;
+			glGetIntegerv(GL_TEXTURE_BINDING_2D, &prev_tex);
+			glGenTextures(1, &buf->tex);
+			glBindTexture(GL_TEXTURE_2D, buf->tex);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+			glBindTexture(GL_TEXTURE_2D, prev_tex);
+		}
+
+		static const EGLint attr[] = {EGL_GL_TEXTURE_LEVEL_KHR, 0, EGL_NONE};
+		buf->img = eglCreateImageKHR(dpy, eglGetCurrentContext(), EGL_GL_TEXTURE_2D_KHR,
+				(EGLClientBuffer)(uintptr_t)buf->tex, attr);
+		if(!buf->img) {
+			return false;
+		}
+
+		int fourcc, nplanes;
+		EGLuint64KHR modifier;
+		if(!eglExportDMABUFImageQueryMESA(dpy, buf->img, &fourcc, &nplanes, &modifier) || nplanes != 1) {
+			return false;
+		}
+		int fd;
+		EGLint stride, offset;
+		if(!eglExportDMABUFImageMESA(dpy, buf->img, &fd, &stride, &offset)) {
+			return false;
+		}
+
+		buf->info.fd = fd;
+		buf->info.fourcc = (unsigned int)fourcc;
+		buf->info.modifier = modifier;
+		buf->info.stride = stride;
+		buf->info.offset = offset;
+		buf->info.width = width;
+		buf->info.height = height;
+		buf->info.serial = exp_serial;
+	}
+	exp_cur = -1;
+	return true;
+}
+
+static void free_buffers()
+{
+	for(int i=0; i<num_expbuf; i++) {
+		close_fd(expbuf[i].info.fd);
+		if(expbuf[i].img) {
+			eglDestroyImageKHR(dpy, expbuf[i].img);
+		}
+		glDeleteTextures(1, &expbuf[i].tex);
+		memset(expbuf + i, 0, sizeof *expbuf);
+		expbuf[i].info.fd = -1;
+	}
+	num_expbuf = 0;
+	exp_width = exp_height = 0;
+	exp_cur = -1;
+}
+
+static void close_fd(int fd)
+{
+#if defined(__unix__)
+	if(fd >= 0) {
+		close(fd);
+	}
+#endif
+}
+
+extern "C" {
+
+int goatvr_set_export(int enable)
+{
+	if(!enable) {
+		destroy_export();
+		exp_enabled = false;
+		return 0;
+	}
+	if(!init_egl()) {
+		return -1;
+	}
+	exp_enabled = true;
+	return 0;
+}
+
+int goatvr_get_export(void)
+{
+	return exp_enabled ? 1 : 0;
+}
+
+int goatvr_export_buffers(struct goatvr_export_buffer *bufs)
+{
+	for(int i=0; i<num_expbuf; i++) {
+		bufs[i] = expbuf[i].info;
+	}
+	return num_expbuf;
+}
+
+int goatvr_export_frame(int *fence_fd)
+{
+	if(fence_fd) {
+		*fence_fd = exp_fence;
+		exp_fence = -1;
+	}
+	if(exp_cur >= 0) {
+		expbuf[exp_cur].held++;
+	}
+	return exp_cur;
+}
+
+void goatvr_export_release(int idx)
+{
+	if(idx >= 0 && idx < num_expbuf && expbuf[idx].held > 0) {
+		expbuf[idx].held--;
+	}
+}
+
+}	// extern "C"
@@ -0,0 +1,38 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef EXPORT_H_
+#define EXPORT_H_
+
+/* Zero-copy export of the eye buffers to other processes, as dma-bufs (see
+ * goatvr_set_export). Needs an EGL context with EGL_KHR_gl_texture_2D_image
+ * and EGL_MESA_image_dma_buf_export. The EGL entry points are looked up at
+ * runtime, so there's no link-time dependency on libEGL.
+ */
+
+namespace goatvr {
+
+class RenderTexture;
+
+void destroy_export();
+
+// copy this frame to the next export buffer. Called by goatvr_draw_done.
+void export_frame(const RenderTexture *rtex);
+
+}	// namespace goatvr
+
+#endif	// EXPORT_H_
@@ -0,0 +1,299 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <algorithm>
+#include "opengl.h"
+#include "sdr.h"
+#include "modman.h"
+#include "render.h"
+#include "jitter.h"
+#include "multires.h"
+#include "upscale.h"
+#include "multiview.h"
+#include "farlayer.h"
+
+using namespace goatvr;
+
+static float far_split;	// 0 disables the far layer
+bool goatvr::far_drawn, goatvr::far_bound;
+static unsigned int far_fbo, far_tex, far_zbuf;
+static int far_width, far_height;
+static Mat4 far_view;
+static EyeFov far_fov;
+static unsigned int far_prog, far_vao;
+
+static const char *far_vsdr =
+	"#version 150\n"
+	"uniform vec4 tc_rect;\n"
+	"uniform float depth;\n"
+	"out vec2 tc;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 pos = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));\n"
+	"	tc = mix(tc_rect.xy, tc_rect.zw, pos);\n"
+	"	gl_Position = vec4(pos * 2.0 - 1.0, depth, 1.0);\n"
+	"}\n";
+
+static const char *far_psdr =
+	"#version 150\n"
+	"uniform sampler2D tex;\n"
+	"in vec2 tc;\n"
+	"out vec4 color;\n"
+	"void main()\n"
+	"{\n"
+	"	color = texture(tex, tc);\n"
+	"}\n";
+
+/* The center eye sits between the two eyes. Its frustum must contain both eye
+ * frusta beyond far_split, where each eye's outer plane is furthest out.
+ */
+static void calc_far_eye()
+{
+	if(!display_module || far_split <= 0.0f) {
+		far_view = Mat4::identity;
+		far_fov.left = far_fov.bottom = -1.0f;
+		far_fov.right = far_fov.top = 1.0f;
+		return;
+	}
+
+	Mat4 eye_view[2];
+	EyeFov fov[2];
+	float ipd = get_stereo_setup(eye_view, fov);
+	float margin = ipd * 0.5f / far_split;
+
+	far_fov.left = std::min(fov[0].left - margin, fov[1].left);
+	far_fov.right = std::max(fov[0].right, fov[1].right + margin);
+	far_fov.bottom = std::min(fov[0].bottom, fov[1].bottom);
+	far_fov.top = std::max(fov[0].top, fov[1].top);
+
+	Mat4 tmat;
+	tmat.translation(-ipd * 0.5f, 0, 0);
+	far_view = eye_view[0] * tmat;
+}
+
+static bool update_far()
+{
+	RenderTexture *rtex = display_module->get_render_texture();
+	if(!rtex) {
+		return false;	// nothing to composite into
+	}
+
+	if(!far_prog) {
+		if(!(far_prog = create_program_load(far_vsdr, far_psdr))) {
+			fprintf(stderr, "goatvr: failed to create the far layer compositing program\n");
+			far_split = 0.0f;
+			return false;
+		}
+		glUseProgram(far_prog);
+		set_uniform_int(far_prog, "tex", 0);
+		glUseProgram(0);
+	}
+	if(!far_vao) {
+		glGenVertexArrays(1, &far_vao);	// attribute-less, vertices from gl_VertexID
+	}
+
+	/* keep roughly the pixel density of the eye framebuffers, over the wider
+	 * field of view of the center eye
+	 */
+	calc_far_eye();
+	EyeFov efov;
+	if(!display_module->get_eye_fov(0, &efov)) {
+		efov = far_fov;
+	}
+	float xscale = (far_fov.right - far_fov.left) / (efov.right - efov.left);
+	float yscale = (far_fov.top - far_fov.bottom) / (efov.top - efov.bottom);
+	int width = (int)(std::max(rtex->eye_width[0], rtex->eye_width[1]) * xscale + 0.5f);
+	int height = (int)(std::max(rtex->eye_height[0], rtex->eye_height[1]) * yscale + 0.5f);
+
+	if(far_fbo && width == far_width && height == far_height) {
+		return true;
+	}
+	far_width = width;
+	far_height = height;
+
+	if(!far_fbo) {
+		glGenFramebuffers(1, &far_fbo);
+		glGenTextures(1, &far_tex);
+		glGenRenderbuffers(1, &far_zbuf);
+
+		glBindTexture(GL_TEXTURE_2D, far_tex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	printf("goatvr: creating %dx%d far layer\n", far_width, far_height);
+
+	glBindTexture(GL_TEXTURE_2D, far_tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, far_width, far_height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, far_zbuf);
+	glRenderbufferStorage(GL_RENDERBUFFER, zfmt[depth_fmt].ifmt, far_width, far_height);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, far_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, far_tex, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, far_zbuf);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+			zfmt[depth_fmt].stencil ? far_zbuf : 0);
+
+	GLenum fbst = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if(fbst != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "goatvr: incomplete far layer framebuffer! (status: %x)\n", (unsigned int)fbst);
+		destroy_far();
+		return false;
+	}
+	return true;
+}
+
+void goatvr::destroy_far()
+{
+	if(far_fbo) {
+		glDeleteFramebuffers(1, &far_fbo);
+		glDeleteTextures(1, &far_tex);
+		glDeleteRenderbuffers(1, &far_zbuf);
+		far_fbo = far_tex = far_zbuf = 0;
+	}
+	far_width = far_height = 0;
+
+	if(far_prog) {
+		free_program(far_prog);
+		far_prog = 0;
+	}
+	if(far_vao) {
+		glDeleteVertexArrays(1, &far_vao);
+		far_vao = 0;
+	}
+}
+
+/* Draw the far layer into each eye, only where the near-field pass left the
+ * depth buffer cleared. At these distances both eyes see the same direction
+ * for each point, so the mapping from each eye's viewport to the center eye's
+ * image is a simple scale/offset of the frustum tangents.
+ */
+static void composite_far()
+{
+	RenderTexture *rtex = display_module->get_render_texture();
+	if(!rtex || !far_fbo) return;
+
+	calc_far_eye();
+	float du = far_fov.right - far_fov.left;
+	float dv = far_fov.top - far_fov.bottom;
+
+	push_gl_state();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, vr_fbo());
+	glUseProgram(far_prog);
+	glBindVertexArray(far_vao);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, far_tex);
+
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(0);
+	glColorMask(1, 1, 1, 1);
+	// sRGB encode on write, to undo the decode when sampling the far layer
+	glEnable(GL_FRAMEBUFFER_SRGB);
+
+	if(proj_flags & GOATVR_PROJ_REVERSE_Z) {
+		glDepthFunc(GL_GEQUAL);
+		set_uniform_float(far_prog, "depth", glcaps.clip_control ? 0.0f : -1.0f);
+	} else {
+		glDepthFunc(GL_LEQUAL);
+		set_uniform_float(far_prog, "depth", 1.0f);
+	}
+
+	for(int i=0; i<2; i++) {
+		EyeFov efov;
+		if(!display_module->get_eye_fov(i, &efov)) {
+			efov = far_fov;
+		}
+		float u0 = (efov.left - far_fov.left) / du;
+		float u1 = (efov.right - far_fov.left) / du;
+		float v0 = (efov.bottom - far_fov.bottom) / dv;
+		float v1 = (efov.top - far_fov.bottom) / dv;
+
+		glViewport(rtex->eye_xoffs[i], rtex->eye_yoffs[i], rtex->eye_width[i], rtex->eye_height[i]);
+		set_uniform_float4(far_prog, "tc_rect", u0, v0, u1, v1);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+
+	pop_gl_state();
+}
+
+void goatvr::far_draw_done()
+{
+	if(far_drawn) {
+		composite_far();
+		far_drawn = far_bound = false;
+	}
+}
+
+extern "C" {
+
+void goatvr_set_far_split(float dist)
+{
+	if(dist > 0.0f && !glcaps.shaders) {
+		fprintf(stderr, "goatvr: the mono far layer needs OpenGL 3.2\n");
+		return;
+	}
+	far_split = dist > 0.0f ? dist : 0.0f;
+	if(far_split <= 0.0f) {
+		destroy_far();
+	}
+}
+
+float goatvr_get_far_split(void)
+{
+	return far_split;
+}
+
+int goatvr_draw_far(void)
+{
+	if(!display_module || far_split <= 0.0f || !update_far()) {
+		return -1;
+	}
+	if((mr_active && !mr_zblit) || (ups_active && !ups_zblit) || !multiview_zblit()) {
+		return -1;	// the far layer composite needs the near-field depth in the VR framebuffer
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, far_fbo);
+	glViewport(0, 0, far_width, far_height);
+	far_drawn = far_bound = true;
+	return 0;
+}
+
+float *goatvr_far_view_matrix(void)
+{
+	calc_far_eye();
+	return far_view[0];
+}
+
+float *goatvr_far_projection_matrix(float zfar)
+{
+	static Mat4 pmat;
+	calc_far_eye();
+	calc_proj_matrix(pmat, far_fov, far_split, zfar, proj_flags);
+	jitter_proj(pmat, far_width, far_height);
+	return pmat[0];
+}
+
+}	// extern "C"
@@ -0,0 +1,38 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef FARLAYER_H_
+#define FARLAYER_H_
+
+/* mono far-field layer (see goatvr_set_far_split), rendered once from a center
+ * eye covering both eye frusta, and composited behind the stereo near-field
+ * content of both eyes by goatvr_draw_done.
+ */
+
+namespace goatvr {
+
+extern bool far_drawn;	// goatvr_draw_far was called this frame
+extern bool far_bound;	// ... and the far layer framebuffer is still bound
+
+void destroy_far();
+
+// composite the far layer, if it was drawn this frame. Called by goatvr_draw_done.
+void far_draw_done();
+
+}	// namespace goatvr
+
+#endif	/* FARLAYER_H_ */
@@ -18,12 +18,32 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <string.h>
 #include <algorithm>
+#include <chrono>
 #include "opengl.h"
+#include "upscale.h"
+#include "mirror.h"
+#include "layer.h"
+#include "compositor.h"
+#include "export.h"
+#include "capture.h"
+#include "spectator.h"
+#include "render.h"
+#include "jitter.h"
+#include "stereoubo.h"
+#include "multiview.h"
+#include "farlayer.h"
+#include "hiddenarea.h"
+#include "multires.h"
+#include "reproj.h"
 #include "goatvr_impl.h"
 #include "modman.h"
 #include "inpman.h"
 #include "autocfg.h"
 
+#ifndef GL_READ_FRAMEBUFFER_BINDING
+#define GL_READ_FRAMEBUFFER_BINDING	0x8caa
+#endif
+
 using namespace goatvr;
 
 namespace goatvr {
@@ -31,19 +51,60 @@ void register_modules();	// auto-generated function during build
 }
 
 static bool update_fbo();
+static void destroy_fbo();
+static bool mirror_due();
+static bool present_outputs();
 
 static goatvr_origin_mode origin_mode = GOATVR_FLOOR;
 
 static bool in_vr;
 // user-supplied framebuffer properties
-static int cur_fbwidth, cur_fbheight;
+int goatvr::cur_fbwidth, goatvr::cur_fbheight;
 static float cur_fbscale = 1.0f;
+static float max_fbscale;
 
 static unsigned int fbo;
-static unsigned int zbuf;
+static unsigned int fbo_tex;	// last texture we got from Module::get_render_texture()
+static unsigned int zbuf, ztex;
 static int fbo_width, fbo_height;
 
+// application-provided render target
+unsigned int goatvr::user_fbo;
+static unsigned int user_tex;
+static int user_tex_width, user_tex_height;
+
+goatvr_depth_format goatvr::depth_fmt = GOATVR_DEPTH24;
+static bool depth_as_tex;
+/* depth format of the application framebuffer (zfmt index), looked up the first
+ * time it's needed after goatvr_set_fbo. -1 if it's not one of ours.
+ */
+static int user_zfmt = -1;
+static unsigned int user_ztex;	// application depth attachment, if it's a texture
+static bool user_zfmt_valid;
+
+// texture formats for each goatvr_depth_format
+const DepthFormat goatvr::zfmt[] = {
+	{GL_DEPTH_COMPONENT16, GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT, false},
+	{GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, false},
+	{GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, true},
+	{GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, false}
+};
+
+unsigned int goatvr::proj_flags;
+float goatvr::clip_near = 0.5f, goatvr::clip_far = 500.0f;
+// application clip control state, saved while we switch to [0, 1] depth
+static int saved_clip_origin, saved_clip_depth;
+static bool clip_changed;
+
 static bool user_swap = true;
+static int mirror_mode = GOATVR_MIRROR_BOTH;
+// mirror update policy, see goatvr_set_mirror_interval
+static int mirror_interval = 1;
+static float mirror_rate;
+static int mirror_frame;
+static std::chrono::steady_clock::time_point mirror_last;
+static bool mirror_shown = true;	// the mirror was updated this frame, the user should swap
+static bool use_comp;	// present from the compositor thread, see goatvr_set_compositor_thread
 
 // action state for each hand
 static bool action[GOATVR_NUM_ACTIONS][2];
@@ -54,6 +115,8 @@ static goatvr_user_gender user_gender = GOATVR_USER_UNKNOWN;
 
 static float units_scale = 1.0f;
 
+float goatvr::ident_mat[] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
 extern "C" {
 
 int goatvr_init()
@@ -70,12 +133,21 @@ int goatvr_init()
 void goatvr_shutdown()
 {
 	goatvr_stopvr();
+	destroy_layers();
 	destroy_modules();
-
-	if(fbo) {
-		glDeleteFramebuffers(1, &fbo);
-		glDeleteRenderbuffers(1, &zbuf);
-	}
+	destroy_fbo();
+	destroy_multiview();
+	destroy_far();
+	destroy_multires();
+	destroy_reproj();
+	destroy_upscale_fbo();
+	destroy_upscale();
+	destroy_hidden_area();
+	destroy_stereo_ubo();
+	destroy_mirror();
+	destroy_export();
+	destroy_capture();
+	destroy_spectator();
 }
 
 void goatvr_detect()
@@ -99,16 +171,50 @@ void goatvr_startvr()
 
 	if(!start()) return;
 	in_vr = true;
+	invalidate_hidden_area();
 
 	// make sure any changes done while not in VR make it through to the module
 	display_module->set_origin_mode(origin_mode);
+	if(user_tex) {
+		display_module->set_render_texture(user_tex, user_tex_width, user_tex_height);
+	}
 
 	user_swap = display_module->should_swap();
 }
 
 void goatvr_stopvr()
 {
-	if(in_vr) stop();
+	stop_compositor();
+	if(in_vr) {
+		stop();
+		in_vr = false;
+	} else {
+		trim();	// release anything left behind by a previous goatvr_suspendvr
+	}
+}
+
+void goatvr_suspendvr()
+{
+	if(!in_vr) return;
+
+	stop_compositor();
+	suspend();
+	in_vr = false;
+}
+
+void goatvr_trim()
+{
+	if(in_vr) return;
+
+	trim();
+	destroy_fbo();
+	destroy_multiview();
+	destroy_far();
+	destroy_multires();
+	destroy_reproj();
+	destroy_upscale_fbo();
+	destroy_upscale();
+	destroy_latch();
 }
 
 int goatvr_invr()
@@ -191,6 +297,16 @@ float goatvr_get_fb_scale()
 	return cur_fbscale;
 }
 
+void goatvr_set_fb_max_scale(float scale)
+{
+	max_fbscale = scale;
+}
+
+float goatvr_get_fb_max_scale()
+{
+	return max_fbscale;
+}
+
 int goatvr_get_fb_width()
 {
 	if(display_module) {
@@ -212,8 +328,9 @@ int goatvr_get_fb_height()
 int goatvr_get_fb_eye_width(int eye)
 {
 	if(display_module) {
-		RenderTexture *rtex = display_module->get_render_texture();
-		return rtex ? rtex->eye_width[eye] : 0;
+		int rect[4];
+		get_eye_rect(eye, rect);
+		return rect[2];
 	}
 	return cur_fbwidth / 2;
 }
@@ -221,8 +338,9 @@ int goatvr_get_fb_eye_width(int eye)
 int goatvr_get_fb_eye_height(int eye)
 {
 	if(display_module) {
-		RenderTexture *rtex = display_module->get_render_texture();
-		return rtex ? rtex->eye_height[eye] : 0;
+		int rect[4];
+		get_eye_rect(eye, rect);
+		return rect[3];
 	}
 	return cur_fbheight;
 }
@@ -230,8 +348,9 @@ int goatvr_get_fb_eye_height(int eye)
 int goatvr_get_fb_eye_xoffset(int eye)
 {
 	if(display_module) {
-		RenderTexture *rtex = display_module->get_render_texture();
-		return rtex ? rtex->eye_xoffs[eye] : 0;
+		int rect[4];
+		get_eye_rect(eye, rect);
+		return rect[0];
 	}
 	return eye == GOATVR_LEFT ? 0 : cur_fbwidth / 2;
 }
@@ -239,8 +358,9 @@ int goatvr_get_fb_eye_xoffset(int eye)
 int goatvr_get_fb_eye_yoffset(int eye)
 {
 	if(display_module) {
-		RenderTexture *rtex = display_module->get_render_texture();
-		return rtex ? rtex->eye_yoffs[eye] : 0;
+		int rect[4];
+		get_eye_rect(eye, rect);
+		return rect[1];
 	}
 	return 0;
 }
@@ -272,24 +392,57 @@ int goatvr_get_fb_texture_height()
 	return next_pow2(cur_fbheight);
 }
 
+void goatvr_set_fbo(unsigned int ufbo)
+{
+	user_fbo = ufbo;
+	fbo_tex = 0;	// make sure the render texture gets attached to the new fbo
+	user_zfmt_valid = false;
+}
+
 unsigned int goatvr_get_fbo(void)
 {
 	update_fbo();
-	return fbo;
+	return render_fbo();
 }
 
+int goatvr_set_fb_texture(unsigned int tex, int width, int height)
+{
+	if(display_module && !display_module->set_render_texture(tex, width, height)) {
+		fprintf(stderr, "goatvr: display module %s can't render into application textures\n",
+				display_module->get_name());
+		return -1;
+	}
+	user_tex = tex;
+	user_tex_width = width;
+	user_tex_height = height;
+	fbo_tex = 0;
+	return 0;
+}
 
-void goatvr_viewport(int eye)
+void goatvr_set_fb_depth(goatvr_depth_format fmt, int as_texture)
 {
-	RenderTexture *rtex = display_module ? display_module->get_render_texture() : 0;
-	if(rtex) {
-		glViewport(rtex->eye_xoffs[eye], rtex->eye_yoffs[eye], rtex->eye_width[eye], rtex->eye_height[eye]);
-	} else {
-		glViewport(eye == 0 ? 0 : cur_fbwidth / 2, 0, cur_fbwidth / 2, cur_fbheight);
+	if(fmt == depth_fmt && (bool)as_texture == depth_as_tex) {
+		return;
 	}
+	depth_fmt = fmt;
+	depth_as_tex = as_texture != 0;
+	fbo_width = fbo_height = -1;	// force update_fbo to re-create the depth buffer
+	destroy_multiview();
 }
 
-static float ident_mat[] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+unsigned int goatvr_get_fb_depth_texture(void)
+{
+	update_fbo();
+	return depth_as_tex ? ztex : 0;
+}
+
+
+void goatvr_viewport(int eye)
+{
+	int rect[4];
+	get_eye_rect(eye, rect);
+	glViewport(rect[0], rect[1], rect[2], rect[3]);
+}
 
 float *goatvr_view_matrix(int eye)
 {
@@ -305,47 +458,245 @@ float *goatvr_projection_matrix(int eye, float znear, float zfar)
 {
 	static Mat4 pmat[2];
 	if(display_module) {
-		display_module->get_proj_matrix(pmat[eye], eye, znear, zfar);
+		display_module->get_proj_matrix(pmat[eye], eye, znear, zfar, proj_flags);
+		jitter_eye_proj(pmat[eye], eye);
 		return pmat[eye][0];
 	}
 	return ident_mat;
 }
 
+void goatvr_set_projection_mode(unsigned int flags)
+{
+	if((flags & GOATVR_PROJ_REVERSE_Z) && !glcaps.clip_control) {
+		fprintf(stderr, "goatvr: reverse-Z projection requested, but ARB_clip_control is not"
+				" available. Reverse-Z will not work, and its depth precision benefit is lost.\n");
+	}
+	proj_flags = flags;
+}
+
+void goatvr_set_clip_planes(float znear, float zfar)
+{
+	clip_near = znear;
+	clip_far = zfar;
+}
+
+void goatvr_get_clip_planes(float *znear, float *zfar)
+{
+	*znear = clip_near;
+	*zfar = clip_far;
+}
+
+void goatvr_combined_frustum(float *planes, float *view, float *proj)
+{
+	Mat4 cull_view = Mat4::identity;
+	Mat4 cull_proj = Mat4::identity;
+
+	if(display_module) {
+		Mat4 eye_view[2];
+		EyeFov fov[2];
+		float ipd = get_stereo_setup(eye_view, fov);
+
+		/* the culling eye sits behind the two eyes, where the left plane of
+		 * the left eye meets the right plane of the right eye. Its frustum
+		 * starts with those two planes, and encloses both eye frusta.
+		 */
+		EyeFov cfov;
+		cfov.left = fov[0].left;
+		cfov.right = fov[1].right;
+		cfov.bottom = std::min(fov[0].bottom, fov[1].bottom);
+		cfov.top = std::max(fov[0].top, fov[1].top);
+
+		float xoffs = 0.0f, zoffs = 0.0f;
+		float spread = cfov.right - cfov.left;
+		if(ipd > 0.0f && spread > 0.0f) {
+			zoffs = ipd / spread;
+			xoffs = -cfov.left * zoffs;
+		}
+
+		Mat4 tmat;
+		tmat.translation(-xoffs, 0, -zoffs);
+		cull_view = eye_view[0] * tmat;
+		calc_proj_matrix(cull_proj, cfov, clip_near + zoffs, clip_far + zoffs, 0);
+	}
+
+	if(planes) {
+		calc_frustum_planes(planes, cull_view * cull_proj);
+	}
+	if(view) {
+		memcpy(view, cull_view[0], 16 * sizeof(float));
+	}
+	if(proj) {
+		memcpy(proj, cull_proj[0], 16 * sizeof(float));
+	}
+}
+
+unsigned int goatvr_get_projection_mode(void)
+{
+	return proj_flags;
+}
+
 void goatvr_draw_start(void)
 {
 	display_module->draw_start(); // this needs to be called before update_fbo for oculus
 
 	update_fbo();
-	if(fbo) {
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	// multires and upscaling bind their own framebuffers, they're never both enabled
+	bool mr = multires_draw_start();
+	bool ups = upscale_draw_start();
+	if(!mr && !ups && (user_fbo || fbo)) {
+		glBindFramebuffer(GL_FRAMEBUFFER, vr_fbo());
+	}
+
+	if((proj_flags & GOATVR_PROJ_REVERSE_Z) && glcaps.clip_control) {
+		// save whatever the application had set, to restore it in draw_done
+		glGetIntegerv(GL_CLIP_ORIGIN, &saved_clip_origin);
+		glGetIntegerv(GL_CLIP_DEPTH_MODE, &saved_clip_depth);
+		glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+		clip_changed = true;
 	}
 
+	multiview_draw_start();
+
 	update();	// this needs to be called *after* draw_start for oculus_old
+
+	jitter_next_frame();
+	update_stereo_ubo();
 }
 
 void goatvr_draw_eye(int eye)
 {
 	if(!display_module) return;
 
+	if(far_bound) {
+		// switch back from the far layer to the VR framebuffer
+		glBindFramebuffer(GL_FRAMEBUFFER, render_fbo());
+		far_bound = false;
+	}
 	goatvr_viewport(eye);
 	display_module->draw_eye(eye);
+
+	draw_hidden_area(eye);
 }
 
 void goatvr_draw_done()
 {
 	if(!display_module) return;
 
-	if(fbo) {
+	instanced_stereo_done();
+
+	multiview_draw_done();
+	multires_draw_done();
+	upscale_draw_done();
+	far_draw_done();	// after the others, it needs the near-field depth in the VR framebuffer
+
+	// as late as possible, but the layers must be composited with the submitted poses
+	late_latch_poses();
+
+	if(update_layers(display_module) > 0) {
+		// overlay layers the display module can't present itself
+		RenderTexture *rtex = display_module->get_render_texture();
+		if(rtex) {
+			int rect[2][4];
+			for(int i=0; i<2; i++) {
+				rect[i][0] = rtex->eye_xoffs[i];
+				rect[i][1] = rtex->eye_yoffs[i];
+				rect[i][2] = rtex->eye_width[i];
+				rect[i][3] = rtex->eye_height[i];
+			}
+			composite_layers(display_module, vr_fbo(), rect, proj_flags);
+		}
+	}
+	if(in_vr) {
+		RenderTexture *rtex = display_module->get_render_texture();
+		if(rtex) {
+			export_frame(rtex);
+			capture_frame(rtex);
+			spectator_frame(rtex);
+		}
+	}
+	if(user_fbo || fbo) {
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	}
-	display_module->draw_mirror();
+	if(clip_changed) {
+		glClipControl(saved_clip_origin, saved_clip_depth);
+		clip_changed = false;
+	}
+	RenderTexture *rtex;
+	if(use_comp && in_vr && (rtex = display_module->get_render_texture()) &&
+			start_compositor(display_module)) {
+		// the compositor thread presents it, and swaps the window buffers
+		submit_frame(rtex);
+		mirror_shown = false;
+	} else {
+		if(display_module->window_is_mirror() && present_outputs()) {
+			// the outputs take the place of the mirror, every frame
+			mirror_shown = true;
+		} else if(!display_module->window_is_mirror() || mirror_due()) {
+			display_module->draw_mirror();
+			mirror_shown = true;
+		} else {
+			mirror_shown = false;
+		}
 
-	display_module->draw_done();
+		display_module->draw_done();
+	}
+	layers_frame_done();
 }
 
 int goatvr_should_swap()
 {
-	return user_swap ? 1 : 0;
+	return user_swap && mirror_shown ? 1 : 0;
+}
+
+void goatvr_set_mirror_mode(int mode)
+{
+	mirror_mode = mode;
+}
+
+int goatvr_get_mirror_mode(void)
+{
+	return mirror_mode;
+}
+
+void goatvr_set_mirror_interval(int nframes)
+{
+	mirror_interval = nframes;
+	mirror_frame = 0;
+}
+
+int goatvr_get_mirror_interval(void)
+{
+	return mirror_interval;
+}
+
+void goatvr_set_mirror_rate(float rate)
+{
+	mirror_rate = rate;
+}
+
+float goatvr_get_mirror_rate(void)
+{
+	return mirror_rate;
+}
+
+int goatvr_set_compositor_thread(int enable)
+{
+	if(!enable) {
+		stop_compositor();
+		use_comp = false;
+		return 0;
+	}
+	if(!glcaps.sync || !display_module || !display_module->can_present() ||
+			!display_module->get_render_texture()) {
+		return -1;
+	}
+	use_comp = true;
+	return 0;
+}
+
+int goatvr_get_compositor_thread(void)
+{
+	return use_comp ? 1 : 0;
 }
 
 // ---- input device handling ----
@@ -505,16 +856,69 @@ int goatvr_lookup_stick(const char *name)
 
 int goatvr_activate_module(goatvr_module *mod)
 {
+	if(mod->get_type() == GOATVR_DISPLAY_MODULE) {
+		stop_compositor();
+		// an output promoted to the display module, must be stopped as an output
+		goatvr_deactivate_output(mod);
+	}
 	activate(mod);
 	return 0;
 }
 
 int goatvr_deactivate_module(goatvr_module *mod)
 {
+	if(mod == compositor_module()) {
+		stop_compositor();
+	}
 	deactivate(mod);
+	goatvr_deactivate_output(mod);
 	return 0;
 }
 
+int goatvr_activate_output(goatvr_module *mod)
+{
+	if(goatvr_module_output(mod)) {
+		return 0;	// already an output, and started if we're in VR
+	}
+	if(!activate_output(mod)) {
+		return -1;
+	}
+	if(in_vr && !mod->start()) {
+		deactivate_output(mod);
+		return -1;
+	}
+	return 0;
+}
+
+int goatvr_deactivate_output(goatvr_module *mod)
+{
+	for(int i=0; i<get_num_outputs(); i++) {
+		if(get_output(i) == mod) {
+			if(in_vr) {
+				mod->stop();
+			}
+			deactivate_output(mod);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int goatvr_module_output(goatvr_module *mod)
+{
+	for(int i=0; i<get_num_outputs(); i++) {
+		if(get_output(i) == mod) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void goatvr_output_size(goatvr_module *mod, int width, int height)
+{
+	mod->set_fbsize(width, height, 1.0f);
+}
+
 int goatvr_num_modules()
 {
 	return get_num_modules();
@@ -674,10 +1078,73 @@ void goatvr::calc_inv_matrix(Mat4 &mat, const Vec3 &pos, const Quat &rot)
 	mat = tmat * rmat;
 }
 
-static bool update_fbo()
+void goatvr::calc_proj_matrix(Mat4 &mat, const EyeFov &fov, float znear, float zfar, unsigned int flags)
+{
+	float dx = fov.right - fov.left;
+	float dy = fov.top - fov.bottom;
+
+	mat = Mat4::identity;
+	mat[0][0] = 2.0f / dx;
+	mat[1][1] = 2.0f / dy;
+	mat[2][0] = (fov.right + fov.left) / dx;
+	mat[2][1] = (fov.top + fov.bottom) / dy;
+	mat[2][3] = -1.0f;
+	mat[3][3] = 0.0f;
+
+	if(flags & GOATVR_PROJ_REVERSE_Z) {
+		// [0, 1] clip range, znear -> 1, zfar -> 0
+		if(flags & GOATVR_PROJ_INFINITE) {
+			mat[2][2] = 0.0f;
+			mat[3][2] = znear;
+		} else {
+			mat[2][2] = znear / (zfar - znear);
+			mat[3][2] = zfar * znear / (zfar - znear);
+		}
+	} else {
+		// [-1, 1] clip range, znear -> -1, zfar -> 1
+		if(flags & GOATVR_PROJ_INFINITE) {
+			mat[2][2] = -1.0f;
+			mat[3][2] = -2.0f * znear;
+		} else {
+			mat[2][2] = -(zfar + znear) / (zfar - znear);
+			mat[3][2] = -2.0f * zfar * znear / (zfar - znear);
+		}
+	}
+}
+
+void goatvr::calc_eye_fov(EyeFov *fov, const Mat4 &proj)
 {
-	static unsigned int last_tex;	// last texture we got from Module::get_render_texture()
+	fov->left = (proj[2][0] - 1.0f) / proj[0][0];
+	fov->right = (proj[2][0] + 1.0f) / proj[0][0];
+	fov->bottom = (proj[2][1] - 1.0f) / proj[1][1];
+	fov->top = (proj[2][1] + 1.0f) / proj[1][1];
+}
 
+/* with DSA these don't disturb the application's framebuffer binding,
+ * otherwise they leave fb bound
+ */
+static void fbo_attach_tex(unsigned int fb, unsigned int attachment, unsigned int tex)
+{
+	if(glcaps.dsa) {
+		glNamedFramebufferTexture(fb, attachment, tex, 0);
+	} else {
+		glBindFramebuffer(GL_FRAMEBUFFER, fb);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, tex, 0);
+	}
+}
+
+static void fbo_attach_rbuf(unsigned int fb, unsigned int attachment, unsigned int rbuf)
+{
+	if(glcaps.dsa) {
+		glNamedFramebufferRenderbuffer(fb, attachment, GL_RENDERBUFFER, rbuf);
+	} else {
+		glBindFramebuffer(GL_FRAMEBUFFER, fb);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, rbuf);
+	}
+}
+
+static bool update_fbo()
+{
 	if(!display_module) {
 		return false;
 	}
@@ -687,31 +1154,104 @@ static bool update_fbo()
 		return false;
 	}
 
+	if(user_fbo) {
+		/* the application provides the FBO and its depth buffer. If it also
+		 * provided the color texture there's nothing to do, otherwise attach
+		 * the module's render texture (which might change every frame).
+		 */
+		if(!user_tex && fbo_tex != rtex->tex) {
+			fbo_attach_tex(user_fbo, GL_COLOR_ATTACHMENT0, rtex->tex);
+			fbo_tex = rtex->tex;
+		}
+		return true;
+	}
+
 	if(!fbo) {
-		glGenFramebuffers(1, &fbo);
-		glGenRenderbuffers(1, &zbuf);
+		if(glcaps.dsa) {
+			glCreateFramebuffers(1, &fbo);
+		} else {
+			glGenFramebuffers(1, &fbo);
+		}
 	}
 
+	bool resized = fbo_width != rtex->tex_width || fbo_height != rtex->tex_height;
+
 	/* every time we call Module::get_render_texture() we might get a different texture
-	 * make sure to re-bind it as the fbo color attachment if it changed
+	 * make sure to re-bind it as the fbo color attachment if it changed. Resizing
+	 * might also re-create the texture, possibly with the same name.
 	 */
-	if(last_tex != rtex->tex) {
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rtex->tex, 0);
-		last_tex = rtex->tex;
+	if(fbo_tex != rtex->tex || resized) {
+		fbo_attach_tex(fbo, GL_COLOR_ATTACHMENT0, rtex->tex);
+		fbo_tex = rtex->tex;
 	}
 
 	// resize fbo if necessary (or if it's the first time)
-	if(fbo_width != rtex->tex_width || fbo_height != rtex->tex_height) {
+	if(resized) {
 		fbo_width = rtex->tex_width;
 		fbo_height = rtex->tex_height;
 
-		glBindRenderbuffer(GL_RENDERBUFFER, zbuf);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, fbo_width, fbo_height);
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, zbuf);
+		int fidx = (int)depth_fmt;
+
+		if(depth_as_tex) {
+			if(zbuf) {
+				fbo_attach_rbuf(fbo, GL_DEPTH_ATTACHMENT, 0);
+				fbo_attach_rbuf(fbo, GL_STENCIL_ATTACHMENT, 0);
+				glDeleteRenderbuffers(1, &zbuf);
+				zbuf = 0;
+			}
+			if(glcaps.dsa) {
+				// immutable storage can't be resized, make a new depth texture
+				if(ztex) {
+					glDeleteTextures(1, &ztex);
+				}
+				glCreateTextures(GL_TEXTURE_2D, 1, &ztex);
+				glTextureParameteri(ztex, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glTextureParameteri(ztex, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+				glTextureStorage2D(ztex, 1, zfmt[fidx].ifmt, fbo_width, fbo_height);
+			} else {
+				if(!ztex) {
+					glGenTextures(1, &ztex);
+					glBindTexture(GL_TEXTURE_2D, ztex);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+				}
+				glBindTexture(GL_TEXTURE_2D, ztex);
+				glTexImage2D(GL_TEXTURE_2D, 0, zfmt[fidx].ifmt, fbo_width, fbo_height, 0,
+						zfmt[fidx].fmt, zfmt[fidx].type, 0);
+			}
+
+			fbo_attach_tex(fbo, GL_DEPTH_ATTACHMENT, ztex);
+			fbo_attach_tex(fbo, GL_STENCIL_ATTACHMENT, zfmt[fidx].stencil ? ztex : 0);
+		} else {
+			if(ztex) {
+				fbo_attach_tex(fbo, GL_DEPTH_ATTACHMENT, 0);
+				fbo_attach_tex(fbo, GL_STENCIL_ATTACHMENT, 0);
+				glDeleteTextures(1, &ztex);
+				ztex = 0;
+			}
+			if(glcaps.dsa) {
+				if(!zbuf) {
+					glCreateRenderbuffers(1, &zbuf);
+				}
+				glNamedRenderbufferStorage(zbuf, zfmt[fidx].ifmt, fbo_width, fbo_height);
+			} else {
+				if(!zbuf) {
+					glGenRenderbuffers(1, &zbuf);
+				}
+				glBindRenderbuffer(GL_RENDERBUFFER, zbuf);
+				glRenderbufferStorage(GL_RENDERBUFFER, zfmt[fidx].ifmt, fbo_width, fbo_height);
+			}
+
+			fbo_attach_rbuf(fbo, GL_DEPTH_ATTACHMENT, zbuf);
+			fbo_attach_rbuf(fbo, GL_STENCIL_ATTACHMENT, zfmt[fidx].stencil ? zbuf : 0);
+		}
 
-		GLenum fbst = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		GLenum fbst;
+		if(glcaps.dsa) {
+			fbst = glCheckNamedFramebufferStatus(fbo, GL_FRAMEBUFFER);
+		} else {
+			fbst = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		}
 		if(fbst != GL_FRAMEBUFFER_COMPLETE) {
 			fprintf(stderr, "goatvr: incomplete framebuffer! (status: %x)\n", (unsigned int)fbst);
 			return false;
@@ -719,3 +1259,205 @@ static bool update_fbo()
 	}
 	return true;
 }
+
+static void destroy_fbo()
+{
+	if(fbo) {
+		glDeleteFramebuffers(1, &fbo);
+		fbo = 0;
+	}
+	fbo_tex = 0;
+	fbo_width = fbo_height = 0;
+
+	if(zbuf) {
+		glDeleteRenderbuffers(1, &zbuf);
+		zbuf = 0;
+	}
+	if(ztex) {
+		glDeleteTextures(1, &ztex);
+		ztex = 0;
+	}
+}
+
+int goatvr::vr_depth_format()
+{
+	if(!user_fbo) {
+		return (int)depth_fmt;
+	}
+	if(user_zfmt_valid) {
+		return user_zfmt;
+	}
+	user_zfmt_valid = true;
+	user_zfmt = -1;
+	user_ztex = 0;
+	if(glcaps.version < 30) {
+		return -1;
+	}
+
+	int prev_fb;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_fb);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, user_fbo);
+
+	int type = GL_NONE;
+	glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+			GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+	if(type != GL_NONE) {
+		int name, comp, bits, sbits;
+		glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+				GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &name);
+		glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+				GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &comp);
+		glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+				GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &bits);
+		glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+				GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &sbits);
+
+		if(comp == GL_FLOAT) {
+			if(bits == 32 && !sbits) user_zfmt = GOATVR_DEPTH32F;
+		} else if(bits == 16 && !sbits) {
+			user_zfmt = GOATVR_DEPTH16;
+		} else if(bits == 24) {
+			user_zfmt = sbits ? GOATVR_DEPTH24_STENCIL8 : GOATVR_DEPTH24;
+		}
+		if(type == GL_TEXTURE) {
+			user_ztex = name;
+		}
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_fb);
+
+	if(user_zfmt == -1) {
+		fprintf(stderr, "goatvr: unsupported depth format in the application framebuffer,"
+				" depth can't be copied out of it\n");
+	}
+	return user_zfmt;
+}
+
+unsigned int goatvr::vr_depth_texture()
+{
+	return user_ztex;
+}
+
+float goatvr::get_stereo_setup(Mat4 *eye_view, EyeFov *fov)
+{
+	for(int i=0; i<2; i++) {
+		display_module->get_view_matrix(eye_view[i], i);
+		if(!display_module->get_eye_fov(i, fov + i)) {
+			Mat4 eye_proj;
+			display_module->get_proj_matrix(eye_proj, i, clip_near, clip_far, 0);
+			calc_eye_fov(fov + i, eye_proj);
+		}
+	}
+
+	// position of the right eye in the view space of the left eye
+	Mat4 rel = inverse(eye_view[1]) * eye_view[0];
+	return rel[3][0] > 0.0f ? rel[3][0] : 0.0f;
+}
+
+unsigned int goatvr::vr_fbo()
+{
+	return user_fbo ? user_fbo : fbo;
+}
+
+// the upscaling render target while upscaling, otherwise the VR framebuffer
+unsigned int goatvr::render_fbo()
+{
+	if(ups_active) {
+		return upscale_fbo();
+	}
+	return vr_fbo();
+}
+
+/* While upscaling, the layout of the VR framebuffer is scaled down, rounding
+ * down to keep the eyes from overlapping.
+ */
+void goatvr::get_eye_rect(int eye, int *rect)
+{
+	RenderTexture *rtex = display_module ? display_module->get_render_texture() : 0;
+	if(!rtex) {
+		rect[0] = eye == GOATVR_LEFT ? 0 : cur_fbwidth / 2;
+		rect[1] = 0;
+		rect[2] = cur_fbwidth / 2;
+		rect[3] = cur_fbheight;
+		return;
+	}
+
+	rect[0] = rtex->eye_xoffs[eye];
+	rect[1] = rtex->eye_yoffs[eye];
+	rect[2] = rtex->eye_width[eye];
+	rect[3] = rtex->eye_height[eye];
+
+	if(upscaling()) {
+		float scale = goatvr_get_upscale();
+		rect[0] = (int)(rect[0] * scale);
+		rect[1] = (int)(rect[1] * scale);
+		rect[2] = std::max((int)(rect[2] * scale), 1);
+		rect[3] = std::max((int)(rect[3] * scale), 1);
+	}
+}
+
+void goatvr::get_render_size(int *width, int *height)
+{
+	RenderTexture *rtex = display_module ? display_module->get_render_texture() : 0;
+	if(!rtex) {
+		*width = cur_fbwidth;
+		*height = cur_fbheight;
+		return;
+	}
+	if(!upscaling()) {
+		*width = rtex->width;
+		*height = rtex->height;
+		return;
+	}
+
+	*width = *height = 0;
+	for(int i=0; i<2; i++) {
+		int rect[4];
+		get_eye_rect(i, rect);
+		*width = std::max(*width, rect[0] + rect[2]);
+		*height = std::max(*height, rect[1] + rect[3]);
+	}
+}
+
+static bool mirror_due()
+{
+	if(mirror_interval <= 0 || ++mirror_frame < mirror_interval) {
+		return false;
+	}
+
+	if(mirror_rate > 0.0f) {
+		using namespace std::chrono;
+		steady_clock::time_point now = steady_clock::now();
+		if(duration<float>(now - mirror_last).count() < 1.0f / mirror_rate) {
+			return false;	// try again next frame
+		}
+		mirror_last = now;
+	}
+	mirror_frame = 0;
+	return true;
+}
+
+/* present the eye buffers with all the output modules. They draw to the
+ * window, so this is only done when it's just a mirror of the display module.
+ */
+static bool present_outputs()
+{
+	int num = get_num_outputs();
+	if(!num || !in_vr) {
+		return false;
+	}
+	RenderTexture *rtex = display_module->get_render_texture();
+	if(!rtex) {
+		return false;
+	}
+
+	bool res = false;
+	for(int i=0; i<num; i++) {
+		Module *mod = get_output(i);
+		PresentParams par;
+		mod->get_present_params(&par);
+		if(mod->present(rtex->tex, rtex, &par)) {
+			res = true;
+		}
+	}
+	return res;
+}
@@ -38,6 +38,14 @@ struct PosRot {
 	Mat4 xform;
 };
 
+/* eye frustum extents, as tangents of the half-angles from the view direction.
+ * left and bottom are negative for the usual case of a frustum which contains
+ * the view direction.
+ */
+struct EyeFov {
+	float left, right, bottom, top;
+};
+
 /* called by the module update function when a action is detected */
 void set_action(int which, int hand, bool value);
 
@@ -49,6 +57,22 @@ unsigned int next_pow2(unsigned int x);
 void calc_matrix(Mat4 &mat, const Vec3 &pos, const Quat &rot);
 void calc_inv_matrix(Mat4 &mat, const Vec3 &pos, const Quat &rot);
 
+// flags: any combination of GOATVR_PROJ_REVERSE_Z and GOATVR_PROJ_INFINITE
+void calc_proj_matrix(Mat4 &mat, const EyeFov &fov, float znear, float zfar, unsigned int flags);
+// extract the frustum extents from an OpenGL projection matrix
+void calc_eye_fov(EyeFov *fov, const Mat4 &proj);
+/* approximate hidden area mesh for a lens with the given field of view (see
+ * Module::get_hidden_area_mesh, in hiddenarea.cc). Returns false if nothing
+ * is hidden.
+ */
+bool calc_hidden_area_mesh(std::vector<Vec2> *tris, const EyeFov &fov);
+
+/* extract the 6 frustum planes (left, right, bottom, top, near, far) from a
+ * view-projection matrix (in cull.cc). Each plane is 4 floats (a, b, c, d),
+ * normalized, with the normal pointing into the frustum.
+ */
+void calc_frustum_planes(float *planes, const Mat4 &m);
+
 }
 
 #ifdef _MSC_VER
@@ -0,0 +1,221 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include "opengl.h"
+#include "sdr.h"
+#include "modman.h"
+#include "render.h"
+#include "hiddenarea.h"
+
+using namespace goatvr;
+
+/* hidden area meshes of both eyes, back to back in one vertex buffer. Rebuilt
+ * on startvr, or when the display module changes.
+ */
+static int hidden_mode;
+static bool hidden_valid;
+static Module *hidden_mod;	// display module the meshes came from
+static unsigned int hidden_vbo, hidden_vao, hidden_prog;
+static int hidden_first[2], hidden_count[2];
+
+static const char *hidden_vsdr =
+	"#version 150\n"
+	"uniform float depth;\n"
+	"in vec2 attr_vertex;\n"
+	"void main()\n"
+	"{\n"
+	"	gl_Position = vec4(attr_vertex * 2.0 - 1.0, depth, 1.0);\n"
+	"}\n";
+
+static const char *hidden_psdr =
+	"#version 150\n"
+	"out vec4 color;\n"
+	"void main()\n"
+	"{\n"
+	"	color = vec4(0.0, 0.0, 0.0, 1.0);\n"
+	"}\n";
+
+#define HIDDEN_AREA_SEGM	32
+
+bool goatvr::calc_hidden_area_mesh(std::vector<Vec2> *tris, const EyeFov &fov)
+{
+	/* treat the lens as a circle in tangent space, centered on the optical axis
+	 * and reaching the furthest viewport edge. Everything between it and a
+	 * circle enclosing the viewport corners is hidden, and the parts outside
+	 * the viewport are clipped away when drawing.
+	 */
+	float xmax = std::max(-fov.left, fov.right);
+	float ymax = std::max(-fov.bottom, fov.top);
+	float rad = std::max(xmax, ymax);
+	float outer_rad = sqrt(xmax * xmax + ymax * ymax) * 1.01f;
+	if(outer_rad <= rad * 1.01f) {
+		return false;
+	}
+
+	float du = fov.right - fov.left;
+	float dv = fov.top - fov.bottom;
+
+	Vec2 inner[HIDDEN_AREA_SEGM + 1], outer[HIDDEN_AREA_SEGM + 1];
+	for(int i=0; i<=HIDDEN_AREA_SEGM; i++) {
+		float theta = 6.2831853f * (float)i / (float)HIDDEN_AREA_SEGM;
+		float x = cos(theta);
+		float y = sin(theta);
+		inner[i] = Vec2((x * rad - fov.left) / du, (y * rad - fov.bottom) / dv);
+		outer[i] = Vec2((x * outer_rad - fov.left) / du, (y * outer_rad - fov.bottom) / dv);
+	}
+
+	tris->clear();
+	for(int i=0; i<HIDDEN_AREA_SEGM; i++) {
+		tris->push_back(inner[i]);
+		tris->push_back(outer[i]);
+		tris->push_back(outer[i + 1]);
+
+		tris->push_back(inner[i]);
+		tris->push_back(outer[i + 1]);
+		tris->push_back(inner[i + 1]);
+	}
+	return true;
+}
+
+static bool update_hidden_area()
+{
+	if(hidden_valid && hidden_mod == display_module) {
+		return hidden_count[0] + hidden_count[1] > 0;
+	}
+	hidden_valid = true;
+	hidden_mod = display_module;
+	hidden_count[0] = hidden_count[1] = 0;
+
+	if(!glcaps.shaders) {
+		return false;
+	}
+	if(!hidden_prog) {
+		if(!(hidden_prog = create_program_load(hidden_vsdr, hidden_psdr))) {
+			fprintf(stderr, "goatvr: failed to create the hidden area shader, disabling\n");
+			hidden_mode = GOATVR_HIDDEN_AREA_OFF;
+			return false;
+		}
+	}
+
+	std::vector<Vec2> verts, eye_verts;
+	for(int i=0; i<2; i++) {
+		hidden_first[i] = (int)verts.size();
+		if(display_module->get_hidden_area_mesh(i, &eye_verts)) {
+			verts.insert(verts.end(), eye_verts.begin(), eye_verts.end());
+		}
+		hidden_count[i] = (int)verts.size() - hidden_first[i];
+	}
+	if(verts.empty()) {
+		return false;
+	}
+
+	if(!hidden_vao) {
+		glGenVertexArrays(1, &hidden_vao);
+		glGenBuffers(1, &hidden_vbo);
+
+		int loc = glGetAttribLocation(hidden_prog, "attr_vertex");
+		glBindVertexArray(hidden_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, hidden_vbo);
+		glVertexAttribPointer(loc, 2, GL_FLOAT, 0, 0, 0);
+		glEnableVertexAttribArray(loc);
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, hidden_vbo);
+	}
+	glBufferData(GL_ARRAY_BUFFER, verts.size() * 2 * sizeof(float), &verts[0].x, GL_STATIC_DRAW);
+	return true;
+}
+
+void goatvr::destroy_hidden_area()
+{
+	if(hidden_vao) {
+		glDeleteVertexArrays(1, &hidden_vao);
+		glDeleteBuffers(1, &hidden_vbo);
+		hidden_vao = hidden_vbo = 0;
+	}
+	if(hidden_prog) {
+		free_program(hidden_prog);
+		hidden_prog = 0;
+	}
+	hidden_valid = false;
+}
+
+void goatvr::draw_hidden_area(int eye)
+{
+	if(!hidden_mode) return;
+
+	push_gl_state();
+
+	if(!update_hidden_area() || !hidden_count[eye]) {
+		pop_gl_state();
+		return;
+	}
+
+	glUseProgram(hidden_prog);
+	glBindVertexArray(hidden_vao);
+
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_SCISSOR_TEST);
+	glColorMask(0, 0, 0, 0);
+
+	if(hidden_mode == GOATVR_HIDDEN_AREA_STENCIL) {
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(0);
+		glEnable(GL_STENCIL_TEST);
+		glStencilFunc(GL_ALWAYS, 1, 0xff);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+		glStencilMask(0xff);
+		set_uniform_float(hidden_prog, "depth", 0.0f);
+	} else {
+		// depth writes need the depth test enabled
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_ALWAYS);
+		glDepthMask(1);
+		glDisable(GL_STENCIL_TEST);
+		set_uniform_float(hidden_prog, "depth", proj_flags & GOATVR_PROJ_REVERSE_Z ? 1.0f : -1.0f);
+	}
+
+	glDrawArrays(GL_TRIANGLES, hidden_first[eye], hidden_count[eye]);
+
+	pop_gl_state();
+}
+
+void goatvr::invalidate_hidden_area()
+{
+	hidden_valid = false;
+}
+
+extern "C" {
+
+void goatvr_set_hidden_area(int mode)
+{
+	if(mode == GOATVR_HIDDEN_AREA_STENCIL && !user_fbo && !zfmt[depth_fmt].stencil) {
+		fprintf(stderr, "goatvr: hidden area stencil prefill needs a depth format with stencil\n");
+	}
+	hidden_mode = mode;
+	hidden_valid = false;
+}
+
+int goatvr_get_hidden_area(void)
+{
+	return hidden_mode;
+}
+
+}	// extern "C"
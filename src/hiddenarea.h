@@ -0,0 +1,37 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef HIDDENAREA_H_
+#define HIDDENAREA_H_
+
+/* hidden area masking (see goatvr_set_hidden_area). The meshes of both eyes
+ * come from the display module, and are drawn into the depth or stencil buffer
+ * by goatvr_draw_eye.
+ */
+
+namespace goatvr {
+
+// rebuild the meshes the next time they're drawn. Called by goatvr_startvr.
+void invalidate_hidden_area();
+void destroy_hidden_area();
+
+// called by goatvr_draw_eye, after setting the viewport of eye
+void draw_hidden_area(int eye);
+
+}	// namespace goatvr
+
+#endif	/* HIDDENAREA_H_ */
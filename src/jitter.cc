@@ -0,0 +1,145 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "modman.h"
+#include "render.h"
+#include "jitter.h"
+
+using namespace goatvr;
+
+/* sub-pixel projection jitter for temporal antialiasing (in pixels), and the
+ * view matrices of the last frame for motion vectors. Both advance in
+ * goatvr_draw_start, with jitter_next_frame.
+ */
+#define JITTER_SEQ_LEN	8
+static bool jitter;
+static int jitter_idx;
+static float cur_jitter[2], prev_jitter[2];
+static Mat4 cur_view[2], prev_view[2];
+static bool have_cur_view;
+
+// radical inverse of idx in the given base: the Halton low-discrepancy sequence
+static float halton(int idx, int base)
+{
+	float f = 1.0f, res = 0.0f;
+	while(idx > 0) {
+		f /= (float)base;
+		res += f * (float)(idx % base);
+		idx /= base;
+	}
+	return res;
+}
+
+/* offset a projection by a fraction of a pixel of a width x height viewport,
+ * by translating in clip space after the projection.
+ */
+static void apply_jitter(Mat4 &proj, const float *offs, int width, int height)
+{
+	if(width <= 0 || height <= 0 || (offs[0] == 0.0f && offs[1] == 0.0f)) {
+		return;
+	}
+	Mat4 xform;
+	xform.translation(2.0f * offs[0] / (float)width, 2.0f * offs[1] / (float)height, 0.0f);
+	proj = proj * xform;
+}
+
+static void apply_eye_jitter(Mat4 &proj, int eye, const float *offs)
+{
+	int rect[4];
+	get_eye_rect(eye, rect);
+	apply_jitter(proj, offs, rect[2], rect[3]);
+}
+
+void goatvr::jitter_next_frame()
+{
+	for(int i=0; i<2; i++) {
+		Mat4 view;
+		display_module->get_view_matrix(view, i);
+		prev_view[i] = have_cur_view ? cur_view[i] : view;
+		cur_view[i] = view;
+	}
+	have_cur_view = true;
+
+	prev_jitter[0] = cur_jitter[0];
+	prev_jitter[1] = cur_jitter[1];
+	if(jitter) {
+		jitter_idx = jitter_idx % JITTER_SEQ_LEN + 1;	// skip index 0 of the sequence
+		cur_jitter[0] = halton(jitter_idx, 2) - 0.5f;
+		cur_jitter[1] = halton(jitter_idx, 3) - 0.5f;
+	} else {
+		cur_jitter[0] = cur_jitter[1] = 0.0f;
+	}
+}
+
+void goatvr::jitter_update_view()
+{
+	for(int i=0; i<2; i++) {
+		display_module->get_view_matrix(cur_view[i], i);
+	}
+}
+
+void goatvr::jitter_proj(Mat4 &proj, int width, int height)
+{
+	apply_jitter(proj, cur_jitter, width, height);
+}
+
+void goatvr::jitter_eye_proj(Mat4 &proj, int eye)
+{
+	apply_eye_jitter(proj, eye, cur_jitter);
+}
+
+extern "C" {
+
+float *goatvr_prev_view_matrix(int eye)
+{
+	return display_module ? prev_view[eye][0] : ident_mat;
+}
+
+float *goatvr_prev_projection_matrix(int eye, float znear, float zfar)
+{
+	static Mat4 pmat[2];
+	if(display_module) {
+		display_module->get_proj_matrix(pmat[eye], eye, znear, zfar, proj_flags);
+		apply_eye_jitter(pmat[eye], eye, prev_jitter);
+		return pmat[eye][0];
+	}
+	return ident_mat;
+}
+
+void goatvr_set_jitter(int enable)
+{
+	jitter = enable != 0;
+}
+
+int goatvr_get_jitter(void)
+{
+	return jitter ? 1 : 0;
+}
+
+void goatvr_get_jitter_offset(float *offs, float *prev_offs)
+{
+	if(offs) {
+		offs[0] = cur_jitter[0];
+		offs[1] = cur_jitter[1];
+	}
+	if(prev_offs) {
+		prev_offs[0] = prev_jitter[0];
+		prev_offs[1] = prev_jitter[1];
+	}
+}
+
+}	// extern "C"
@@ -0,0 +1,43 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef JITTER_H_
+#define JITTER_H_
+
+#include "goatvr_impl.h"
+
+/* sub-pixel projection jitter for temporal antialiasing (see goatvr_set_jitter),
+ * and the view matrices of the last frame for motion vectors.
+ */
+
+namespace goatvr {
+
+/* keep the last frame's view matrices and jitter, and advance to the next.
+ * Called by goatvr_draw_start, after the module update.
+ */
+void jitter_next_frame();
+// re-read the view matrices of this frame, after late latching changed the pose
+void jitter_update_view();
+
+// offset proj by the jitter of this frame, for a width x height viewport
+void jitter_proj(Mat4 &proj, int width, int height);
+// ... for the viewport of eye
+void jitter_eye_proj(Mat4 &proj, int eye);
+
+}	// namespace goatvr
+
+#endif	/* JITTER_H_ */
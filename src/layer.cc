@@ -0,0 +1,284 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <algorithm>
+#include "opengl.h"
+#include "sdr.h"
+#include "layer.h"
+#include "module.h"
+
+using namespace goatvr;
+
+static std::vector<goatvr_layer*> layers;
+
+// fallback compositor, for display modules without native layers
+static unsigned int layer_prog, layer_vao;
+static bool layer_prog_failed;
+
+/* a strip of segments columns, bent around the y axis into an arc for
+ * cylinders, or flat for quads
+ */
+static const char *layer_vsdr =
+	"#version 150\n"
+	"uniform mat4 mvp;\n"
+	"uniform vec2 size;\n"
+	"uniform float arc, radius, segments;\n"
+	"out vec2 tc;\n"
+	"void main()\n"
+	"{\n"
+	"	float u = float(gl_VertexID >> 1) / segments;\n"
+	"	float v = float(gl_VertexID & 1);\n"
+	"	vec3 pos;\n"
+	"	if(arc > 0.0) {\n"
+	"		float theta = (u - 0.5) * arc;\n"
+	"		pos = vec3(sin(theta) * radius, (v - 0.5) * size.y, -cos(theta) * radius);\n"
+	"	} else {\n"
+	"		pos = vec3((u - 0.5) * size.x, (v - 0.5) * size.y, 0.0);\n"
+	"	}\n"
+	"	tc = vec2(u, v);\n"
+	"	gl_Position = mvp * vec4(pos, 1.0);\n"
+	"}\n";
+
+static const char *layer_psdr =
+	"#version 150\n"
+	"uniform sampler2D tex;\n"
+	"in vec2 tc;\n"
+	"out vec4 color;\n"
+	"void main()\n"
+	"{\n"
+	"	color = texture(tex, tc);\n"
+	"}\n";
+
+const std::vector<goatvr_layer*> &goatvr::get_layers()
+{
+	return layers;
+}
+
+int goatvr::update_layers(Module *mod)
+{
+	int num_left = 0;
+	for(size_t i=0; i<layers.size(); i++) {
+		goatvr_layer *layer = layers[i];
+		if(layer->mod != mod) {
+			if(layer->mod && layer->native) {
+				layer->mod->remove_layer(layer);
+			}
+			layer->mod = mod;
+			layer->native = mod->add_layer(layer);
+			layer->tex_changed = true;
+		}
+		if(!layer->native && layer->visible) {
+			num_left++;
+		}
+	}
+	return num_left;
+}
+
+void goatvr::composite_layers(Module *mod, unsigned int fbo, const int (*eye_rect)[4], unsigned int proj_flags)
+{
+	if(!layer_prog) {
+		if(layer_prog_failed || !glcaps.shaders) {
+			return;
+		}
+		if(!(layer_prog = create_program_load(layer_vsdr, layer_psdr))) {
+			fprintf(stderr, "goatvr: failed to create the layer compositing program\n");
+			layer_prog_failed = true;
+			return;
+		}
+		glGenVertexArrays(1, &layer_vao);	// attribute-less, vertices from gl_VertexID
+	}
+
+	Mat4 head_xform;
+	mod->get_head_matrix(head_xform);
+
+	float znear, zfar;
+	goatvr_get_clip_planes(&znear, &zfar);
+
+	push_gl_state();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glUseProgram(layer_prog);
+	glBindVertexArray(layer_vao);
+	glActiveTexture(GL_TEXTURE0);
+
+	/* layers go over the scene, alpha-blended in the color space of the
+	 * textures: sRGB textures are decoded when sampled, so those are encoded
+	 * again on write (and blended in linear space), the rest pass through.
+	 */
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glColorMask(1, 1, 1, 1);
+
+	set_uniform_int(layer_prog, "tex", 0);
+
+	for(int i=0; i<2; i++) {
+		Mat4 view, proj;
+		mod->get_view_matrix(view, i);
+		mod->get_proj_matrix(proj, i, znear, zfar, proj_flags);
+		Mat4 viewproj = view * proj;
+
+		glViewport(eye_rect[i][0], eye_rect[i][1], eye_rect[i][2], eye_rect[i][3]);
+
+		for(size_t j=0; j<layers.size(); j++) {
+			goatvr_layer *layer = layers[j];
+			if(layer->native || !layer->visible || !layer->tex) {
+				continue;
+			}
+
+			Mat4 model;
+			calc_matrix(model, layer->pos, layer->rot);
+			if(layer_head_locked(layer)) {
+				model = model * head_xform;
+			}
+			Mat4 mvp = model * viewproj;
+
+			int segments = 1;
+			float arc = 0.0f;
+			if(layer_shape(layer) == GOATVR_LAYER_CYLINDER && layer->radius > 0.0f) {
+				segments = LAYER_CYL_SEGMENTS;
+				arc = layer->width / layer->radius;
+			}
+
+			if(layer->tex_srgb) {
+				glEnable(GL_FRAMEBUFFER_SRGB);
+			} else {
+				glDisable(GL_FRAMEBUFFER_SRGB);
+			}
+			glBindTexture(GL_TEXTURE_2D, layer->tex);
+			set_uniform_matrix4(layer_prog, "mvp", mvp[0]);
+			set_uniform_float2(layer_prog, "size", layer->width, layer->height);
+			set_uniform_float(layer_prog, "arc", arc);
+			set_uniform_float(layer_prog, "radius", layer->radius);
+			set_uniform_float(layer_prog, "segments", segments);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, (segments + 1) * 2);
+		}
+	}
+
+	pop_gl_state();
+}
+
+void goatvr::layers_frame_done()
+{
+	for(size_t i=0; i<layers.size(); i++) {
+		layers[i]->tex_changed = false;
+	}
+}
+
+void goatvr::destroy_layers()
+{
+	while(!layers.empty()) {
+		goatvr_layer_destroy(layers.back());
+	}
+
+	if(layer_prog) {
+		free_program(layer_prog);
+		layer_prog = 0;
+	}
+	if(layer_vao) {
+		glDeleteVertexArrays(1, &layer_vao);
+		layer_vao = 0;
+	}
+	layer_prog_failed = false;
+}
+
+extern "C" {
+
+goatvr_layer *goatvr_layer_create(int type, unsigned int tex, float width, float height)
+{
+	goatvr_layer *layer = new goatvr_layer;
+	layer->type = type;
+	layer->tex = 0;
+	layer->tex_width = layer->tex_height = 0;
+	layer->tex_srgb = false;
+	layer->width = width;
+	layer->height = height;
+	layer->radius = goatvr_get_units_scale();	// 1 meter
+	layer->pos = Vec3(0, 0, 0);
+	layer->rot = Quat(0, 0, 0, 1);
+	layer->visible = true;
+	layer->tex_changed = true;
+	layer->mod = 0;
+	layer->native = false;
+	layer->mod_data = 0;
+
+	goatvr_layer_texture(layer, tex);
+
+	layers.push_back(layer);
+	return layer;
+}
+
+void goatvr_layer_destroy(goatvr_layer *layer)
+{
+	if(!layer) return;
+
+	if(layer->mod && layer->native) {
+		layer->mod->remove_layer(layer);
+	}
+	layers.erase(std::remove(layers.begin(), layers.end(), layer), layers.end());
+	delete layer;
+}
+
+void goatvr_layer_texture(goatvr_layer *layer, unsigned int tex)
+{
+	if(tex && tex != layer->tex) {
+		int prev_tex;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &prev_tex);
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &layer->tex_width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &layer->tex_height);
+		int ifmt;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &ifmt);
+		layer->tex_srgb = ifmt == GL_SRGB || ifmt == GL_SRGB8 || ifmt == GL_SRGB_ALPHA ||
+			ifmt == GL_SRGB8_ALPHA8;
+		glBindTexture(GL_TEXTURE_2D, prev_tex);
+	}
+	layer->tex = tex;
+	layer->tex_changed = true;
+}
+
+void goatvr_layer_size(goatvr_layer *layer, float width, float height)
+{
+	layer->width = width;
+	layer->height = height;
+}
+
+void goatvr_layer_radius(goatvr_layer *layer, float radius)
+{
+	layer->radius = radius;
+}
+
+void goatvr_layer_pose(goatvr_layer *layer, const float *pos, const float *quat)
+{
+	if(pos) {
+		layer->pos = Vec3(pos[0], pos[1], pos[2]);
+	}
+	if(quat) {
+		layer->rot = Quat(quat[0], quat[1], quat[2], quat[3]);
+	}
+}
+
+void goatvr_layer_visible(goatvr_layer *layer, int visible)
+{
+	layer->visible = visible != 0;
+}
+
+}	// extern "C"
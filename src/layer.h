@@ -0,0 +1,75 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef LAYER_H_
+#define LAYER_H_
+
+#include "goatvr_impl.h"
+
+/* overlay layer, see goatvr_layer_create. Display modules which can present
+ * layers natively (Module::add_layer) read this state while submitting each
+ * frame, the rest are composited into the eye buffers by goatvr_draw_done.
+ */
+struct goatvr_layer {
+	int type;			// GOATVR_LAYER_QUAD or GOATVR_LAYER_CYLINDER, plus GOATVR_LAYER_HEAD_LOCKED
+	unsigned int tex;
+	int tex_width, tex_height;
+	bool tex_srgb;			// sRGB internal format, decoded to linear when sampled
+	float width, height;	// world units, the width of cylinders is the arc length
+	float radius;			// cylinders only
+	Vec3 pos;				// relative to the tracking origin, or the head if head-locked
+	Quat rot;
+	bool visible;
+	bool tex_changed;		// the texture changed since the last frame submitted
+
+	goatvr::Module *mod;	// the display module this layer was last handed to
+	bool native;			// ... and it accepted to present it itself
+	void *mod_data;			// module-specific native layer data
+};
+
+namespace goatvr {
+
+#define LAYER_CYL_SEGMENTS	32
+
+inline int layer_shape(const goatvr_layer *layer)
+{
+	return layer->type & ~GOATVR_LAYER_HEAD_LOCKED;
+}
+
+inline bool layer_head_locked(const goatvr_layer *layer)
+{
+	return (layer->type & GOATVR_LAYER_HEAD_LOCKED) != 0;
+}
+
+const std::vector<goatvr_layer*> &get_layers();
+
+/* offer any layers not seen yet by mod to it. Returns the number of layers
+ * left for composite_layers.
+ */
+int update_layers(Module *mod);
+/* draw the visible layers which are not presented natively by mod, over the
+ * eyes of the framebuffer fbo. eye_rect is x, y, width, height of each eye.
+ */
+void composite_layers(Module *mod, unsigned int fbo, const int (*eye_rect)[4], unsigned int proj_flags);
+// called by goatvr_draw_done after the display module submitted the frame
+void layers_frame_done();
+// destroys all layers, and the compositing resources
+void destroy_layers();
+
+}	// namespace goatvr
+
+#endif	/* LAYER_H_ */
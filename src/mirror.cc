@@ -0,0 +1,254 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include "opengl.h"
+#include "sdr.h"
+#include "mirror.h"
+#include "goatvr.h"
+
+#ifndef GL_SAMPLE_BUFFERS
+#define GL_SAMPLE_BUFFERS		0x80a8
+#endif
+#ifndef GL_DRAW_FRAMEBUFFER_BINDING
+#define GL_DRAW_FRAMEBUFFER_BINDING	0x8ca6
+#define GL_READ_FRAMEBUFFER_BINDING	0x8caa
+#endif
+
+using namespace goatvr;
+
+static void calc_src_rect(const int (*eye_rect)[4], int win_width, int win_height, int *rect);
+static bool blit_mirror(unsigned int tex, const int *src, const int *dst);
+static bool draw_mirror_quad(unsigned int tex, int tex_width, int tex_height, const int *src,
+		bool flip_y, int win_width, int win_height);
+
+static unsigned int mirror_fbo;
+static unsigned int mirror_prog, mirror_vao;
+static bool mirror_failed;
+
+static const char *mirror_vsdr =
+	"#version 150\n"
+	"uniform vec4 tc_rect;\n"
+	"out vec2 tc;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 pos = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));\n"
+	"	tc = mix(tc_rect.xy, tc_rect.zw, pos);\n"
+	"	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+static const char *mirror_psdr =
+	"#version 150\n"
+	"uniform sampler2D tex;\n"
+	"in vec2 tc;\n"
+	"out vec4 color;\n"
+	"void main()\n"
+	"{\n"
+	"	color = texture(tex, tc);\n"
+	"}\n";
+
+void goatvr::destroy_mirror()
+{
+	if(mirror_fbo) {
+		glDeleteFramebuffers(1, &mirror_fbo);
+		mirror_fbo = 0;
+	}
+	if(mirror_prog) {
+		free_program(mirror_prog);
+		mirror_prog = 0;
+	}
+	if(mirror_vao) {
+		glDeleteVertexArrays(1, &mirror_vao);
+		mirror_vao = 0;
+	}
+	mirror_failed = false;
+}
+
+bool goatvr::present_mirror(unsigned int src_tex, int tex_width, int tex_height, const int (*eye_rect)[4],
+		bool flip_y, int win_width, int win_height)
+{
+	if(!src_tex || mirror_failed) {
+		return false;
+	}
+
+	if(win_width <= 0 || win_height <= 0) {
+		int vp[4];
+		glGetIntegerv(GL_VIEWPORT, vp);
+		win_width = vp[0] + vp[2];
+		win_height = vp[1] + vp[3];
+	}
+
+	int src[4], dst[4];
+	calc_src_rect(eye_rect, win_width, win_height, src);
+	dst[0] = 0;
+	dst[1] = flip_y ? win_height : 0;
+	dst[2] = win_width;
+	dst[3] = flip_y ? 0 : win_height;
+
+	int prev_draw_fb, prev_read_fb;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_draw_fb);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_read_fb);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	int msaa = 0;
+	glGetIntegerv(GL_SAMPLE_BUFFERS, &msaa);
+
+	bool res;
+	if(msaa) {
+		res = draw_mirror_quad(src_tex, tex_width, tex_height, src, flip_y, win_width, win_height);
+	} else {
+		res = blit_mirror(src_tex, src, dst);
+	}
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prev_draw_fb);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_read_fb);
+
+	if(!res) {
+		fprintf(stderr, "goatvr: mirror presentation not possible with this OpenGL context, disabling\n");
+		mirror_failed = true;
+	}
+	return res;
+}
+
+// source rectangle as x0, y0, x1, y1 for the current mirror mode
+static void calc_src_rect(const int (*eye_rect)[4], int win_width, int win_height, int *rect)
+{
+	int mode = goatvr_get_mirror_mode();
+
+	switch(mode) {
+	case GOATVR_MIRROR_LEFT:
+	case GOATVR_MIRROR_RIGHT:
+		{
+			const int *r = eye_rect[mode == GOATVR_MIRROR_RIGHT ? 1 : 0];
+			rect[0] = r[0];
+			rect[1] = r[1];
+			rect[2] = r[0] + r[2];
+			rect[3] = r[1] + r[3];
+		}
+		break;
+
+	case GOATVR_MIRROR_CROPPED:
+		{
+			// the largest part of the left eye, centered, matching the window aspect ratio
+			const int *r = eye_rect[0];
+			int w = r[2];
+			int h = r[3];
+			if(w * win_height > h * win_width) {
+				w = h * win_width / win_height;
+			} else {
+				h = w * win_height / win_width;
+			}
+			rect[0] = r[0] + (r[2] - w) / 2;
+			rect[1] = r[1] + (r[3] - h) / 2;
+			rect[2] = rect[0] + w;
+			rect[3] = rect[1] + h;
+		}
+		break;
+
+	case GOATVR_MIRROR_BOTH:
+	default:
+		for(int i=0; i<2; i++) {
+			rect[i] = eye_rect[0][i] < eye_rect[1][i] ? eye_rect[0][i] : eye_rect[1][i];
+
+			int end0 = eye_rect[0][i] + eye_rect[0][i + 2];
+			int end1 = eye_rect[1][i] + eye_rect[1][i + 2];
+			rect[i + 2] = end0 > end1 ? end0 : end1;
+		}
+		break;
+	}
+}
+
+static bool blit_mirror(unsigned int tex, const int *src, const int *dst)
+{
+#ifndef GL_VERSION_3_0
+	if(!glBlitFramebuffer) return false;
+#endif
+
+	if(!mirror_fbo) {
+		if(glcaps.dsa) {
+			glCreateFramebuffers(1, &mirror_fbo);
+		} else {
+			glGenFramebuffers(1, &mirror_fbo);
+		}
+	}
+	if(glcaps.dsa) {
+		glNamedFramebufferTexture(mirror_fbo, GL_COLOR_ATTACHMENT0, tex, 0);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, mirror_fbo);
+	} else {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, mirror_fbo);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+	}
+
+	// blits are subject to the scissor test, and sRGB encoding on write
+	bool scissor = glIsEnabled(GL_SCISSOR_TEST);
+	bool srgb = glIsEnabled(GL_FRAMEBUFFER_SRGB);
+	if(scissor) glDisable(GL_SCISSOR_TEST);
+	if(srgb) glDisable(GL_FRAMEBUFFER_SRGB);
+
+	glBlitFramebuffer(src[0], src[1], src[2], src[3], dst[0], dst[1], dst[2], dst[3],
+			GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	if(scissor) glEnable(GL_SCISSOR_TEST);
+	if(srgb) glEnable(GL_FRAMEBUFFER_SRGB);
+	return true;
+}
+
+static bool draw_mirror_quad(unsigned int tex, int tex_width, int tex_height, const int *src,
+		bool flip_y, int win_width, int win_height)
+{
+	if(!mirror_prog) {
+		if(!glcaps.shaders) {
+			return false;
+		}
+		if(!(mirror_prog = create_program_load(mirror_vsdr, mirror_psdr))) {
+			return false;
+		}
+		glGenVertexArrays(1, &mirror_vao);	// attribute-less, vertices from gl_VertexID
+	}
+
+	push_gl_state();
+
+	glUseProgram(mirror_prog);
+	glBindVertexArray(mirror_vao);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, tex);
+
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glDisable(GL_FRAMEBUFFER_SRGB);
+	glColorMask(1, 1, 1, 1);
+	glViewport(0, 0, win_width, win_height);
+
+	float u0 = (float)src[0] / (float)tex_width;
+	float u1 = (float)src[2] / (float)tex_width;
+	float v0 = (float)src[1] / (float)tex_height;
+	float v1 = (float)src[3] / (float)tex_height;
+
+	set_uniform_int(mirror_prog, "tex", 0);
+	if(flip_y) {
+		set_uniform_float4(mirror_prog, "tc_rect", u0, v1, u1, v0);
+	} else {
+		set_uniform_float4(mirror_prog, "tc_rect", u0, v0, u1, v1);
+	}
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	pop_gl_state();
+	return true;
+}
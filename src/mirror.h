@@ -0,0 +1,41 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MIRROR_H_
+#define MIRROR_H_
+
+/* Mirror window presentation shared by the HMD modules. Copies the eyes out of
+ * a texture to the window framebuffer (0), according to the mirror mode set by
+ * goatvr_set_mirror_mode. Uses a single glBlitFramebuffer, or a textured quad
+ * if the window is multisampled (which can't be a blit destination). Leaves
+ * the GL state of the application untouched.
+ */
+
+namespace goatvr {
+
+void destroy_mirror();
+
+/* eye_rect: x, y, width, height of each eye in src_tex, with the origin at the
+ * bottom-left. flip_y is for textures with the origin at the top-left. A
+ * window size of -1 uses the extents of the current viewport.
+ */
+bool present_mirror(unsigned int src_tex, int tex_width, int tex_height, const int (*eye_rect)[4],
+		bool flip_y, int win_width, int win_height);
+
+}	// namespace goatvr
+
+#endif	/* MIRROR_H_ */
@@ -0,0 +1,320 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "opengl.h"
+#include "sdr.h"
+#include "mod_3dtv.h"
+#include "goatvr_impl.h"
+
+REG_MODULE(3dtv, Module3DTV)
+
+using namespace goatvr;
+
+static int parse_format(const char *s);
+
+static const char *vsdr =
+	"#version 150\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 pos = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));\n"
+	"	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+/* for every window pixel, pick the eye it belongs to, and the cell in that
+ * eye's image grid it shows. With fbscale 1 the cell centers fall exactly on
+ * texel centers, so nothing is filtered across rows or columns. The render
+ * texture is sRGB, so the samples come out linear, and are re-encoded here
+ * to leave the window framebuffer sRGB state alone. The format values match
+ * the TV3D_* enumeration in mod_3dtv.h.
+ */
+static const char *psdr =
+	"#version 150\n"
+	"uniform sampler2D tex;\n"
+	"uniform vec4 eye_rect[2];\n"
+	"uniform vec2 win_size;\n"
+	"uniform int format, swap;\n"
+	"out vec4 color;\n"
+	"vec3 eye_color(int eye, vec2 cell, vec2 grid)\n"
+	"{\n"
+	"	vec2 uv = clamp((cell + 0.5) / grid, 0.0, 1.0);\n"
+	"	return texture(tex, eye_rect[eye].xy + uv * eye_rect[eye].zw).rgb;\n"
+	"}\n"
+	"vec3 srgb_encode(vec3 c)\n"
+	"{\n"
+	"	c = clamp(c, 0.0, 1.0);\n"
+	"	return mix(c * 12.92, 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, c));\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 p = floor(gl_FragCoord.xy);\n"
+	"	vec2 hsz = floor(win_size * 0.5);\n"
+	"	int col = int(p.x);\n"
+	"	int row = int(win_size.y - 1.0 - p.y);	// counting from the top\n"
+	"	int eye;\n"
+	"	vec2 cell, grid;\n"
+	"	if(format == 5) {\n"
+	"		vec3 l = eye_color(0 ^ swap, p, win_size);\n"
+	"		vec3 r = eye_color(1 ^ swap, p, win_size);\n"
+	"		vec3 c;\n"
+	"		c.r = dot(vec3(0.4561, 0.500484, 0.176381), l) +\n"
+	"			dot(vec3(-0.0434706, -0.0879388, -0.00155529), r);\n"
+	"		c.g = dot(vec3(-0.0400822, -0.0378246, -0.0157589), l) +\n"
+	"			dot(vec3(0.378476, 0.73364, -0.0184503), r);\n"
+	"		c.b = dot(vec3(-0.0152161, -0.0205971, -0.00546856), l) +\n"
+	"			dot(vec3(-0.0721527, -0.112961, 1.2264), r);\n"
+	"		color = vec4(srgb_encode(c), 1.0);\n"
+	"		return;\n"
+	"	}\n"
+	"	if(format == 0) {\n"
+	"		eye = p.x < hsz.x ? 0 : 1;\n"
+	"		cell = vec2(p.x - float(eye) * hsz.x, p.y);\n"
+	"		grid = vec2(hsz.x, win_size.y);\n"
+	"	} else if(format == 1) {\n"
+	"		eye = float(row) < hsz.y ? 0 : 1;\n"
+	"		cell = vec2(p.x, eye == 0 ? p.y - (win_size.y - hsz.y) : p.y);\n"
+	"		grid = vec2(win_size.x, hsz.y);\n"
+	"	} else if(format == 2) {\n"
+	"		eye = row & 1;\n"
+	"		cell = vec2(p.x, floor(p.y * 0.5));\n"
+	"		grid = vec2(win_size.x, hsz.y);\n"
+	"	} else {\n"
+	"		eye = format == 3 ? col & 1 : (col + row) & 1;\n"
+	"		cell = vec2(floor(p.x * 0.5), p.y);\n"
+	"		grid = vec2(hsz.x, win_size.y);\n"
+	"	}\n"
+	"	color = vec4(srgb_encode(eye_color(eye ^ swap, cell, grid)), 1.0);\n"
+	"}\n";
+
+Module3DTV::Module3DTV()
+{
+	rtex_valid = false;
+	format = TV3D_HALF_SBS;
+	swap_eyes = false;
+	prog = vao = 0;
+}
+
+Module3DTV::~Module3DTV()
+{
+	destroy();
+}
+
+bool Module3DTV::init()
+{
+	if(!ModuleSBS::init()) {
+		return false;
+	}
+
+	format = parse_format(getenv("GOATVR_3DTV_FORMAT"));
+	swap_eyes = getenv("GOATVR_3DTV_SWAP") != 0;
+	return true;
+}
+
+const char *Module3DTV::get_name() const
+{
+	return "3dtv";
+}
+
+bool Module3DTV::detect()
+{
+	avail = glcaps.shaders;
+	return avail;
+}
+
+void Module3DTV::stop()
+{
+	rtex.destroy();
+	rtex_valid = false;
+
+	if(prog) {
+		free_program(prog);
+		prog = 0;
+	}
+	release_present();
+	ModuleSBS::stop();
+}
+
+void Module3DTV::set_fbsize(int width, int height, float fbscale)
+{
+	if(width != win_width || height != win_height || fbscale != rtex.fbscale) {
+		rtex_valid = false;
+	}
+	rtex.fbscale = fbscale;
+	ModuleSBS::set_fbsize(width, height, fbscale);
+}
+
+RenderTexture *Module3DTV::get_render_texture()
+{
+	if(!rtex_valid) {
+		if(win_width == -1) {
+			int vp[4];
+			glGetIntegerv(GL_VIEWPORT, vp);
+			win_width = vp[2] + vp[0];
+			win_height = vp[3] + vp[1];
+		}
+
+		// each eye only gets as many pixels as the format leaves for it
+		int eye_xsz = win_width;
+		int eye_ysz = win_height;
+
+		switch(format) {
+		case TV3D_HALF_SBS:
+		case TV3D_COLUMNS:
+		case TV3D_CHECKER:
+			eye_xsz /= 2;
+			break;
+
+		case TV3D_TOP_BOTTOM:
+		case TV3D_ROWS:
+			eye_ysz /= 2;
+			break;
+
+		default:
+			break;
+		}
+
+		for(int i=0; i<2; i++) {
+			rtex.eye_width[i] = (int)((float)eye_xsz * rtex.fbscale);
+			rtex.eye_height[i] = (int)((float)eye_ysz * rtex.fbscale);
+			rtex.eye_yoffs[i] = 0;
+		}
+		rtex.eye_xoffs[0] = 0;
+		rtex.eye_xoffs[1] = rtex.eye_width[0];
+
+		// allocate for the maximum scale, to avoid reallocations when the scale changes
+		float max_scale = goatvr_get_fb_max_scale();
+		int max_fbwidth = (int)((float)eye_xsz * max_scale) * 2;
+		int max_fbheight = (int)((float)eye_ysz * max_scale);
+
+		rtex.update(rtex.eye_width[0] + rtex.eye_width[1], rtex.eye_height[0], max_fbwidth, max_fbheight);
+		rtex_valid = true;
+	}
+	return &rtex;
+}
+
+bool Module3DTV::set_render_texture(unsigned int tex, int width, int height)
+{
+	rtex.set_external(tex, width, height);
+	rtex_valid = false;
+	return true;
+}
+
+void Module3DTV::draw_done()
+{
+	PresentParams par;
+	get_present_params(&par);
+	present(rtex.tex, &rtex, &par);
+}
+
+bool Module3DTV::can_present() const
+{
+	return true;
+}
+
+void Module3DTV::get_present_params(PresentParams *par) const
+{
+	ModuleSBS::get_present_params(par);
+	par->mode = format;
+	par->swap_eyes = swap_eyes;
+}
+
+bool Module3DTV::present(unsigned int tex, const RenderTexture *layout, const PresentParams *par)
+{
+	if(!tex || par->win_width <= 0 || par->win_height <= 0) {
+		return false;
+	}
+
+	if(!prog) {
+		if(!(prog = create_program_load(vsdr, psdr))) {
+			print_error("failed to create the output shader program\n");
+			return false;
+		}
+	}
+	if(!vao) {
+		glGenVertexArrays(1, &vao);	// attribute-less, vertices from gl_VertexID
+	}
+
+	push_gl_state();
+
+	glUseProgram(prog);
+	glBindVertexArray(vao);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, tex);
+
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glDisable(GL_FRAMEBUFFER_SRGB);
+	glColorMask(1, 1, 1, 1);
+	glViewport(0, 0, par->win_width, par->win_height);
+
+	float rect[2][4];
+	for(int i=0; i<2; i++) {
+		rect[i][0] = (float)layout->eye_xoffs[i] / (float)layout->tex_width;
+		rect[i][1] = (float)layout->eye_yoffs[i] / (float)layout->tex_height;
+		rect[i][2] = (float)layout->eye_width[i] / (float)layout->tex_width;
+		rect[i][3] = (float)layout->eye_height[i] / (float)layout->tex_height;
+	}
+
+	set_uniform_int(prog, "tex", 0);
+	set_uniform_int(prog, "format", par->mode);
+	set_uniform_int(prog, "swap", par->swap_eyes ? 1 : 0);
+	set_uniform_float2(prog, "win_size", (float)par->win_width, (float)par->win_height);
+	set_uniform_float4(prog, "eye_rect[0]", rect[0][0], rect[0][1], rect[0][2], rect[0][3]);
+	set_uniform_float4(prog, "eye_rect[1]", rect[1][0], rect[1][1], rect[1][2], rect[1][3]);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	pop_gl_state();
+	return true;
+}
+
+// the vertex array is the only object of the output pass not shared between contexts
+void Module3DTV::release_present()
+{
+	if(vao) {
+		glDeleteVertexArrays(1, &vao);
+		vao = 0;
+	}
+	ModuleSBS::release_present();
+}
+
+static int parse_format(const char *s)
+{
+	static const struct { const char *name; int fmt; } formats[] = {
+		{ "hsbs", TV3D_HALF_SBS },
+		{ "tb", TV3D_TOP_BOTTOM },
+		{ "rows", TV3D_ROWS },
+		{ "columns", TV3D_COLUMNS },
+		{ "checker", TV3D_CHECKER },
+		{ "dubois", TV3D_DUBOIS },
+		{ 0, 0 }
+	};
+
+	if(!s) return TV3D_HALF_SBS;
+
+	for(int i=0; formats[i].name; i++) {
+		if(strcasecmp(s, formats[i].name) == 0) {
+			return formats[i].fmt;
+		}
+	}
+	fprintf(stderr, "goatvr: unknown 3dtv format: %s, using hsbs\n", s);
+	return TV3D_HALF_SBS;
+}
@@ -0,0 +1,75 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MOD_3DTV_H_
+#define MOD_3DTV_H_
+
+#include "mod_sbs.h"
+#include "rtex.h"
+
+namespace goatvr {
+
+/* stereo output for 3D TVs, projectors, and anaglyph glasses. Each eye is
+ * rendered to its own part of a render texture, at the resolution the output
+ * format can actually show, and the two are combined into the window in a
+ * single shader pass by draw_done.
+ */
+enum {
+	TV3D_HALF_SBS,		// half-width side-by-side
+	TV3D_TOP_BOTTOM,	// half-height top-bottom (left eye on top)
+	TV3D_ROWS,			// row-interleaved (left eye on the top row)
+	TV3D_COLUMNS,		// column-interleaved (left eye on the first column)
+	TV3D_CHECKER,		// checkerboard (left eye on the top-left pixel)
+	TV3D_DUBOIS			// full-color Dubois red-cyan anaglyph
+};
+
+class Module3DTV : public ModuleSBS {
+protected:
+	RenderTexture rtex;
+	bool rtex_valid;
+
+	int format;
+	bool swap_eyes;
+
+	unsigned int prog, vao;
+
+public:
+	Module3DTV();
+	~Module3DTV();
+
+	bool init();
+
+	const char *get_name() const;
+
+	bool detect();
+	void stop();
+
+	void set_fbsize(int width, int height, float fbscale);
+	RenderTexture *get_render_texture();
+	bool set_render_texture(unsigned int tex, int width, int height);
+
+	void draw_done();
+
+	bool can_present() const;
+	void get_present_params(PresentParams *par) const;
+	bool present(unsigned int tex, const RenderTexture *layout, const PresentParams *par);
+	void release_present();
+};
+
+}	// namespace goatvr
+
+#endif	// MOD_3DTV_H_
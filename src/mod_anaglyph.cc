@@ -64,3 +64,8 @@ void ModuleAnaglyph::draw_done()
 {
 	glColorMask(1, 1, 1, 1);
 }
+
+bool ModuleAnaglyph::can_present() const
+{
+	return false;
+}
@@ -35,6 +35,9 @@ public:
 	void draw_start();
 	void draw_eye(int eye);
 	void draw_done();
+
+	// color masks don't apply to blits, so it can't be an output module
+	bool can_present() const;
 };
 
 }	// namespace goatvr
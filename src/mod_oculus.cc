@@ -21,6 +21,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <algorithm>
 #include "opengl.h"
 #include "mod_oculus.h"
+#include "mirror.h"
+#include "layer.h"
 #include "goatvr_impl.h"
 
 REG_MODULE(oculus, ModuleOculus)
@@ -29,6 +31,14 @@ using namespace goatvr;
 
 static inline void update_tracking(PosRot *pr, const ovrPosef &pose, float units_scale);
 
+// native quad/cylinder layer, see add_layer
+struct OculusLayer {
+	ovrTextureSwapChain chain;
+	int width, height;
+	ovrLayerQuad quad;
+	ovrLayerCylinder cyl;
+};
+
 ModuleOculus::ModuleOculus()
 {
 	ovr = 0;
@@ -40,6 +50,8 @@ ModuleOculus::ModuleOculus()
 
 	rtex_valid = false;
 	have_touch = false;
+	latched = false;
+	layer_fbo[0] = layer_fbo[1] = 0;
 	hand_valid[0] = hand_valid[1] = false;
 }
 
@@ -124,6 +136,12 @@ void ModuleOculus::stop()
 {
 	if(!ovr) return;	// not started
 
+	release_layers();
+	if(layer_fbo[0]) {
+		glDeleteFramebuffers(2, layer_fbo);
+		layer_fbo[0] = layer_fbo[1] = 0;
+	}
+
 	if(ovr_rtex) {
 		ovr_DestroyTextureSwapChain(ovr, ovr_rtex);
 		ovr_rtex = 0;
@@ -134,9 +152,23 @@ void ModuleOculus::stop()
 	ovr = 0;
 }
 
+void ModuleOculus::suspend()
+{
+	/* keep the session and the swap chain. While we're not submitting frames
+	 * the oculus compositor takes over the display.
+	 */
+	hand_valid[0] = hand_valid[1] = false;
+}
+
+void ModuleOculus::trim()
+{
+	stop();
+}
+
 void ModuleOculus::update()
 {
 	float units_scale = goatvr_get_units_scale();
+	latched = false;
 	ovrPosef eye_offs[2] = {
 		rdesc[0].HmdToEyePose,
 		rdesc[1].HmdToEyePose
@@ -148,25 +180,11 @@ void ModuleOculus::update()
 
 	// fill in the details for the head input source
 	update_tracking(&head, tstate.HeadPose.ThePose, units_scale);
+	update_eye_xforms(units_scale);
 
-	for(int i=0; i<2; i++) {
-		ovrVector3f pos = ovr_layer.RenderPose[i].Position;
-		ovrQuatf rot = ovr_layer.RenderPose[i].Orientation;
-
-		eye[i].pos = Vec3(pos.x, pos.y, pos.z) * units_scale;
-		eye[i].rot = Quat(rot.x, rot.y, rot.z, rot.w);
-
-		Mat4 rmat = eye[i].rot.calc_matrix();
-		Mat4 tmat;
-		tmat.translation(eye[i].pos);
-		eye[i].xform = rmat * tmat;
-
-		rmat.transpose();
-		tmat.translation(-eye[i].pos);
-		eye_inv_xform[i] = tmat * rmat;
-
-		// also update hand tracking poses if available
-		if(have_touch) {
+	// also update hand tracking poses if available
+	if(have_touch) {
+		for(int i=0; i<2; i++) {
 			hand_valid[i] = (tstate.HandStatusFlags[i] & ovrStatus_PositionTracked) != 0;
 			update_tracking(hand + i, tstate.HandPoses[i].ThePose, units_scale);
 		}
@@ -202,6 +220,68 @@ void ModuleOculus::update()
 	}
 }
 
+/* re-predict the head pose for the frame about to be submitted. The layer
+ * RenderPose is what the compositor timewarps from, so it always matches the
+ * poses returned by get_view_matrix.
+ */
+bool ModuleOculus::late_latch()
+{
+	float units_scale = goatvr_get_units_scale();
+	ovrPosef eye_offs[2] = {
+		rdesc[0].HmdToEyePose,
+		rdesc[1].HmdToEyePose
+	};
+
+	if(!latched) {
+		unlatched_pose[0] = ovr_layer.RenderPose[0];
+		unlatched_pose[1] = ovr_layer.RenderPose[1];
+		unlatched_time = ovr_layer.SensorSampleTime;
+		unlatched_head = head;
+	}
+
+	double tm = ovr_GetPredictedDisplayTime(ovr, 0);
+	ovr_layer.SensorSampleTime = ovr_GetTimeInSeconds();
+	ovrTrackingState tstate = ovr_GetTrackingState(ovr, tm, ovrTrue);
+	ovr_CalcEyePoses(tstate.HeadPose.ThePose, eye_offs, ovr_layer.RenderPose);
+
+	update_tracking(&head, tstate.HeadPose.ThePose, units_scale);
+	update_eye_xforms(units_scale);
+	latched = true;
+	return true;
+}
+
+void ModuleOculus::unlatch()
+{
+	if(!latched) return;
+
+	ovr_layer.RenderPose[0] = unlatched_pose[0];
+	ovr_layer.RenderPose[1] = unlatched_pose[1];
+	ovr_layer.SensorSampleTime = unlatched_time;
+	head = unlatched_head;
+	update_eye_xforms(goatvr_get_units_scale());
+	latched = false;
+}
+
+void ModuleOculus::update_eye_xforms(float units_scale)
+{
+	for(int i=0; i<2; i++) {
+		ovrVector3f pos = ovr_layer.RenderPose[i].Position;
+		ovrQuatf rot = ovr_layer.RenderPose[i].Orientation;
+
+		eye[i].pos = Vec3(pos.x, pos.y, pos.z) * units_scale;
+		eye[i].rot = Quat(rot.x, rot.y, rot.z, rot.w);
+
+		Mat4 rmat = eye[i].rot.calc_matrix();
+		Mat4 tmat;
+		tmat.translation(eye[i].pos);
+		eye[i].xform = rmat * tmat;
+
+		rmat.transpose();
+		tmat.translation(-eye[i].pos);
+		eye_inv_xform[i] = tmat * rmat;
+	}
+}
+
 void ModuleOculus::set_origin_mode(goatvr_origin_mode mode)
 {
 	if(!ovr) return;	// not started
@@ -372,9 +452,20 @@ RenderTexture *ModuleOculus::get_render_texture()
 
 		int fbwidth = texsz[0].w + texsz[1].w;
 		int fbheight = std::max(texsz[0].h, texsz[1].h);
-
-		int texwidth = next_pow2(fbwidth);
-		int texheight = next_pow2(fbheight);
+		int texwidth, texheight;
+
+		// allocate for the maximum scale, to avoid reallocations when the scale changes
+		float max_scale = goatvr_get_fb_max_scale();
+		texwidth = next_pow2(fbwidth);
+		texheight = next_pow2(fbheight);
+		if(max_scale > rtex.fbscale) {
+			ovrSizei maxsz[2];
+			for(int i=0; i<2; i++) {
+				maxsz[i] = ovr_GetFovTextureSize(ovr, (ovrEyeType)i, hmd.DefaultEyeFov[i], max_scale);
+			}
+			texwidth = next_pow2(maxsz[0].w + maxsz[1].w);
+			texheight = next_pow2(std::max(maxsz[0].h, maxsz[1].h));
+		}
 
 		// recreate the texture if necessary
 		if(rtex.tex_width != texwidth || rtex.tex_height != texheight) {
@@ -414,8 +505,8 @@ RenderTexture *ModuleOculus::get_render_texture()
 		for(int i=0; i<2; i++) {
 			ovr_layer.ColorTexture[i] = ovr_rtex;
 			ovr_layer.Fov[i] = rdesc[i].Fov;
-			//ovr_layer.Viewport[i].Pos = {rtex.eye_xoffs[i], rtex.eye_yoffs[i]};
-			ovr_layer.Viewport[i].Pos = {rtex.eye_xoffs[i], texheight - fbheight};
+			// viewport positions are relative to the top of the texture
+			ovr_layer.Viewport[i].Pos = {rtex.eye_xoffs[i], rtex.tex_height - rtex.eye_yoffs[i] - rtex.eye_height[i]};
 			ovr_layer.Viewport[i].Size = {rtex.eye_width[i], rtex.eye_height[i]};
 		}
 
@@ -468,8 +559,20 @@ void ModuleOculus::draw_done()
 	scale_desc.HmdSpaceToWorldScaleInMeters = 1.0 / goatvr_get_units_scale();
 	scale_desc.HmdToEyePose[0] = rdesc[0].HmdToEyePose;
 	scale_desc.HmdToEyePose[1] = rdesc[1].HmdToEyePose;
-	ovrLayerHeader *layers = &ovr_layer.Header;
-	ovrResult res = ovr_SubmitFrame(ovr, 0, &scale_desc, &layers, 1);
+	std::vector<ovrLayerHeader*> layers;
+	layers.push_back(&ovr_layer.Header);
+
+	const std::vector<goatvr_layer*> &glayers = get_layers();
+	for(size_t i=0; i<glayers.size(); i++) {
+		if(glayers[i]->mod == this && glayers[i]->native) {
+			ovrLayerHeader *hdr = prepare_layer(glayers[i]);
+			if(hdr) {
+				layers.push_back(hdr);
+			}
+		}
+	}
+
+	ovrResult res = ovr_SubmitFrame(ovr, 0, &scale_desc, &layers[0], layers.size());
 	switch(res) {
 	case ovrSuccess_NotVisible:
 		//print_info("lost HMD ownership\n");
@@ -489,40 +592,154 @@ void ModuleOculus::draw_done()
 	}
 }
 
-void ModuleOculus::draw_mirror()
+bool ModuleOculus::add_layer(goatvr_layer *layer)
 {
-	glViewport(0, 0, win_width, win_height);
+	if(!ovr) return false;
 
-	glPushAttrib(GL_ENABLE_BIT);
-	glDisable(GL_LIGHTING);
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_ALPHA_TEST);
-	glDisable(GL_STENCIL_TEST);
-	glDisable(GL_CULL_FACE);
+	OculusLayer *olayer = new OculusLayer;
+	memset(olayer, 0, sizeof *olayer);
+	layer->mod_data = olayer;
+	return true;
+}
 
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, mirtex);
+void ModuleOculus::remove_layer(goatvr_layer *layer)
+{
+	OculusLayer *olayer = (OculusLayer*)layer->mod_data;
+	if(olayer) {
+		if(olayer->chain && ovr) {
+			ovr_DestroyTextureSwapChain(ovr, olayer->chain);
+		}
+		delete olayer;
+		layer->mod_data = 0;
+	}
+}
 
-	glMatrixMode(GL_MODELVIEW);
-	glPushMatrix();
-	glLoadIdentity();
-	glMatrixMode(GL_PROJECTION);
-	glPushMatrix();
-	glLoadIdentity();
+// the swap chains go away with the session, have goatvr offer the layers again
+void ModuleOculus::release_layers()
+{
+	const std::vector<goatvr_layer*> &layers = get_layers();
+	for(size_t i=0; i<layers.size(); i++) {
+		if(layers[i]->mod == this) {
+			if(layers[i]->native) {
+				remove_layer(layers[i]);
+			}
+			layers[i]->mod = 0;
+			layers[i]->native = false;
+		}
+	}
+}
+
+/* copy the layer texture to its swap chain if it changed, and fill in the
+ * ovrLayerQuad or ovrLayerCylinder for this frame
+ */
+ovrLayerHeader *ModuleOculus::prepare_layer(goatvr_layer *layer)
+{
+	OculusLayer *olayer = (OculusLayer*)layer->mod_data;
+	if(!layer->visible || !layer->tex) {
+		return 0;
+	}
 
-	glBegin(GL_QUADS);
-	glColor3f(1, 1, 1);
-	glTexCoord2f(0, 1); glVertex2f(-1, -1);
-	glTexCoord2f(1, 1); glVertex2f(1, -1);
-	glTexCoord2f(1, 0); glVertex2f(1, 1);
-	glTexCoord2f(0, 0); glVertex2f(-1, 1);
-	glEnd();
+	if(layer->tex_changed) {
+		if(!olayer->chain || olayer->width != layer->tex_width || olayer->height != layer->tex_height) {
+			if(olayer->chain) {
+				ovr_DestroyTextureSwapChain(ovr, olayer->chain);
+				olayer->chain = 0;
+			}
 
-	glPopMatrix();
-	glMatrixMode(GL_MODELVIEW);
-	glPopMatrix();
+			ovrTextureSwapChainDesc desc;
+			memset(&desc, 0, sizeof desc);
+			desc.Type = ovrTexture_2D;
+			desc.Format = OVR_FORMAT_R8G8B8A8_UNORM_SRGB;
+			desc.ArraySize = 1;
+			desc.Width = layer->tex_width;
+			desc.Height = layer->tex_height;
+			desc.MipLevels = 1;
+			desc.SampleCount = 1;
 
-	glPopAttrib();
+			if(ovr_CreateTextureSwapChainGL(ovr, &desc, &olayer->chain) != 0) {
+				print_error("failed to create layer swap chain (%dx%d)\n", layer->tex_width, layer->tex_height);
+				olayer->chain = 0;
+				return 0;
+			}
+			olayer->width = layer->tex_width;
+			olayer->height = layer->tex_height;
+		}
+
+		unsigned int dst_tex;
+		ovr_GetTextureSwapChainBufferGL(ovr, olayer->chain, -1, &dst_tex);
+
+		if(!layer_fbo[0]) {
+			glGenFramebuffers(2, layer_fbo);
+		}
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, layer_fbo[0]);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layer->tex, 0);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, layer_fbo[1]);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dst_tex, 0);
+
+		// copy the bits as they are, the swap chain is sRGB to have them decoded
+		bool srgb = glIsEnabled(GL_FRAMEBUFFER_SRGB);
+		bool scissor = glIsEnabled(GL_SCISSOR_TEST);
+		if(srgb) glDisable(GL_FRAMEBUFFER_SRGB);
+		if(scissor) glDisable(GL_SCISSOR_TEST);
+
+		glBlitFramebuffer(0, 0, olayer->width, olayer->height, 0, 0, olayer->width, olayer->height,
+				GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+		if(srgb) glEnable(GL_FRAMEBUFFER_SRGB);
+		if(scissor) glEnable(GL_SCISSOR_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		ovr_CommitTextureSwapChain(ovr, olayer->chain);
+	}
+	if(!olayer->chain) {
+		return 0;
+	}
+
+	float inv_scale = 1.0f / goatvr_get_units_scale();
+	ovrPosef pose;
+	pose.Orientation = {layer->rot.x, layer->rot.y, layer->rot.z, layer->rot.w};
+	pose.Position = {layer->pos.x * inv_scale, layer->pos.y * inv_scale, layer->pos.z * inv_scale};
+
+	unsigned int flags = ovrLayerFlag_TextureOriginAtBottomLeft | ovrLayerFlag_HighQuality;
+	if(layer_head_locked(layer)) {
+		flags |= ovrLayerFlag_HeadLocked;
+	}
+	ovrRecti vp = {{0, 0}, {olayer->width, olayer->height}};
+
+	if(layer_shape(layer) == GOATVR_LAYER_CYLINDER) {
+		ovrLayerCylinder *cyl = &olayer->cyl;
+		cyl->Header.Type = ovrLayerType_Cylinder;
+		cyl->Header.Flags = flags;
+		cyl->ColorTexture = olayer->chain;
+		cyl->Viewport = vp;
+		cyl->CylinderPoseCenter = pose;
+		cyl->CylinderRadius = layer->radius * inv_scale;
+		cyl->CylinderAngle = layer->radius > 0.0f ? layer->width / layer->radius : 0.0f;
+		cyl->CylinderAspectRatio = layer->height > 0.0f ? layer->width / layer->height : 0.0f;
+		return &cyl->Header;
+	}
+
+	ovrLayerQuad *quad = &olayer->quad;
+	quad->Header.Type = ovrLayerType_Quad;
+	quad->Header.Flags = flags;
+	quad->ColorTexture = olayer->chain;
+	quad->Viewport = vp;
+	quad->QuadPoseCenter = pose;
+	quad->QuadSize = {layer->width * inv_scale, layer->height * inv_scale};
+	return &quad->Header;
+}
+
+void ModuleOculus::draw_mirror()
+{
+	if(!ovr_mirtex) return;
+
+	// both eyes side by side, the mirror texture has its origin at the top-left
+	int hw = mirtex_width / 2;
+	int rect[2][4] = {
+		{0, 0, hw, mirtex_height},
+		{hw, 0, mirtex_width - hw, mirtex_height}
+	};
+	present_mirror(mirtex, mirtex_width, mirtex_height, rect, true, win_width, win_height);
 }
 
 bool ModuleOculus::should_swap() const
@@ -530,15 +747,33 @@ bool ModuleOculus::should_swap() const
 	return true;
 }
 
+bool ModuleOculus::window_is_mirror() const
+{
+	return true;
+}
+
 void ModuleOculus::get_view_matrix(Mat4 &mat, int eye) const
 {
 	mat = eye_inv_xform[eye];
 }
 
-void ModuleOculus::get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar) const
+bool ModuleOculus::get_eye_fov(int eye, EyeFov *fov) const
+{
+	const ovrFovPort &fp = rdesc[eye].Fov;
+	fov->left = -fp.LeftTan;
+	fov->right = fp.RightTan;
+	fov->bottom = -fp.DownTan;
+	fov->top = fp.UpTan;
+	return true;
+}
+
+bool ModuleOculus::get_hidden_area_mesh(int eye, std::vector<Vec2> *tris) const
 {
-	ovrMatrix4f m = ovrMatrix4f_Projection(rdesc[eye].Fov, znear, zfar, ovrProjection_ClipRangeOpenGL);
-	mat = transpose(*(Mat4*)&m);
+	EyeFov fov;
+	if(!get_eye_fov(eye, &fov)) {
+		return false;
+	}
+	return calc_hidden_area_mesh(tris, fov);
 }
 
 Vec3 ModuleOculus::get_head_position() const
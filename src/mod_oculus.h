@@ -35,6 +35,11 @@ protected:
 	ovrGraphicsLuid ovr_luid;
 	ovrTextureSwapChainData *ovr_rtex;
 	ovrLayerEyeFov ovr_layer;
+	// layer poses and head pose from before late_latch
+	ovrPosef unlatched_pose[2];
+	double unlatched_time;
+	PosRot unlatched_head;
+	bool latched;
 
 	bool have_touch;
 
@@ -54,6 +59,11 @@ protected:
 	int mirtex_width, mirtex_height;
 	int win_width, win_height;
 
+	unsigned int layer_fbo[2];	// for copying layer textures to their swap chains
+
+	void update_eye_xforms(float units_scale);
+	ovrLayerHeader *prepare_layer(goatvr_layer *layer);
+	void release_layers();
 
 public:
 	ModuleOculus();
@@ -69,8 +79,12 @@ public:
 
 	bool start();
 	void stop();
+	void suspend();
+	void trim();
 
 	void update();
+	bool late_latch();
+	void unlatch();
 
 	void set_origin_mode(goatvr_origin_mode mode);
 	void recenter();
@@ -99,9 +113,14 @@ public:
 	void draw_mirror();
 
 	bool should_swap() const;
+	bool window_is_mirror() const;
 
 	void get_view_matrix(Mat4 &mat, int eye) const;
-	void get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar) const;
+	bool get_eye_fov(int eye, EyeFov *fov) const;
+	bool get_hidden_area_mesh(int eye, std::vector<Vec2> *tris) const;
+
+	bool add_layer(goatvr_layer *layer);
+	void remove_layer(goatvr_layer *layer);
 
 	Vec3 get_head_position() const;
 	Quat get_head_orientation() const;
@@ -38,7 +38,6 @@ REG_MODULE(oculus_old, ModuleOculusOld)
 
 using namespace goatvr;
 
-static Mat4 ovr_matrix(const ovrMatrix4f &mat);
 static ovrHmdType parse_hmdtype(const char *s);
 
 
@@ -184,16 +183,33 @@ void ModuleOculusOld::stop()
 {
 	if(!hmd) return;	// not started
 
-	if(rtex.tex) {
-		glDeleteTextures(1, &rtex.tex);
-		rtex.tex = 0;
-	}
+	rtex.destroy();
 	rtex_valid = false;
 
 	ovrHmd_Destroy(hmd);
 	hmd = 0;
 }
 
+void ModuleOculusOld::suspend()
+{
+	if(!hmd) return;
+
+	/* the distortion renderer is tied to the HMD object, which also holds the
+	 * display in direct mode, so that has to go. The render texture survives;
+	 * get_render_texture on the next start reuses it if the size didn't change.
+	 */
+	rtex_valid = false;
+
+	ovrHmd_Destroy(hmd);
+	hmd = 0;
+}
+
+void ModuleOculusOld::trim()
+{
+	rtex.destroy();
+	rtex_valid = false;
+}
+
 void ModuleOculusOld::update()
 {
 	float units_scale = goatvr_get_units_scale();
@@ -281,15 +297,26 @@ RenderTexture *ModuleOculusOld::get_render_texture()
 		int fbwidth = texsz[0].w + texsz[1].w;
 		int fbheight = std::max(texsz[0].h, texsz[1].h);
 
-		rtex.update(fbwidth, fbheight);
+		// allocate for the maximum scale, to avoid reallocations when the scale changes
+		int max_fbwidth = 0, max_fbheight = 0;
+		float max_scale = goatvr_get_fb_max_scale();
+		if(max_scale > rtex.fbscale) {
+			for(int i=0; i<2; i++) {
+				ovrSizei sz = ovrHmd_GetFovTextureSize(hmd, (ovrEyeType)i, hmd->DefaultEyeFov[i], max_scale);
+				max_fbwidth += sz.w;
+				max_fbheight = std::max(max_fbheight, sz.h);
+			}
+		}
+
+		rtex.update(fbwidth, fbheight, max_fbwidth, max_fbheight);
 
 		// prepare the ovrGLTexture
 		for(int i=0; i<2; i++) {
 			ovr_gltex[i].OGL.Header.API = ovrRenderAPI_OpenGL;
 			ovr_gltex[i].OGL.Header.TextureSize.w = rtex.tex_width;
 			ovr_gltex[i].OGL.Header.TextureSize.h = rtex.tex_height;
-			ovr_gltex[i].OGL.Header.RenderViewport.Pos.x = i == 0 ? 0 : fbwidth / 2;
-			ovr_gltex[i].OGL.Header.RenderViewport.Pos.y = 0;
+			ovr_gltex[i].OGL.Header.RenderViewport.Pos.x = rtex.eye_xoffs[i];
+			ovr_gltex[i].OGL.Header.RenderViewport.Pos.y = rtex.eye_yoffs[i];
 			ovr_gltex[i].OGL.Header.RenderViewport.Size = {rtex.eye_width[i], rtex.eye_height[i]};
 			ovr_gltex[i].OGL.TexId = rtex.tex;
 		}
@@ -299,6 +326,13 @@ RenderTexture *ModuleOculusOld::get_render_texture()
 	return &rtex;
 }
 
+bool ModuleOculusOld::set_render_texture(unsigned int tex, int width, int height)
+{
+	rtex.set_external(tex, width, height);
+	rtex_valid = false;
+	return true;
+}
+
 void ModuleOculusOld::draw_start()
 {
 	ovrHmd_BeginFrame(hmd, 0);
@@ -320,10 +354,23 @@ void ModuleOculusOld::get_view_matrix(Mat4 &mat, int eye) const
 	mat = eye_inv_xform[eye];
 }
 
-void ModuleOculusOld::get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar) const
+bool ModuleOculusOld::get_eye_fov(int eye, EyeFov *fov) const
+{
+	const ovrFovPort &fp = ovr_rdesc[eye].Fov;
+	fov->left = -fp.LeftTan;
+	fov->right = fp.RightTan;
+	fov->bottom = -fp.DownTan;
+	fov->top = fp.UpTan;
+	return true;
+}
+
+bool ModuleOculusOld::get_hidden_area_mesh(int eye, std::vector<Vec2> *tris) const
 {
-	mat = ovr_matrix(ovrMatrix4f_Projection(ovr_rdesc[eye].Fov, znear, zfar,
-			ovrProjection_RightHanded | ovrProjection_ClipRangeOpenGL));
+	EyeFov fov;
+	if(!get_eye_fov(eye, &fov)) {
+		return false;
+	}
+	return calc_hidden_area_mesh(tris, fov);
 }
 
 Vec3 ModuleOculusOld::get_head_position() const
@@ -342,14 +389,6 @@ void ModuleOculusOld::get_head_matrix(Mat4 &mat) const
 }
 
 
-static Mat4 ovr_matrix(const ovrMatrix4f &mat)
-{
-	return Mat4(mat.M[0][0], mat.M[1][0], mat.M[2][0], mat.M[3][0],
-			mat.M[0][1], mat.M[1][1], mat.M[2][1], mat.M[3][1],
-			mat.M[0][2], mat.M[1][2], mat.M[2][2], mat.M[3][2],
-			mat.M[0][3], mat.M[1][3], mat.M[2][3], mat.M[3][3]);
-}
-
 static ovrHmdType parse_hmdtype(const char *s)
 {
 	static const struct { const char *name; ovrHmdType type; } hmds[] = {
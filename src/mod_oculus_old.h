@@ -64,6 +64,8 @@ public:
 
 	bool start();
 	void stop();
+	void suspend();
+	void trim();
 
 	void update();
 
@@ -74,6 +76,7 @@ public:
 
 	void set_fbsize(int width, int height, float fbscale);
 	RenderTexture *get_render_texture();
+	bool set_render_texture(unsigned int tex, int width, int height);
 
 	void draw_start();
 	void draw_done();
@@ -81,7 +84,8 @@ public:
 	bool should_swap() const;
 
 	void get_view_matrix(Mat4 &mat, int eye) const;
-	void get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar) const;
+	bool get_eye_fov(int eye, EyeFov *fov) const;
+	bool get_hidden_area_mesh(int eye, std::vector<Vec2> *tris) const;
 
 	Vec3 get_head_position() const;
 	Quat get_head_orientation() const;
@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "mod_openhmd.h"
 #include "goatvr_impl.h"
 #include "opengl.h"
+#include "mirror.h"
 
 REG_MODULE(openhmd, ModuleOpenHMD)
 
@@ -29,6 +30,7 @@ ModuleOpenHMD::ModuleOpenHMD()
 {
 	ohmd = 0;
 	rtex_valid = false;
+	win_width = win_height = -1;
 }
 
 ModuleOpenHMD::~ModuleOpenHMD()
@@ -107,16 +109,23 @@ void ModuleOpenHMD::stop()
 {
 	if(!dev) return;
 
-	if(rtex.tex) {
-		glDeleteTextures(1, &rtex.tex);
-		rtex.tex = 0;
-	}
+	rtex.destroy();
 	rtex_valid = false;
 
 	ohmd_close_device(dev);
 	dev = 0;
 }
 
+void ModuleOpenHMD::suspend()
+{
+	// keep the device open and the render texture around, start will find them
+}
+
+void ModuleOpenHMD::trim()
+{
+	stop();
+}
+
 void ModuleOpenHMD::update()
 {
 	if(!dev) return;
@@ -135,6 +144,16 @@ void ModuleOpenHMD::update()
 	ohmd_device_getf(dev, OHMD_ROTATION_QUAT, &head.rot.x);
 }
 
+/* OpenHMD has no frame submission, re-reading the sensors is all there is to
+ * it, and update is cheap enough to just call it again.
+ */
+bool ModuleOpenHMD::late_latch()
+{
+	if(!dev) return false;
+	update();
+	return true;
+}
+
 void ModuleOpenHMD::recenter()
 {
 	const static float zero[] = {0, 0, 0, 1};
@@ -155,6 +174,8 @@ void ModuleOpenHMD::set_fbsize(int width, int height, float fbscale)
 		rtex_valid = false;
 	}
 	rtex.fbscale = fbscale;
+	win_width = width;
+	win_height = height;
 }
 
 RenderTexture *ModuleOpenHMD::get_render_texture()
@@ -162,18 +183,46 @@ RenderTexture *ModuleOpenHMD::get_render_texture()
 	if(!dev) return &rtex;
 
 	if(!rtex_valid) {
-		int fbwidth, fbheight;
+		int scr_width, scr_height;
 
-		ohmd_device_geti(dev, OHMD_SCREEN_HORIZONTAL_RESOLUTION, &fbwidth);
-		ohmd_device_geti(dev, OHMD_SCREEN_VERTICAL_RESOLUTION, &fbheight);
+		ohmd_device_geti(dev, OHMD_SCREEN_HORIZONTAL_RESOLUTION, &scr_width);
+		ohmd_device_geti(dev, OHMD_SCREEN_VERTICAL_RESOLUTION, &scr_height);
 
-		rtex.update(fbwidth, fbheight);
+		for(int i=0; i<2; i++) {
+			rtex.eye_width[i] = (int)((float)scr_width * 0.5f * rtex.fbscale);
+			rtex.eye_height[i] = (int)((float)scr_height * rtex.fbscale);
+			rtex.eye_yoffs[i] = 0;
+		}
+		rtex.eye_xoffs[0] = 0;
+		rtex.eye_xoffs[1] = rtex.eye_width[0];
+
+		// allocate for the maximum scale, to avoid reallocations when the scale changes
+		float max_scale = goatvr_get_fb_max_scale();
+		int max_fbwidth = (int)((float)scr_width * 0.5f * max_scale) * 2;
+		int max_fbheight = (int)((float)scr_height * max_scale);
+
+		rtex.update(rtex.eye_width[0] + rtex.eye_width[1], rtex.eye_height[0], max_fbwidth, max_fbheight);
 		// TODO more
+
+		// make sure we have the window size in case the user never called goatvr_set_fb_size
+		if(win_width == -1) {
+			int vp[4];
+			glGetIntegerv(GL_VIEWPORT, vp);
+			win_width = vp[2] + vp[0];
+			win_height = vp[3] + vp[1];
+		}
 		rtex_valid = true;
 	}
 	return &rtex;
 }
 
+bool ModuleOpenHMD::set_render_texture(unsigned int tex, int width, int height)
+{
+	rtex.set_external(tex, width, height);
+	rtex_valid = false;
+	return true;
+}
+
 void ModuleOpenHMD::draw_start()
 {
 }
@@ -184,6 +233,40 @@ void ModuleOpenHMD::draw_done()
 
 void ModuleOpenHMD::draw_mirror()
 {
+	PresentParams par;
+	get_present_params(&par);
+	present(rtex.tex, &rtex, &par);
+}
+
+// the HMD is just another monitor, so presenting is the same as mirroring
+bool ModuleOpenHMD::can_present() const
+{
+	return true;
+}
+
+void ModuleOpenHMD::get_present_params(PresentParams *par) const
+{
+	Module::get_present_params(par);
+	par->win_width = win_width;
+	par->win_height = win_height;
+}
+
+bool ModuleOpenHMD::present(unsigned int tex, const RenderTexture *layout, const PresentParams *par)
+{
+	int rect[2][4];
+	for(int i=0; i<2; i++) {
+		rect[i][0] = layout->eye_xoffs[i];
+		rect[i][1] = layout->eye_yoffs[i];
+		rect[i][2] = layout->eye_width[i];
+		rect[i][3] = layout->eye_height[i];
+	}
+	return present_mirror(tex, layout->tex_width, layout->tex_height, rect, false, par->win_width,
+			par->win_height);
+}
+
+void ModuleOpenHMD::release_present()
+{
+	destroy_mirror();
 }
 
 void ModuleOpenHMD::get_view_matrix(Mat4 &mat, int eye) const
@@ -191,11 +274,24 @@ void ModuleOpenHMD::get_view_matrix(Mat4 &mat, int eye) const
 	mat = eye_inv_xform[eye];
 }
 
-void ModuleOpenHMD::get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar) const
+bool ModuleOpenHMD::get_eye_fov(int eye, EyeFov *fov) const
+{
+	if(!dev) return false;
+
+	// the x/y part of the OpenHMD projection doesn't depend on the clipping planes
+	Mat4 proj;
+	ohmd_device_getf(dev, (ohmd_float_value)(OHMD_LEFT_EYE_GL_PROJECTION_MATRIX + eye), proj[0]);
+	calc_eye_fov(fov, proj);
+	return true;
+}
+
+bool ModuleOpenHMD::get_hidden_area_mesh(int eye, std::vector<Vec2> *tris) const
 {
-	ohmd_device_setf(dev, OHMD_PROJECTION_ZNEAR, &znear);
-	ohmd_device_setf(dev, OHMD_PROJECTION_ZFAR, &zfar);
-	ohmd_device_getf(dev, (ohmd_float_value)(OHMD_LEFT_EYE_GL_PROJECTION_MATRIX + eye), mat[0]);
+	EyeFov fov;
+	if(!get_eye_fov(eye, &fov)) {
+		return false;
+	}
+	return calc_hidden_area_mesh(tris, fov);
 }
 
 Vec3 ModuleOpenHMD::get_head_position() const
@@ -210,7 +306,7 @@ Quat ModuleOpenHMD::get_head_orientation() const
 
 void ModuleOpenHMD::get_head_matrix(Mat4 &mat) const
 {
-	// TODO
+	calc_matrix(mat, head.pos, head.rot);
 }
 
 #else
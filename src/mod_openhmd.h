@@ -35,6 +35,8 @@ protected:
 	PosRot eye[2];
 	Mat4 eye_inv_xform[2];
 
+	int win_width, win_height;	// for the mirror
+
 public:
 	ModuleOpenHMD();
 	~ModuleOpenHMD();
@@ -49,8 +51,11 @@ public:
 
 	bool start();
 	void stop();
+	void suspend();
+	void trim();
 
 	void update();
+	bool late_latch();
 
 	void recenter();
 
@@ -58,13 +63,20 @@ public:
 
 	void set_fbsize(int width, int height, float fbscale);
 	RenderTexture *get_render_texture();
+	bool set_render_texture(unsigned int tex, int width, int height);
 
 	void draw_start();
 	void draw_done();
 	void draw_mirror();
 
+	bool can_present() const;
+	void get_present_params(PresentParams *par) const;
+	bool present(unsigned int tex, const RenderTexture *layout, const PresentParams *par);
+	void release_present();
+
 	void get_view_matrix(Mat4 &mat, int eye) const;
-	void get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar) const;
+	bool get_eye_fov(int eye, EyeFov *fov) const;
+	bool get_hidden_area_mesh(int eye, std::vector<Vec2> *tris) const;
 
 	Vec3 get_head_position() const;
 	Quat get_head_orientation() const;
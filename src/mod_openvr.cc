@@ -17,10 +17,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #ifdef USE_MOD_OPENVR
 
+#include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include <algorithm>
 #include "opengl.h"
 #include "mod_openvr.h"
+#include "mirror.h"
+#include "layer.h"
 #include "goatvr_impl.h"
 
 REG_MODULE(openvr, ModuleOpenVR)
@@ -28,16 +32,24 @@ REG_MODULE(openvr, ModuleOpenVR)
 using namespace goatvr;
 using namespace vr;		// OpenVR namespace
 
-static void openvr_matrix4(Mat4 &res, const HmdMatrix44_t &mat);
 static void openvr_matrix(Mat4 &res, const HmdMatrix34_t &mat);
 static VRTextureBounds_t openvr_tex_bounds(float umin, float vmin, float umax, float vmax);
+static void openvr_matrix34(HmdMatrix34_t &res, const Mat4 &mat);
+
+// native layer, see add_layer
+struct OpenVRLayer {
+	VROverlayHandle_t ovl;
+	bool shown;
+};
 
 ModuleOpenVR::ModuleOpenVR()
 {
 	vr = 0;
 	vrcomp = 0;
+	suspended = false;
 	win_width = win_height = -1;
 	rtex_valid = false;
+	latched = false;
 
 	memset(xform_valid, 0, sizeof xform_valid);
 }
@@ -88,7 +100,14 @@ bool ModuleOpenVR::detect()
 
 bool ModuleOpenVR::start()
 {
-	if(vr) return true;	// already started
+	if(vr) {
+		// already started, or resuming from suspend
+		if(suspended) {
+			vrcomp->SuspendRendering(false);
+			suspended = false;
+		}
+		return true;
+	}
 
 	EVRInitError vrerr;
 	if(!(vr = VR_Init(&vrerr, VRApplication_Scene))) {
@@ -135,18 +154,35 @@ void ModuleOpenVR::stop()
 {
 	if(!vr) return;	// not started
 
+	release_layers();
+
 	// if we call VR_Shutdown while a frame is pending, we'll crash
 	vrcomp->ClearLastSubmittedFrame();
 	VR_Shutdown();
 	vr = 0;
+	suspended = false;
 
-	if(rtex.tex) {
-		glDeleteTextures(1, &rtex.tex);
-		rtex.tex = 0;
-	}
+	rtex.destroy();
 	rtex_valid = false;
 }
 
+void ModuleOpenVR::suspend()
+{
+	if(!vr || suspended) return;
+
+	// keep the OpenVR session and the render texture, just hand back the HMD
+	vrcomp->ClearLastSubmittedFrame();
+	vrcomp->SuspendRendering(true);
+	suspended = true;
+}
+
+void ModuleOpenVR::trim()
+{
+	if(suspended) {
+		stop();
+	}
+}
+
 void ModuleOpenVR::update()
 {
 	// XXX is this going to block?
@@ -187,6 +223,54 @@ void ModuleOpenVR::update()
 		*/
 	}
 
+	update_eye_xforms();
+	latched = false;
+}
+
+bool ModuleOpenVR::late_latch()
+{
+	if(!vr) return false;
+
+	/* predict the HMD pose for when this frame reaches the display: the rest of
+	 * the current frame period, plus the vsync to photons latency
+	 */
+	float since_vsync;
+	if(!vr->GetTimeSinceLastVsync(&since_vsync, 0)) {
+		return false;
+	}
+	float freq = vr->GetFloatTrackedDeviceProperty(k_unTrackedDeviceIndex_Hmd, Prop_DisplayFrequency_Float);
+	float photons = vr->GetFloatTrackedDeviceProperty(k_unTrackedDeviceIndex_Hmd, Prop_SecondsFromVsyncToPhotons_Float);
+	float pred = (freq > 0.0f ? 1.0f / freq : 0.0f) - since_vsync + photons;
+
+	TrackedDevicePose_t pose;
+	vr->GetDeviceToAbsoluteTrackingPose(vrcomp->GetTrackingSpace(), pred, &pose, 1);
+	if(!pose.bPoseIsValid) {
+		return false;
+	}
+
+	if(!latched) {
+		unlatched_pose = vr_pose[k_unTrackedDeviceIndex_Hmd];
+	}
+	vr_pose[k_unTrackedDeviceIndex_Hmd] = pose;
+	openvr_matrix(xform[k_unTrackedDeviceIndex_Hmd], pose.mDeviceToAbsoluteTracking);
+	update_eye_xforms();
+	latched = true;
+	return true;
+}
+
+void ModuleOpenVR::unlatch()
+{
+	if(!latched) return;
+
+	// back to the WaitGetPoses pose, and a plain submit
+	vr_pose[k_unTrackedDeviceIndex_Hmd] = unlatched_pose;
+	openvr_matrix(xform[k_unTrackedDeviceIndex_Hmd], unlatched_pose.mDeviceToAbsoluteTracking);
+	update_eye_xforms();
+	latched = false;
+}
+
+void ModuleOpenVR::update_eye_xforms()
+{
 	const Mat4 &hmd_xform = xform[k_unTrackedDeviceIndex_Hmd];
 	for(int i=0; i<2; i++) {
 		eye_xform[i] = eye_to_hmd_xform[i] * hmd_xform;
@@ -254,17 +338,26 @@ RenderTexture *ModuleOpenVR::get_render_texture()
 		int fbwidth = rtex.eye_width[0] + rtex.eye_width[1];
 		int fbheight = std::max(rtex.eye_height[0], rtex.eye_height[1]);
 
-		rtex.update(fbwidth, fbheight);
+		// allocate for the maximum scale, to avoid reallocations when the scale changes
+		float max_scale = goatvr_get_fb_max_scale();
+		int max_fbwidth = (int)((float)def_fbwidth * max_scale) * 2;
+		int max_fbheight = (int)((float)def_fbheight * max_scale);
+
+		rtex.update(fbwidth, fbheight, max_fbwidth, max_fbheight);
 
 		// prepare the OpenVR texture and texture bounds structs
-		vr_tex.handle = (void*)rtex.tex;
+		vr_tex.handle = (void*)(uintptr_t)rtex.tex;
 		vr_tex.eType = TextureType_OpenGL;
 		vr_tex.eColorSpace = ColorSpace_Linear;
 
-		float umax = (float)rtex.width / (float)rtex.tex_width;
-		float vmax = (float)rtex.height / (float)rtex.tex_height;
-		vr_tex_bounds[0] = openvr_tex_bounds(0, 1.0 - vmax, 0.5 * umax, 1.0);
-		vr_tex_bounds[1] = openvr_tex_bounds(0.5 * umax, 1.0 - vmax, umax, 1.0);
+		for(int i=0; i<2; i++) {
+			float umin = (float)rtex.eye_xoffs[i] / (float)rtex.tex_width;
+			float umax = (float)(rtex.eye_xoffs[i] + rtex.eye_width[i]) / (float)rtex.tex_width;
+			// OpenVR texture coordinates start at the top
+			float vmin = 1.0f - (float)(rtex.eye_yoffs[i] + rtex.eye_height[i]) / (float)rtex.tex_height;
+			float vmax = 1.0f - (float)rtex.eye_yoffs[i] / (float)rtex.tex_height;
+			vr_tex_bounds[i] = openvr_tex_bounds(umin, vmin, umax, vmax);
+		}
 
 		// make sure we have the correct viewport in case the user never called goatvr_set_fb_size
 		if(win_width == -1) {
@@ -279,10 +372,36 @@ RenderTexture *ModuleOpenVR::get_render_texture()
 	return &rtex;
 }
 
+bool ModuleOpenVR::set_render_texture(unsigned int tex, int width, int height)
+{
+	rtex.set_external(tex, width, height);
+	rtex_valid = false;
+	return true;
+}
+
 void ModuleOpenVR::draw_done()
 {
-	vrcomp->Submit(Eye_Left, &vr_tex, vr_tex_bounds);
-	vrcomp->Submit(Eye_Right, &vr_tex, vr_tex_bounds + 1);
+	if(latched) {
+		/* the frame was drawn with a late-latched pose, which is not the one
+		 * returned by WaitGetPoses. Let the compositor reproject from that.
+		 */
+		VRTextureWithPose_t ptex;
+		static_cast<Texture_t&>(ptex) = vr_tex;
+		ptex.mDeviceToAbsoluteTracking = vr_pose[k_unTrackedDeviceIndex_Hmd].mDeviceToAbsoluteTracking;
+
+		vrcomp->Submit(Eye_Left, &ptex, vr_tex_bounds, Submit_TextureWithPose);
+		vrcomp->Submit(Eye_Right, &ptex, vr_tex_bounds + 1, Submit_TextureWithPose);
+	} else {
+		vrcomp->Submit(Eye_Left, &vr_tex, vr_tex_bounds);
+		vrcomp->Submit(Eye_Right, &vr_tex, vr_tex_bounds + 1);
+	}
+
+	const std::vector<goatvr_layer*> &layers = get_layers();
+	for(size_t i=0; i<layers.size(); i++) {
+		if(layers[i]->mod == this && layers[i]->native) {
+			update_layer(layers[i]);
+		}
+	}
 
 	glFlush();
 
@@ -294,42 +413,124 @@ void ModuleOpenVR::draw_done()
 
 void ModuleOpenVR::draw_mirror()
 {
-	return;	// XXX it looks like maybe the mirror window drawing fucks this up ... no idea why
-	glClear(GL_COLOR_BUFFER_BIT);
-	glViewport(0, 0, win_width, win_height);
+	int rect[2][4];
+	for(int i=0; i<2; i++) {
+		rect[i][0] = rtex.eye_xoffs[i];
+		rect[i][1] = rtex.eye_yoffs[i];
+		rect[i][2] = rtex.eye_width[i];
+		rect[i][3] = rtex.eye_height[i];
+	}
+	present_mirror(rtex.tex, rtex.tex_width, rtex.tex_height, rect, false, win_width, win_height);
+}
+
+bool ModuleOpenVR::add_layer(goatvr_layer *layer)
+{
+	IVROverlay *vrovl = vr ? VROverlay() : 0;
+	if(!vrovl) return false;
+
+	char key[64];
+	sprintf(key, "goatvr.layer.%p", (void*)layer);
+
+	VROverlayHandle_t ovl;
+	if(vrovl->CreateOverlay(key, "goatvr layer", &ovl) != VROverlayError_None) {
+		print_error("failed to create overlay for layer\n");
+		return false;
+	}
+	// GL textures have the origin at the bottom-left
+	VRTextureBounds_t bounds = openvr_tex_bounds(0, 1, 1, 0);
+	vrovl->SetOverlayTextureBounds(ovl, &bounds);
+
+	OpenVRLayer *vrlayer = new OpenVRLayer;
+	vrlayer->ovl = ovl;
+	vrlayer->shown = false;
+	layer->mod_data = vrlayer;
+	return true;
+}
 
-	glPushAttrib(GL_ENABLE_BIT);
-	glDisable(GL_LIGHTING);
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_ALPHA_TEST);
-	glDisable(GL_STENCIL_TEST);
-	glDisable(GL_CULL_FACE);
+void ModuleOpenVR::remove_layer(goatvr_layer *layer)
+{
+	OpenVRLayer *vrlayer = (OpenVRLayer*)layer->mod_data;
+	if(vrlayer) {
+		if(vr) {
+			VROverlay()->DestroyOverlay(vrlayer->ovl);
+		}
+		delete vrlayer;
+		layer->mod_data = 0;
+	}
+}
+
+// overlays go away with the OpenVR session, have goatvr offer the layers again
+void ModuleOpenVR::release_layers()
+{
+	const std::vector<goatvr_layer*> &layers = get_layers();
+	for(size_t i=0; i<layers.size(); i++) {
+		if(layers[i]->mod == this) {
+			if(layers[i]->native) {
+				remove_layer(layers[i]);
+			}
+			layers[i]->mod = 0;
+			layers[i]->native = false;
+		}
+	}
+}
 
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, rtex.tex);
+/* OpenVR overlays keep their height at the aspect ratio of the texture, only
+ * the width of the layer is used.
+ */
+void ModuleOpenVR::update_layer(goatvr_layer *layer)
+{
+	OpenVRLayer *vrlayer = (OpenVRLayer*)layer->mod_data;
+	IVROverlay *vrovl = VROverlay();
+
+	bool show = layer->visible && layer->tex;
+	if(!show) {
+		if(vrlayer->shown) {
+			vrovl->HideOverlay(vrlayer->ovl);
+			vrlayer->shown = false;
+		}
+		return;
+	}
 
-	glMatrixMode(GL_MODELVIEW);
-	glPushMatrix();
-	glLoadIdentity();
-	glMatrixMode(GL_PROJECTION);
-	glPushMatrix();
-	glLoadIdentity();
+	if(layer->tex_changed) {
+		Texture_t tex;
+		tex.handle = (void*)(uintptr_t)layer->tex;
+		tex.eType = TextureType_OpenGL;
+		tex.eColorSpace = ColorSpace_Auto;
+		vrovl->SetOverlayTexture(vrlayer->ovl, &tex);
+	}
 
-	glBegin(GL_QUADS);
-	glColor3f(1, 1, 1);
-	float umax = (float)rtex.width / (float)rtex.tex_width;
-	float vmax = (float)rtex.height / (float)rtex.tex_height;
-	glTexCoord2f(0, 0); glVertex2f(-1, -1);
-	glTexCoord2f(umax, 0); glVertex2f(1, -1);
-	glTexCoord2f(umax, vmax); glVertex2f(1, 1);
-	glTexCoord2f(0, vmax); glVertex2f(-1, 1);
-	glEnd();
+	float inv_scale = 1.0f / goatvr_get_units_scale();
+	vrovl->SetOverlayWidthInMeters(vrlayer->ovl, layer->width * inv_scale);
+
+	Mat4 xform;
+	calc_matrix(xform, layer->pos * inv_scale, layer->rot);
+	if(layer_shape(layer) == GOATVR_LAYER_CYLINDER && layer->radius > 0.0f) {
+		// overlays are placed by the center of their surface, not the cylinder axis
+		Mat4 offs;
+		offs.translation(0, 0, -layer->radius * inv_scale);
+		xform = offs * xform;
+		vrovl->SetOverlayCurvature(vrlayer->ovl, layer->width / (6.2831853f * layer->radius));
+	} else {
+		vrovl->SetOverlayCurvature(vrlayer->ovl, 0.0f);
+	}
 
-	glPopMatrix();
-	glMatrixMode(GL_MODELVIEW);
-	glPopMatrix();
+	HmdMatrix34_t vrmat;
+	openvr_matrix34(vrmat, xform);
+	if(layer_head_locked(layer)) {
+		vrovl->SetOverlayTransformTrackedDeviceRelative(vrlayer->ovl, k_unTrackedDeviceIndex_Hmd, &vrmat);
+	} else {
+		vrovl->SetOverlayTransformAbsolute(vrlayer->ovl, vrcomp->GetTrackingSpace(), &vrmat);
+	}
 
-	glPopAttrib();
+	if(!vrlayer->shown) {
+		vrovl->ShowOverlay(vrlayer->ovl);
+		vrlayer->shown = true;
+	}
+}
+
+bool ModuleOpenVR::window_is_mirror() const
+{
+	return true;
 }
 
 void ModuleOpenVR::get_view_matrix(Mat4 &mat, int eye) const
@@ -337,10 +538,42 @@ void ModuleOpenVR::get_view_matrix(Mat4 &mat, int eye) const
 	mat = eye_inv_xform[eye];
 }
 
-void ModuleOpenVR::get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar) const
+bool ModuleOpenVR::get_eye_fov(int eye, EyeFov *fov) const
 {
+	if(!vr) return false;
+
 	EVREye openvr_eye = eye == GOATVR_LEFT ? Eye_Left : Eye_Right;
-	openvr_matrix4(mat, vr->GetProjectionMatrix(openvr_eye, znear, zfar));
+	float left, right, top, bottom;
+	vr->GetProjectionRaw(openvr_eye, &left, &right, &top, &bottom);
+
+	/* OpenVR's raw projection is y-down: "top" is the tangent towards -y
+	 * (negative), and "bottom" towards +y.
+	 */
+	fov->left = left;
+	fov->right = right;
+	fov->bottom = top;
+	fov->top = bottom;
+	return true;
+}
+
+bool ModuleOpenVR::get_hidden_area_mesh(int eye, std::vector<Vec2> *tris) const
+{
+	if(!vr) return false;
+
+	EVREye openvr_eye = eye == GOATVR_LEFT ? Eye_Left : Eye_Right;
+	HiddenAreaMesh_t mesh = vr->GetHiddenAreaMesh(openvr_eye, k_eHiddenAreaMesh_Standard);
+	if(!mesh.pVertexData || !mesh.unTriangleCount) {
+		return false;
+	}
+
+	// OpenVR hidden area vertices are in texture space, with the origin at the top-left
+	int nverts = mesh.unTriangleCount * 3;
+	tris->resize(nverts);
+	for(int i=0; i<nverts; i++) {
+		const HmdVector2_t &v = mesh.pVertexData[i];
+		(*tris)[i] = Vec2(v.v[0], 1.0f - v.v[1]);
+	}
+	return true;
 }
 
 Vec3 ModuleOpenVR::get_head_position() const
@@ -376,14 +609,6 @@ void ModuleOpenVR::get_hand_matrix(Mat4 &mat, int idx) const
 }
 
 
-static void openvr_matrix4(Mat4 &res, const HmdMatrix44_t &mat)
-{
-	res = Mat4(mat.m[0][0], mat.m[1][0], mat.m[2][0], mat.m[3][0],
-			mat.m[0][1], mat.m[1][1], mat.m[2][1], mat.m[3][1],
-			mat.m[0][2], mat.m[1][2], mat.m[2][2], mat.m[3][2],
-			mat.m[0][3], mat.m[1][3], mat.m[2][3], mat.m[3][3]);
-}
-
 static void openvr_matrix(Mat4 &res, const HmdMatrix34_t &mat)
 {
 	res = Mat4(mat.m[0][0], mat.m[1][0], mat.m[2][0], 0,
@@ -392,6 +617,15 @@ static void openvr_matrix(Mat4 &res, const HmdMatrix34_t &mat)
 			mat.m[0][3], mat.m[1][3], mat.m[2][3], 1);
 }
 
+static void openvr_matrix34(HmdMatrix34_t &res, const Mat4 &mat)
+{
+	for(int i=0; i<3; i++) {
+		for(int j=0; j<4; j++) {
+			res.m[i][j] = mat[j][i];
+		}
+	}
+}
+
 static VRTextureBounds_t openvr_tex_bounds(float umin, float vmin, float umax, float vmax)
 {
 	VRTextureBounds_t res;
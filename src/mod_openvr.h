@@ -37,6 +37,7 @@ protected:
 	vr::IVRSystem *vr;
 	vr::IVRCompositor *vrcomp;
 	vr::IVRChaperone *vrchap;
+	bool suspended;
 	vr::TrackedDevicePose_t vr_pose[vr::k_unMaxTrackedDeviceCount];
 	Mat4 xform[vr::k_unMaxTrackedDeviceCount];
 	bool xform_valid[vr::k_unMaxTrackedDeviceCount];
@@ -44,6 +45,12 @@ protected:
 
 	Mat4 eye_to_hmd_xform[2];
 	Mat4 eye_xform[2], eye_inv_xform[2];
+	bool latched;	// submit with the late-latched HMD pose
+	vr::TrackedDevicePose_t unlatched_pose;	// HMD pose from before late_latch
+
+	void update_eye_xforms();
+	void update_layer(goatvr_layer *layer);
+	void release_layers();
 
 	int win_width, win_height;	// for the mirror texture
 
@@ -61,8 +68,12 @@ public:
 
 	bool start();
 	void stop();
+	void suspend();
+	void trim();
 
 	void update();
+	bool late_latch();
+	void unlatch();
 
 	void set_origin_mode(goatvr_origin_mode mode);
 	void recenter();
@@ -73,12 +84,18 @@ public:
 
 	void set_fbsize(int width, int height, float fbscale);
 	RenderTexture *get_render_texture();
+	bool set_render_texture(unsigned int tex, int width, int height);
 
 	void draw_done();
 	void draw_mirror();
+	bool window_is_mirror() const;
 
 	void get_view_matrix(Mat4 &mat, int eye) const;
-	void get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar) const;
+	bool get_eye_fov(int eye, EyeFov *fov) const;
+	bool get_hidden_area_mesh(int eye, std::vector<Vec2> *tris) const;
+
+	bool add_layer(goatvr_layer *layer);
+	void remove_layer(goatvr_layer *layer);
 
 	Vec3 get_head_position() const;
 	Quat get_head_orientation() const;
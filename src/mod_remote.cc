@@ -0,0 +1,462 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if defined(__unix__)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/un.h>
+#include "opengl.h"
+#include "mod_remote.h"
+#include "mirror.h"
+
+REG_MODULE(remote, ModuleRemote)
+
+using namespace goatvr;
+
+static int open_socket(const char *fname);
+static const char *socket_path();
+
+ModuleRemote::ModuleRemote()
+{
+	sock = -1;
+	shm_poses = 0;
+	memset(&pose, 0, sizeof pose);
+	pose.head_rot[3] = 1.0f;
+
+	rtex_valid = false;
+	rtex.alpha = true;	// the daemon composites the clients on top of each other
+	win_width = win_height = -1;
+
+	for(int i=0; i<REMOTE_FRAME_SLOTS; i++) {
+		fb_mem[i] = 0;
+		fb_size[i] = 0;
+		fb_busy[i] = false;
+	}
+	frame = 0;
+}
+
+ModuleRemote::~ModuleRemote()
+{
+	destroy();
+}
+
+void ModuleRemote::destroy()
+{
+	stop();
+	Module::destroy();
+}
+
+enum goatvr_module_type ModuleRemote::get_type() const
+{
+	return GOATVR_DISPLAY_MODULE;
+}
+
+const char *ModuleRemote::get_name() const
+{
+	return "remote";
+}
+
+bool ModuleRemote::detect()
+{
+	avail = false;
+
+	// goatvrd sets this, to avoid connecting to itself
+	if(getenv("GOATVR_NO_REMOTE")) {
+		return false;
+	}
+	if(!glcaps.sync) {
+		return false;
+	}
+
+	int s = open_socket(socket_path());
+	if(s == -1) {
+		return false;
+	}
+	close(s);
+
+	print_info("found goatvrd at: %s\n", socket_path());
+	avail = true;
+	return true;
+}
+
+bool ModuleRemote::start()
+{
+	if(sock != -1) return true;	// already started
+
+	if(!connect_daemon()) {
+		return false;
+	}
+
+	// force creation of the render target
+	get_render_texture();
+	return true;
+}
+
+void ModuleRemote::stop()
+{
+	disconnect();
+
+	readback.destroy();
+	rtex.destroy();
+	rtex_valid = false;
+}
+
+void ModuleRemote::update()
+{
+	if(sock == -1) return;
+
+	while(handle_msg(false));
+	read_poses();
+}
+
+bool ModuleRemote::have_headtracking() const
+{
+	return true;
+}
+
+void ModuleRemote::set_fbsize(int width, int height, float fbscale)
+{
+	if(fbscale != rtex.fbscale) {
+		rtex_valid = false;
+	}
+	rtex.fbscale = fbscale;
+	win_width = width;
+	win_height = height;
+}
+
+RenderTexture *ModuleRemote::get_render_texture()
+{
+	if(!rtex_valid && pose.eye_width > 0) {
+		for(int i=0; i<2; i++) {
+			rtex.eye_width[i] = (int)((float)pose.eye_width * rtex.fbscale);
+			rtex.eye_height[i] = (int)((float)pose.eye_height * rtex.fbscale);
+			rtex.eye_yoffs[i] = 0;
+		}
+		rtex.eye_xoffs[0] = 0;
+		rtex.eye_xoffs[1] = rtex.eye_width[0];
+
+		// allocate for the maximum scale, to avoid reallocations when the scale changes
+		float max_scale = goatvr_get_fb_max_scale();
+		int max_fbwidth = (int)((float)pose.eye_width * max_scale) * 2;
+		int max_fbheight = (int)((float)pose.eye_height * max_scale);
+
+		rtex.update(rtex.eye_width[0] + rtex.eye_width[1], rtex.eye_height[0], max_fbwidth, max_fbheight);
+
+		// make sure we have the window size in case the user never called goatvr_set_fb_size
+		if(win_width == -1) {
+			int vp[4];
+			glGetIntegerv(GL_VIEWPORT, vp);
+			win_width = vp[2] + vp[0];
+			win_height = vp[3] + vp[1];
+		}
+		rtex_valid = true;
+	}
+	return &rtex;
+}
+
+bool ModuleRemote::set_render_texture(unsigned int tex, int width, int height)
+{
+	rtex.set_external(tex, width, height);
+	rtex_valid = false;
+	return true;
+}
+
+/* start reading back this frame, and send the ones which made it back to
+ * the CPU since the last call. Frames are dropped while all the readback
+ * buffers are waiting for a free framebuffer slot.
+ */
+void ModuleRemote::draw_done()
+{
+	if(sock == -1 || !rtex.tex) return;
+
+	readback.read(rtex.tex, 0, 0, rtex.width, rtex.height, (long)frame++);
+	send_frames();
+}
+
+void ModuleRemote::draw_mirror()
+{
+	int rect[2][4];
+	for(int i=0; i<2; i++) {
+		rect[i][0] = rtex.eye_xoffs[i];
+		rect[i][1] = rtex.eye_yoffs[i];
+		rect[i][2] = rtex.eye_width[i];
+		rect[i][3] = rtex.eye_height[i];
+	}
+	present_mirror(rtex.tex, rtex.tex_width, rtex.tex_height, rect, false, win_width, win_height);
+}
+
+bool ModuleRemote::window_is_mirror() const
+{
+	return true;
+}
+
+void ModuleRemote::get_view_matrix(Mat4 &mat, int eye) const
+{
+	float units_scale = goatvr_get_units_scale();
+
+	mat = Mat4(pose.view[eye]);
+	for(int i=0; i<3; i++) {
+		mat[3][i] *= units_scale;
+	}
+}
+
+bool ModuleRemote::get_eye_fov(int eye, EyeFov *fov) const
+{
+	if(pose.eye_width <= 0) return false;
+
+	fov->left = pose.fov[eye][0];
+	fov->right = pose.fov[eye][1];
+	fov->bottom = pose.fov[eye][2];
+	fov->top = pose.fov[eye][3];
+	return true;
+}
+
+Vec3 ModuleRemote::get_head_position() const
+{
+	float units_scale = goatvr_get_units_scale();
+	return Vec3(pose.head_pos[0], pose.head_pos[1], pose.head_pos[2]) * units_scale;
+}
+
+Quat ModuleRemote::get_head_orientation() const
+{
+	return Quat(pose.head_rot[0], pose.head_rot[1], pose.head_rot[2], pose.head_rot[3]);
+}
+
+bool ModuleRemote::connect_daemon()
+{
+	const char *path = socket_path();
+	if((sock = open_socket(path)) == -1) {
+		print_error("failed to connect to goatvrd at: %s\n", path);
+		return false;
+	}
+
+	// the daemon sends the pose block as soon as we connect
+	if(!handle_msg(true) || !shm_poses) {
+		print_error("goatvrd handshake failed\n");
+		disconnect();
+		return false;
+	}
+	read_poses();
+	print_info("connected to goatvrd (eye framebuffer: %dx%d)\n", (int)pose.eye_width,
+			(int)pose.eye_height);
+	return true;
+}
+
+void ModuleRemote::disconnect()
+{
+	if(sock != -1) {
+		close(sock);
+		sock = -1;
+	}
+	if(shm_poses) {
+		munmap((void*)shm_poses, sizeof *shm_poses);
+		shm_poses = 0;
+	}
+	for(int i=0; i<REMOTE_FRAME_SLOTS; i++) {
+		if(fb_mem[i]) {
+			munmap(fb_mem[i], fb_size[i]);
+			fb_mem[i] = 0;
+		}
+		fb_size[i] = 0;
+		fb_busy[i] = false;
+	}
+}
+
+// returns false if there are no more messages, or the daemon went away
+bool ModuleRemote::handle_msg(bool wait)
+{
+	if(wait) {
+		struct pollfd pfd = {sock, POLLIN, 0};
+		if(poll(&pfd, 1, 2000) <= 0) {
+			return false;
+		}
+	}
+
+	remote_msg msg;
+	int fd;
+	int res = remote_recv(sock, &msg, &fd);
+	if(res == 1) {
+		return false;
+	}
+	if(res == -1) {
+		print_error("lost connection to goatvrd\n");
+		disconnect();
+		return false;
+	}
+
+	switch(msg.type) {
+	case REMOTE_MSG_HELLO:
+		if(fd == -1) break;
+		if(shm_poses) {
+			munmap((void*)shm_poses, sizeof *shm_poses);
+		}
+		shm_poses = (remote_poses*)mmap(0, sizeof *shm_poses, PROT_READ, MAP_SHARED, fd, 0);
+		if(shm_poses == MAP_FAILED) {
+			print_error("failed to map the goatvrd pose block\n");
+			shm_poses = 0;
+		}
+		break;
+
+	case REMOTE_MSG_RELEASE:
+		if(msg.slot < REMOTE_FRAME_SLOTS) {
+			fb_busy[msg.slot] = false;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	if(fd != -1) {
+		close(fd);
+	}
+	return true;
+}
+
+void ModuleRemote::read_poses()
+{
+	if(!shm_poses) return;
+
+	remote_poses tmp;
+	for(int i=0; i<16; i++) {
+		uint32_t seq = shm_poses->seq;
+		if(seq & 1) continue;	// being updated
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		memcpy(&tmp, (const void*)shm_poses, sizeof tmp);
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if(shm_poses->seq == seq) {
+			if(tmp.eye_width != pose.eye_width || tmp.eye_height != pose.eye_height) {
+				rtex_valid = false;
+			}
+			pose = tmp;
+			return;
+		}
+	}
+}
+
+void ModuleRemote::send_frames()
+{
+	for(;;) {
+		int slot = -1;
+		for(int i=0; i<REMOTE_FRAME_SLOTS; i++) {
+			if(!fb_busy[i]) {
+				slot = i;
+				break;
+			}
+		}
+		if(slot == -1) break;
+
+		int width, height;
+		long id;
+		const void *pixels = readback.map(&width, &height, &id, false);
+		if(!pixels) break;
+
+		int size = width * height * 4;
+		if(size > fb_size[slot]) {
+			// grow the framebuffer slot, and pass the new one to the daemon
+			if(fb_mem[slot]) {
+				munmap(fb_mem[slot], fb_size[slot]);
+				fb_mem[slot] = 0;
+				fb_size[slot] = 0;
+			}
+
+			char name[64];
+			sprintf(name, "/goatvr-remote-%d-%d", (int)getpid(), slot);
+			int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+			if(fd == -1) {
+				print_error("failed to create framebuffer shared memory: %s\n", strerror(errno));
+				readback.unmap();
+				break;
+			}
+			shm_unlink(name);	// only the file descriptors keep it alive
+
+			void *mem = MAP_FAILED;
+			if(ftruncate(fd, size) != -1) {
+				mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			}
+			if(mem == MAP_FAILED) {
+				print_error("failed to map framebuffer shared memory\n");
+				close(fd);
+				readback.unmap();
+				break;
+			}
+			fb_mem[slot] = mem;
+			fb_size[slot] = size;
+
+			remote_msg msg = {REMOTE_MSG_FRAMEBUF, (uint32_t)slot, (uint32_t)width, (uint32_t)height, 0};
+			int res = remote_send(sock, &msg, fd);
+			close(fd);
+			if(res == -1) {
+				readback.unmap();
+				break;
+			}
+		}
+
+		memcpy(fb_mem[slot], pixels, size);
+		readback.unmap();
+
+		remote_msg msg = {REMOTE_MSG_FRAME, (uint32_t)slot, (uint32_t)width, (uint32_t)height, (uint64_t)id};
+		if(remote_send(sock, &msg, -1) == -1) {
+			print_error("failed to send frame to goatvrd\n");
+			break;
+		}
+		fb_busy[slot] = true;
+	}
+}
+
+static int open_socket(const char *fname)
+{
+	int s;
+	struct sockaddr_un addr;
+
+	if((s = socket(AF_UNIX, SOCK_SEQPACKET, 0)) == -1) {
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, fname, sizeof addr.sun_path - 1);
+
+	if(connect(s, (struct sockaddr*)&addr, sizeof addr) == -1) {
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+static const char *socket_path()
+{
+	const char *path = getenv("GOATVR_REMOTE_SOCKET");
+	return path ? path : REMOTE_DEF_SOCKET;
+}
+
+#else
+
+#include "module.h"
+// this expands to an empty register_mod_remote() function
+NOREG_MODULE(remote)
+
+#endif	// __unix__
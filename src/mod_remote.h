@@ -0,0 +1,88 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MOD_REMOTE_H_
+#define MOD_REMOTE_H_
+
+#include "module.h"
+#include "readback.h"
+#include "remote.h"
+
+namespace goatvr {
+
+/* client of the goatvrd compositor daemon (see remote.h). The daemon owns the
+ * actual display module, this one just passes its poses to the application,
+ * and sends the rendered frames back.
+ */
+class ModuleRemote : public Module {
+protected:
+	int sock;
+	const remote_poses *shm_poses;	// mapped read-only, updated by the daemon
+	remote_poses pose;				// last consistent copy of shm_poses
+
+	RenderTexture rtex;
+	bool rtex_valid;
+	int win_width, win_height;	// for the mirror
+
+	Readback readback;
+	void *fb_mem[REMOTE_FRAME_SLOTS];
+	int fb_size[REMOTE_FRAME_SLOTS];
+	bool fb_busy[REMOTE_FRAME_SLOTS];	// sent to the daemon, waiting for release
+	uint64_t frame;
+
+	bool connect_daemon();
+	void disconnect();
+	bool handle_msg(bool wait);
+	void read_poses();
+	void send_frames();
+
+public:
+	ModuleRemote();
+	~ModuleRemote();
+
+	void destroy();
+
+	enum goatvr_module_type get_type() const;
+	const char *get_name() const;
+
+	bool detect();
+
+	bool start();
+	void stop();
+
+	void update();
+
+	bool have_headtracking() const;
+
+	void set_fbsize(int width, int height, float fbscale);
+	RenderTexture *get_render_texture();
+	bool set_render_texture(unsigned int tex, int width, int height);
+
+	void draw_done();
+	void draw_mirror();
+	bool window_is_mirror() const;
+
+	void get_view_matrix(Mat4 &mat, int eye) const;
+	bool get_eye_fov(int eye, EyeFov *fov) const;
+
+	Vec3 get_head_position() const;
+	Quat get_head_orientation() const;
+};
+
+}	// namespace goatvr
+
+#endif	// MOD_REMOTE_H_
@@ -18,6 +18,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "opengl.h"
 #include "mod_sbs.h"
 
+#ifndef GL_DRAW_FRAMEBUFFER_BINDING
+#define GL_DRAW_FRAMEBUFFER_BINDING	0x8ca6
+#define GL_READ_FRAMEBUFFER_BINDING	0x8caa
+#endif
+
 REG_MODULE(sbs, ModuleSBS)
 
 using namespace goatvr;
@@ -26,6 +31,7 @@ ModuleSBS::ModuleSBS()
 {
 	win_width = win_height = -1;
 	ipd = 0.064f;		// default IPD 6.4cm
+	present_fbo = 0;
 }
 
 ModuleSBS::~ModuleSBS()
@@ -74,6 +80,12 @@ bool ModuleSBS::start()
 	return true;
 }
 
+void ModuleSBS::stop()
+{
+	release_present();
+	Module::stop();
+}
+
 void ModuleSBS::set_origin_mode(goatvr_origin_mode mode)
 {
 	origin_mode = mode;
@@ -85,6 +97,99 @@ void ModuleSBS::set_fbsize(int width, int height, float fbscale)
 	win_height = height;
 }
 
+bool ModuleSBS::can_present() const
+{
+	return true;
+}
+
+void ModuleSBS::get_present_params(PresentParams *par) const
+{
+	Module::get_present_params(par);
+	par->win_width = win_width;
+	par->win_height = win_height;
+}
+
+bool ModuleSBS::present(unsigned int tex, const RenderTexture *layout, const PresentParams *par)
+{
+	if(par->win_width <= 0 || par->win_height <= 0) {
+		return false;
+	}
+	int half = par->win_width / 2;
+	int dst[2][4] = {
+		{0, 0, half, par->win_height},
+		{half, 0, half * 2, par->win_height}
+	};
+	return blit_eyes(tex, layout, dst, 0);
+}
+
+void ModuleSBS::release_present()
+{
+	if(present_fbo) {
+		glDeleteFramebuffers(1, &present_fbo);
+		present_fbo = 0;
+	}
+}
+
+/* blit each eye of tex to the dst rectangle (x0, y0, x1, y1) of the window,
+ * and to drawbuf[eye] if drawbuf is not null
+ */
+bool ModuleSBS::blit_eyes(unsigned int tex, const RenderTexture *layout, const int (*dst)[4],
+		const unsigned int *drawbuf)
+{
+	if(!tex) {
+		return false;
+	}
+	// multisampled windows can't be blit destinations
+	int msaa = 0;
+	glGetIntegerv(GL_SAMPLE_BUFFERS, &msaa);
+	if(msaa) {
+		return false;
+	}
+
+	if(!present_fbo) {
+		glGenFramebuffers(1, &present_fbo);
+	}
+
+	int prev_draw_fb, prev_read_fb;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_draw_fb);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_read_fb);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, present_fbo);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+	// the window's draw buffer selection, to put back after the blits
+	int prev_drawbuf = GL_BACK;
+	if(drawbuf) {
+		glGetIntegerv(GL_DRAW_BUFFER, &prev_drawbuf);
+	}
+
+	bool scissor = glIsEnabled(GL_SCISSOR_TEST);
+	bool srgb = glIsEnabled(GL_FRAMEBUFFER_SRGB);
+	if(scissor) glDisable(GL_SCISSOR_TEST);
+	if(srgb) glDisable(GL_FRAMEBUFFER_SRGB);
+
+	for(int i=0; i<2; i++) {
+		int x = layout->eye_xoffs[i];
+		int y = layout->eye_yoffs[i];
+		if(drawbuf) {
+			glDrawBuffer(drawbuf[i]);
+		}
+		glBlitFramebuffer(x, y, x + layout->eye_width[i], y + layout->eye_height[i],
+				dst[i][0], dst[i][1], dst[i][2], dst[i][3], GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	}
+	if(drawbuf) {
+		glDrawBuffer(prev_drawbuf);
+	}
+
+	if(scissor) glEnable(GL_SCISSOR_TEST);
+	if(srgb) glEnable(GL_FRAMEBUFFER_SRGB);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prev_draw_fb);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_read_fb);
+	return true;
+}
+
 void ModuleSBS::get_view_matrix(Mat4 &mat, int eye) const
 {
 	float eye_offs[] = {0.5f * ipd, -0.5f * ipd};
@@ -98,16 +203,20 @@ void ModuleSBS::get_view_matrix(Mat4 &mat, int eye) const
 	}
 }
 
-void ModuleSBS::get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar) const
+bool ModuleSBS::get_eye_fov(int eye, EyeFov *fov) const
 {
 	// TODO let the user set the fov
 	float vfov = deg_to_rad(60);
 	float aspect = (float)win_width / (float)win_height;
-	float top = znear * tan(vfov * 0.5);
+	float top = tan(vfov * 0.5);
 	float right = top * aspect;
 
 	static const float offs[] = {1.0, -1.0};
-	float shift = offs[eye] * (ipd * 0.5 * znear /* / focus_dist? */);
+	float shift = offs[eye] * (ipd * 0.5 /* / focus_dist? */);
 
-	mat.frustum(-right + shift, right + shift, -top, top, znear, zfar);
+	fov->left = -right + shift;
+	fov->right = right + shift;
+	fov->bottom = -top;
+	fov->top = top;
+	return true;
 }
@@ -31,6 +31,11 @@ protected:
 
 	goatvr_origin_mode origin_mode;
 
+	unsigned int present_fbo;
+
+	bool blit_eyes(unsigned int tex, const RenderTexture *layout, const int (*dst)[4],
+			const unsigned int *drawbuf);
+
 public:
 	ModuleSBS();
 	~ModuleSBS();
@@ -43,13 +48,20 @@ public:
 
 	bool detect();
 	bool start();
+	void stop();
 
 	void set_origin_mode(goatvr_origin_mode mode);
 
 	void set_fbsize(int width, int height, float fbscale);
 
+	// present another module's eye buffers side by side (as an output module)
+	bool can_present() const;
+	void get_present_params(PresentParams *par) const;
+	bool present(unsigned int tex, const RenderTexture *layout, const PresentParams *par);
+	void release_present();
+
 	void get_view_matrix(Mat4 &mat, int eye) const;
-	void get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar) const;
+	bool get_eye_fov(int eye, EyeFov *fov) const;
 };
 
 }	// namespace goatvr
@@ -59,3 +59,22 @@ void ModuleStereo::draw_done()
 {
 	glDrawBuffer(GL_BACK);	// reset to both buffers again
 }
+
+bool ModuleStereo::present(unsigned int tex, const RenderTexture *layout, const PresentParams *par)
+{
+	static const unsigned int drawbuf[] = {GL_BACK_LEFT, GL_BACK_RIGHT};
+	if(par->win_width <= 0 || par->win_height <= 0) {
+		return false;
+	}
+	// without a quad-buffered window the right back buffer doesn't exist
+	GLboolean stereo;
+	glGetBooleanv(GL_STEREO, &stereo);
+	if(!stereo) {
+		return false;
+	}
+	int dst[2][4] = {
+		{0, 0, par->win_width, par->win_height},
+		{0, 0, par->win_width, par->win_height}
+	};
+	return blit_eyes(tex, layout, dst, drawbuf);
+}
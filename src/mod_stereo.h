@@ -34,6 +34,9 @@ public:
 	void draw_start();
 	void draw_eye(int eye);
 	void draw_done();
+
+	// present another module's eye buffers to the left and right back buffers
+	bool present(unsigned int tex, const RenderTexture *layout, const PresentParams *par);
 };
 
 } // namespace goatvr
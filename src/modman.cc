@@ -26,6 +26,7 @@ static struct {
 	const char *name;
 	int prio;
 } modprio[] = {
+	{ "remote", 129 },
 	{ "oculus", 128 },
 	{ "openvr", 127 },
 	{ "oculus_old", 126 },
@@ -33,6 +34,7 @@ static struct {
 	{ "stereo", 64 },
 	{ "anaglyph", 63},
 	{ "sbs", 62},
+	{ "3dtv", 61},
 	{0, 0}
 };
 
@@ -42,15 +44,20 @@ Module *display_module;
 
 static std::vector<Module*> modules;
 static std::set<Module*> active;
+static std::vector<Module*> outputs;	// secondary display modules, see activate_output
+static std::set<Module*> suspended;	// suspended modules still holding resources
 static int num_avail;
 
 void destroy_modules()
 {
+	trim();
+
 	for(size_t i=0; i<modules.size(); i++) {
 		delete modules[i];
 	}
 	modules.clear();
 	active.clear();
+	outputs.clear();
 	num_avail = 0;
 	display_module = 0;
 }
@@ -116,6 +123,8 @@ void activate(Module *m)
 		if(display_module) {
 			deactivate(display_module);
 		}
+		// and it can't be an output at the same time
+		deactivate_output(m);
 		display_module = m;
 	}
 	active.insert(m);
@@ -123,21 +132,70 @@ void activate(Module *m)
 
 void deactivate(Module *m)
 {
-	if(m->get_type() == GOATVR_DISPLAY_MODULE) {
+	if(suspended.erase(m)) {
+		m->trim();
+	}
+	if(m == display_module) {
 		display_module = 0;
 	}
 	active.erase(m);
 }
 
+bool activate_output(Module *m)
+{
+	if(m->get_type() != GOATVR_DISPLAY_MODULE || m == display_module || !m->can_present()) {
+		return false;
+	}
+	if(std::find(outputs.begin(), outputs.end(), m) == outputs.end()) {
+		outputs.push_back(m);
+	}
+	return true;
+}
+
+void deactivate_output(Module *m)
+{
+	std::vector<Module*>::iterator it = std::find(outputs.begin(), outputs.end(), m);
+	if(it != outputs.end()) {
+		if(suspended.erase(m)) {
+			m->trim();
+		}
+		outputs.erase(it);
+	}
+}
+
+int get_num_outputs()
+{
+	return (int)outputs.size();
+}
+
+Module *get_output(int idx)
+{
+	return outputs[idx];
+}
+
 bool start()
 {
 	for(Module *m : active) {
+		suspended.erase(m);
 		if(!m->start() && m->get_type() == GOATVR_DISPLAY_MODULE) {
 			display_module = 0;	// TODO fallback to the next available display module?
 			return false;
 		}
 		inp_add_module(m);
 	}
+
+	// outputs failing to start are dropped, without failing the whole thing
+	size_t i = 0;
+	while(i < outputs.size()) {
+		Module *m = outputs[i];
+		suspended.erase(m);
+		if(!m->start()) {
+			m->print_error("failed to start as an output, deactivating\n");
+			outputs.erase(outputs.begin() + i);
+			continue;
+		}
+		i++;
+	}
 	return true;
 }
 
@@ -147,6 +205,31 @@ void stop()
 		inp_remove_module(m);
 		m->stop();
 	}
+	for(Module *m : outputs) {
+		m->stop();
+	}
+	trim();	// in case we were suspended, nothing should be left behind
+}
+
+void suspend()
+{
+	for(Module *m : active) {
+		inp_remove_module(m);
+		m->suspend();
+		suspended.insert(m);
+	}
+	for(Module *m : outputs) {
+		m->suspend();
+		suspended.insert(m);
+	}
+}
+
+void trim()
+{
+	for(Module *m : suspended) {
+		m->trim();
+	}
+	suspended.clear();
 }
 
 void update()
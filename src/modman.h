@@ -39,9 +39,22 @@ void detect();
 void activate(Module *m);
 void deactivate(Module *m);
 
+/* secondary display modules, presenting the eye buffers of display_module
+ * with Module::present, instead of rendering the scene themselves. Only
+ * modules which can_present, other than display_module, can be outputs.
+ * They're started and stopped along with the active modules.
+ */
+bool activate_output(Module *m);
+void deactivate_output(Module *m);
+int get_num_outputs();
+Module *get_output(int idx);
+
 // vr operations to be performed on all active modules
 bool start();
 void stop();
+void suspend();
+// release resources kept alive by suspended modules
+void trim();
 void update();
 
 // operations to be performed on the active rendering module
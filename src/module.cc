@@ -85,10 +85,28 @@ void Module::stop()
 {
 }
 
+void Module::suspend()
+{
+	stop();
+}
+
+void Module::trim()
+{
+}
+
 void Module::update()
 {
 }
 
+bool Module::late_latch()
+{
+	return false;
+}
+
+void Module::unlatch()
+{
+}
+
 void Module::set_origin_mode(goatvr_origin_mode mode)
 {
 }
@@ -166,6 +184,11 @@ RenderTexture *Module::get_render_texture()
 	return 0;
 }
 
+bool Module::set_render_texture(unsigned int tex, int width, int height)
+{
+	return false;
+}
+
 void Module::draw_start()
 {
 }
@@ -187,14 +210,64 @@ bool Module::should_swap() const
 	return true;
 }
 
+bool Module::window_is_mirror() const
+{
+	return false;
+}
+
+bool Module::can_present() const
+{
+	return false;
+}
+
+void Module::get_present_params(PresentParams *par) const
+{
+	par->win_width = par->win_height = -1;
+	par->mode = 0;
+	par->swap_eyes = false;
+}
+
+bool Module::present(unsigned int tex, const RenderTexture *layout, const PresentParams *par)
+{
+	return false;
+}
+
+void Module::release_present()
+{
+}
+
 void Module::get_view_matrix(Mat4 &mat, int eye) const
 {
 	mat = Mat4::identity;
 }
 
-void Module::get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar) const
+void Module::get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar, unsigned int flags) const
+{
+	EyeFov fov;
+	if(!get_eye_fov(eye, &fov)) {
+		mat = Mat4::identity;
+		return;
+	}
+	calc_proj_matrix(mat, fov, znear, zfar, flags);
+}
+
+bool Module::get_eye_fov(int eye, EyeFov *fov) const
+{
+	return false;
+}
+
+bool Module::get_hidden_area_mesh(int eye, std::vector<Vec2> *tris) const
+{
+	return false;
+}
+
+bool Module::add_layer(goatvr_layer *layer)
+{
+	return false;
+}
+
+void Module::remove_layer(goatvr_layer *layer)
 {
-	mat = Mat4::identity;
 }
 
 Vec3 Module::get_head_position() const
@@ -38,6 +38,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 namespace goatvr {
 
+/* module state Module::present draws with. The compositor takes a copy of it
+ * along with every frame, on the application thread, so that the module can
+ * keep changing it while the compositor thread presents.
+ */
+struct PresentParams {
+	int win_width, win_height;
+	int mode;		// module-specific presentation mode
+	bool swap_eyes;
+};
+
 class Module {
 protected:
 	int prio;
@@ -65,8 +75,24 @@ public:
 
 	virtual bool start();
 	virtual void stop();
+	/* suspend is like stop, but keeps GPU resources and runtime sessions alive
+	 * where possible, to make the next start cheap. trim releases anything kept
+	 * alive by a previous suspend. By default suspend just calls stop.
+	 */
+	virtual void suspend();
+	virtual void trim();
 
 	virtual void update();
+	/* refresh the eye poses with the latest prediction for the frame being
+	 * drawn, right before it's submitted. Modules returning true must submit
+	 * the frame with the refreshed poses. Returns false if not supported.
+	 */
+	virtual bool late_latch();
+	/* called after a successful late_latch, if the GPU turned out to have
+	 * drawn the frame with the poses from before it. Restores those, to submit
+	 * the frame with the poses it was actually drawn with.
+	 */
+	virtual void unlatch();
 
 	virtual void set_origin_mode(goatvr_origin_mode mode);
 	virtual void recenter();
@@ -90,6 +116,11 @@ public:
 	// rendering ops are only valid on rendering modules
 	virtual void set_fbsize(int width, int height, float fbscale);
 	virtual RenderTexture *get_render_texture();
+	/* render and submit directly from an application-provided texture. Returns
+	 * false if the module can't submit arbitrary textures. tex 0 reverts to the
+	 * module's own render texture.
+	 */
+	virtual bool set_render_texture(unsigned int tex, int width, int height);
 
 	virtual void draw_start();
 	virtual void draw_eye(int eye);
@@ -98,9 +129,43 @@ public:
 
 	// should the user do buffer-swaps on their window?
 	virtual bool should_swap() const;
+	/* is the window just a mirror of the HMD (which can be updated at a lower
+	 * rate), rather than the display itself? Default false.
+	 */
+	virtual bool window_is_mirror() const;
+
+	/* asynchronous presentation from the compositor thread (see compositor.h),
+	 * instead of draw_mirror and draw_done. present draws a frame, laid out
+	 * like get_render_texture but in tex, to the window. It's called with the
+	 * compositor context current, so any framebuffers or vertex arrays it
+	 * needs (which are not shared between contexts) must be created there, and
+	 * freed by release_present, which is called in whichever context is about
+	 * to lose them. get_present_params is called on the application thread,
+	 * and the result passed to present. The default can_present returns false.
+	 */
+	virtual bool can_present() const;
+	virtual void get_present_params(PresentParams *par) const;
+	virtual bool present(unsigned int tex, const RenderTexture *layout, const PresentParams *par);
+	virtual void release_present();
 
 	virtual void get_view_matrix(Mat4 &mat, int eye) const;
-	virtual void get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar) const;
+	/* the default get_proj_matrix builds the projection out of get_eye_fov,
+	 * honoring the GOATVR_PROJ_* flags.
+	 */
+	virtual void get_proj_matrix(Mat4 &mat, int eye, float znear, float zfar, unsigned int flags) const;
+	virtual bool get_eye_fov(int eye, EyeFov *fov) const;
+	/* triangles covering the parts of the eye viewport which are not visible
+	 * through the lenses, in [0, 1] viewport coordinates with the origin at the
+	 * bottom-left. Returns false if the whole viewport is visible (default).
+	 */
+	virtual bool get_hidden_area_mesh(int eye, std::vector<Vec2> *tris) const;
+
+	/* present an overlay layer natively, keeping any data in layer->mod_data.
+	 * The module reads the layer state (see get_layers) every frame it submits.
+	 * Returns false (default) if it can't, to have goatvr composite it instead.
+	 */
+	virtual bool add_layer(goatvr_layer *layer);
+	virtual void remove_layer(goatvr_layer *layer);
 
 	/* valid if have_head_tracking() */
 	virtual Vec3 get_head_position() const;
@@ -0,0 +1,319 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "opengl.h"
+#include "modman.h"
+#include "render.h"
+#include "jitter.h"
+#include "farlayer.h"
+#include "multires.h"
+
+using namespace goatvr;
+
+/* multi-resolution eye buffers: a 3x3 grid of tiles for each eye, with the
+ * center tile at full pixel density and the rest at mr_scale, all packed in
+ * mr_tex and stretched back to the VR framebuffer by goatvr_draw_done. Each
+ * tile is drawn with a border of MULTIRES_GUTTER pixels of the scene beyond
+ * its edges, for the linear filtering of the stretch to sample from, instead
+ * of the neighbouring tiles.
+ */
+#define MULTIRES_GUTTER	1
+struct MultiresTile {
+	int vp[4];	// viewport the tile is drawn at, src and the gutters around it
+	int src[4];	// x, y, width, height in the packed framebuffer
+	int dst[4];	// x, y, width, height in the VR framebuffer
+	EyeFov fov;	// frustum of vp
+};
+static float mr_center, mr_scale = 0.5f;	// mr_center 0 disables multires
+bool goatvr::mr_active;
+static unsigned int mr_fbo, mr_tex, mr_zbuf;
+static int mr_width, mr_height;
+static int mr_zfmt = -1;	// zfmt index of mr_zbuf
+bool goatvr::mr_zblit;
+static MultiresTile mr_tiles[2][GOATVR_NUM_TILES];
+
+/* split an eye extent of size pixels, spanning tangents t0 to t1, in three
+ * spans with the center one covering mr_center of it. pix receives the 4 span
+ * boundaries in pixels, tan the corresponding tangents, and packed the size
+ * of each span in the packed framebuffer.
+ */
+static void calc_tile_spans(int *pix, float *tan, int *packed, int size, float t0, float t1)
+{
+	pix[0] = 0;
+	pix[1] = (int)(size * (1.0f - mr_center) * 0.5f + 0.5f);
+	pix[2] = size - pix[1];
+	pix[3] = size;
+
+	for(int i=0; i<4; i++) {
+		tan[i] = t0 + (t1 - t0) * (float)pix[i] / (float)size;
+	}
+	for(int i=0; i<3; i++) {
+		int span = pix[i + 1] - pix[i];
+		if(i == 1 || span <= 0) {
+			packed[i] = span;
+		} else {
+			packed[i] = std::max((int)(span * mr_scale + 0.5f), 1);
+		}
+	}
+}
+
+static bool update_multires()
+{
+	RenderTexture *rtex = display_module->get_render_texture();
+	if(!rtex) {
+		return false;	// nothing to stitch the tiles into
+	}
+
+	// lay out the tiles of both eyes side by side in the packed framebuffer
+	int width = 0, height = 0;
+	for(int i=0; i<2; i++) {
+		if(rtex->eye_width[i] <= 0 || rtex->eye_height[i] <= 0) {
+			return false;
+		}
+		EyeFov fov;
+		if(!display_module->get_eye_fov(i, &fov)) {
+			Mat4 proj;
+			display_module->get_proj_matrix(proj, i, clip_near, clip_far, 0);
+			calc_eye_fov(&fov, proj);
+		}
+
+		int xpix[4], ypix[4], xsz[3], ysz[3];
+		float xtan[4], ytan[4];
+		calc_tile_spans(xpix, xtan, xsz, rtex->eye_width[i], fov.left, fov.right);
+		calc_tile_spans(ypix, ytan, ysz, rtex->eye_height[i], fov.bottom, fov.top);
+
+		// gutters only around the spans which aren't empty
+		int xgut[3], ygut[3];
+		for(int j=0; j<3; j++) {
+			xgut[j] = xsz[j] > 0 ? MULTIRES_GUTTER : 0;
+			ygut[j] = ysz[j] > 0 ? MULTIRES_GUTTER : 0;
+		}
+
+		int y = 0;
+		for(int row=0; row<3; row++) {
+			int x = width;
+			// tangent span of one pixel of the tile, to extend the frustum over the gutters
+			float dy = ysz[row] > 0 ? (ytan[row + 1] - ytan[row]) / ysz[row] : 0.0f;
+
+			for(int col=0; col<3; col++) {
+				float dx = xsz[col] > 0 ? (xtan[col + 1] - xtan[col]) / xsz[col] : 0.0f;
+
+				MultiresTile *tile = mr_tiles[i] + row * 3 + col;
+				tile->vp[0] = x;
+				tile->vp[1] = y;
+				tile->vp[2] = xsz[col] + 2 * xgut[col];
+				tile->vp[3] = ysz[row] + 2 * ygut[row];
+				tile->src[0] = x + xgut[col];
+				tile->src[1] = y + ygut[row];
+				tile->src[2] = xsz[col];
+				tile->src[3] = ysz[row];
+				tile->dst[0] = rtex->eye_xoffs[i] + xpix[col];
+				tile->dst[1] = rtex->eye_yoffs[i] + ypix[row];
+				tile->dst[2] = xpix[col + 1] - xpix[col];
+				tile->dst[3] = ypix[row + 1] - ypix[row];
+				tile->fov.left = xtan[col] - xgut[col] * dx;
+				tile->fov.right = xtan[col + 1] + xgut[col] * dx;
+				tile->fov.bottom = ytan[row] - ygut[row] * dy;
+				tile->fov.top = ytan[row + 1] + ygut[row] * dy;
+				x += tile->vp[2];
+			}
+			y += ysz[row] + 2 * ygut[row];
+		}
+		for(int j=0; j<3; j++) {
+			width += xsz[j] + 2 * xgut[j];
+		}
+		height = std::max(height, y);
+	}
+
+	/* allocate the depth buffer in the format of the VR framebuffer, so that it
+	 * can be blitted there for the far layer composite
+	 */
+	int zf = vr_depth_format();
+	mr_zblit = zf >= 0;
+	if(zf < 0) zf = (int)depth_fmt;
+
+	if(mr_fbo && width == mr_width && height == mr_height && zf == mr_zfmt) {
+		return true;
+	}
+	mr_width = width;
+	mr_height = height;
+	mr_zfmt = zf;
+
+	if(!mr_fbo) {
+		glGenFramebuffers(1, &mr_fbo);
+		glGenTextures(1, &mr_tex);
+		glGenRenderbuffers(1, &mr_zbuf);
+
+		glBindTexture(GL_TEXTURE_2D, mr_tex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	printf("goatvr: creating %dx%d multi-resolution framebuffer\n", mr_width, mr_height);
+
+	glBindTexture(GL_TEXTURE_2D, mr_tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, mr_width, mr_height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, mr_zbuf);
+	glRenderbufferStorage(GL_RENDERBUFFER, zfmt[mr_zfmt].ifmt, mr_width, mr_height);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mr_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mr_tex, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mr_zbuf);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+			zfmt[mr_zfmt].stencil ? mr_zbuf : 0);
+
+	GLenum fbst = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if(fbst != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "goatvr: incomplete multi-resolution framebuffer! (status: %x)\n", (unsigned int)fbst);
+		destroy_multires();
+		return false;
+	}
+	return true;
+}
+
+void goatvr::destroy_multires()
+{
+	if(mr_fbo) {
+		glDeleteFramebuffers(1, &mr_fbo);
+		glDeleteTextures(1, &mr_tex);
+		glDeleteRenderbuffers(1, &mr_zbuf);
+		mr_fbo = mr_tex = mr_zbuf = 0;
+	}
+	mr_width = mr_height = 0;
+	mr_zfmt = -1;
+	mr_active = false;
+}
+
+/* stretch each tile to its place in the VR framebuffer. The center tiles are
+ * at full density, and copied 1:1. The periphery is magnified with linear
+ * filtering, which samples up to half a pixel past the edges of each tile,
+ * into its gutters.
+ */
+static void stitch_multires()
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, mr_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, vr_fbo());
+
+	for(int i=0; i<2; i++) {
+		for(int j=0; j<GOATVR_NUM_TILES; j++) {
+			const int *src = mr_tiles[i][j].src;
+			const int *dst = mr_tiles[i][j].dst;
+			if(src[2] <= 0 || src[3] <= 0) continue;
+
+			int sx1 = src[0] + src[2];
+			int sy1 = src[1] + src[3];
+			int dx1 = dst[0] + dst[2];
+			int dy1 = dst[1] + dst[3];
+
+			glBlitFramebuffer(src[0], src[1], sx1, sy1, dst[0], dst[1], dx1, dy1,
+					GL_COLOR_BUFFER_BIT, j == GOATVR_CENTER_TILE ? GL_NEAREST : GL_LINEAR);
+			if(far_drawn && mr_zblit) {
+				// the far layer composite needs the depth of the near-field
+				glBlitFramebuffer(src[0], src[1], sx1, sy1, dst[0], dst[1], dx1, dy1,
+						GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			}
+		}
+	}
+}
+
+bool goatvr::multires_draw_start()
+{
+	mr_active = mr_center > 0.0f && update_multires();
+	if(mr_active) {
+		glBindFramebuffer(GL_FRAMEBUFFER, mr_fbo);
+		glViewport(0, 0, mr_width, mr_height);
+	}
+	return mr_active;
+}
+
+void goatvr::multires_draw_done()
+{
+	if(mr_active) {
+		stitch_multires();
+		mr_active = false;
+	}
+}
+
+extern "C" {
+
+int goatvr_set_multires(float center, float periph_scale)
+{
+	if(center < 0.0f || center > 1.0f || periph_scale <= 0.0f || periph_scale > 1.0f) {
+		return -1;
+	}
+	if(center > 0.0f && glcaps.version < 30) {
+		fprintf(stderr, "goatvr: can't enable multi-resolution rendering, needs OpenGL 3.0\n");
+		return -1;
+	}
+	mr_center = center;
+	mr_scale = periph_scale;
+	if(mr_center <= 0.0f) {
+		destroy_multires();
+	} else if(goatvr_get_multiview() || goatvr_get_hidden_area() || goatvr_get_reprojection()) {
+		fprintf(stderr, "goatvr: multiview, hidden area masking, and stereo reprojection are"
+				" not used together with multi-resolution rendering\n");
+	}
+	return 0;
+}
+
+int goatvr_get_multires(float *center, float *periph_scale)
+{
+	if(center) *center = mr_center;
+	if(periph_scale) *periph_scale = mr_scale;
+	return mr_center > 0.0f ? 1 : 0;
+}
+
+int goatvr_draw_tile(int eye, int tile)
+{
+	if(!mr_active || eye < 0 || eye > 1 || tile < 0 || tile >= GOATVR_NUM_TILES) {
+		return -1;
+	}
+
+	if(far_bound) {
+		glBindFramebuffer(GL_FRAMEBUFFER, mr_fbo);
+		far_bound = false;
+	}
+	const int *vp = mr_tiles[eye][tile].vp;
+	glViewport(vp[0], vp[1], vp[2], vp[3]);
+	return 0;
+}
+
+void goatvr_get_tile_viewport(int eye, int tile, int *vp)
+{
+	if(eye < 0 || eye > 1 || tile < 0 || tile >= GOATVR_NUM_TILES) {
+		return;
+	}
+	memcpy(vp, mr_tiles[eye][tile].vp, sizeof mr_tiles[eye][tile].vp);
+}
+
+float *goatvr_tile_projection_matrix(int eye, int tile, float znear, float zfar)
+{
+	static Mat4 pmat;
+	if(eye < 0 || eye > 1 || tile < 0 || tile >= GOATVR_NUM_TILES) {
+		return ident_mat;
+	}
+	const MultiresTile *t = mr_tiles[eye] + tile;
+	calc_proj_matrix(pmat, t->fov, znear, zfar, proj_flags);
+	jitter_proj(pmat, t->vp[2], t->vp[3]);
+	return pmat[0];
+}
+
+}	// extern "C"
@@ -0,0 +1,42 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MULTIRES_H_
+#define MULTIRES_H_
+
+/* multi-resolution eye buffers (see goatvr_set_multires): a 3x3 grid of tiles
+ * for each eye, packed in one framebuffer, and stretched back to the VR
+ * framebuffer by goatvr_draw_done.
+ */
+
+namespace goatvr {
+
+extern bool mr_active;	// goatvr_draw_start bound the packed framebuffer
+extern bool mr_zblit;	// its depth buffer can be blitted to the VR framebuffer
+
+void destroy_multires();
+
+/* bind the packed framebuffer if multires is enabled, and return true if it
+ * did. Called by goatvr_draw_start.
+ */
+bool multires_draw_start();
+// stitch the tiles into the VR framebuffer. Called by goatvr_draw_done.
+void multires_draw_done();
+
+}	// namespace goatvr
+
+#endif	/* MULTIRES_H_ */
@@ -0,0 +1,209 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <algorithm>
+#include "opengl.h"
+#include "modman.h"
+#include "render.h"
+#include "farlayer.h"
+#include "multires.h"
+#include "upscale.h"
+#include "multiview.h"
+
+using namespace goatvr;
+
+static bool multiview;
+static bool mv_drawn;	// goatvr_draw_both_eyes was called this frame
+static unsigned int mv_fbo, mv_copy_fbo;
+static unsigned int mv_tex, mv_ztex;
+static int mv_width, mv_height;
+static int mv_zfmt = -1;	// zfmt index of mv_ztex
+static bool mv_zblit;	// mv_ztex can be blitted to the framebuffer the eyes are copied to
+
+static bool update_multiview()
+{
+	RenderTexture *rtex = display_module->get_render_texture();
+	if(!rtex) {
+		return false;	// no render texture to copy the layers into
+	}
+
+	int rect[2][4];
+	get_eye_rect(0, rect[0]);
+	get_eye_rect(1, rect[1]);
+	int width = std::max(rect[0][2], rect[1][2]);
+	int height = std::max(rect[0][3], rect[1][3]);
+
+	/* allocate the depth texture in the format of the framebuffer the layers
+	 * are copied to, so that it can be blitted there for the far layer composite
+	 */
+	int zf = ups_active ? ups_zfmt : vr_depth_format();
+	mv_zblit = zf >= 0;
+	if(zf < 0) zf = (int)depth_fmt;
+
+	if(mv_fbo && width == mv_width && height == mv_height && zf == mv_zfmt) {
+		return true;
+	}
+	mv_width = width;
+	mv_height = height;
+	mv_zfmt = zf;
+
+	if(!mv_fbo) {
+		glGenFramebuffers(1, &mv_fbo);
+		glGenFramebuffers(1, &mv_copy_fbo);
+		glGenTextures(1, &mv_tex);
+		glGenTextures(1, &mv_ztex);
+
+		unsigned int tex[] = {mv_tex, mv_ztex};
+		for(int i=0; i<2; i++) {
+			glBindTexture(GL_TEXTURE_2D_ARRAY, tex[i]);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		}
+	}
+
+	// multiview needs layered attachments for depth as well, renderbuffers won't do
+	int fidx = mv_zfmt;
+	glBindTexture(GL_TEXTURE_2D_ARRAY, mv_tex);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_SRGB8, mv_width, mv_height, 2, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, mv_ztex);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, zfmt[fidx].ifmt, mv_width, mv_height, 2, 0,
+			zfmt[fidx].fmt, zfmt[fidx].type, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mv_fbo);
+	glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mv_tex, 0, 0, 2);
+	glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mv_ztex, 0, 0, 2);
+	glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT,
+			zfmt[fidx].stencil ? mv_ztex : 0, 0, 0, 2);
+
+	GLenum fbst = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if(fbst != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "goatvr: incomplete multiview framebuffer! (status: %x)\n", (unsigned int)fbst);
+		destroy_multiview();
+		return false;
+	}
+	return true;
+}
+
+void goatvr::destroy_multiview()
+{
+	if(mv_fbo) {
+		glDeleteFramebuffers(1, &mv_fbo);
+		glDeleteFramebuffers(1, &mv_copy_fbo);
+		glDeleteTextures(1, &mv_tex);
+		glDeleteTextures(1, &mv_ztex);
+		mv_fbo = mv_copy_fbo = 0;
+		mv_tex = mv_ztex = 0;
+	}
+	mv_width = mv_height = 0;
+	mv_zfmt = -1;
+}
+
+/* None of the VR runtimes we support can take a GL texture array for
+ * submission, so copy each layer to its place in the module's render texture,
+ * which is attached to the regular VR framebuffer by update_fbo.
+ */
+static void copy_multiview()
+{
+	RenderTexture *rtex = display_module->get_render_texture();
+	if(!rtex) return;
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, mv_copy_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, render_fbo());
+
+	for(int i=0; i<2; i++) {
+		int rect[4];
+		get_eye_rect(i, rect);
+		int x = rect[0];
+		int y = rect[1];
+		int w = rect[2];
+		int h = rect[3];
+
+		unsigned int mask = GL_COLOR_BUFFER_BIT;
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mv_tex, 0, i);
+		if(far_drawn && mv_zblit) {
+			// the far layer composite needs the depth of the near-field
+			glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mv_ztex, 0, i);
+			glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_STENCIL_ATTACHMENT,
+					zfmt[mv_zfmt].stencil ? mv_ztex : 0, 0, i);
+			mask |= GL_DEPTH_BUFFER_BIT;
+		}
+		glBlitFramebuffer(0, 0, w, h, x, y, x + w, y + h, mask, GL_NEAREST);
+	}
+}
+
+bool goatvr::multiview_zblit()
+{
+	if(!display_module || !multiview || mr_active || !update_multiview()) {
+		return true;	// goatvr_draw_both_eyes won't be used
+	}
+	return mv_zblit;
+}
+
+void goatvr::multiview_draw_start()
+{
+	mv_drawn = false;
+}
+
+void goatvr::multiview_draw_done()
+{
+	if(mv_drawn) {
+		copy_multiview();
+		mv_drawn = false;
+	}
+}
+
+extern "C" {
+
+int goatvr_set_multiview(int enable)
+{
+	if(enable && !glcaps.multiview) {
+		fprintf(stderr, "goatvr: can't enable multiview rendering, GL_OVR_multiview2 not available\n");
+		return -1;
+	}
+	multiview = enable != 0;
+	if(!multiview) {
+		destroy_multiview();
+	}
+	return 0;
+}
+
+int goatvr_get_multiview(void)
+{
+	return multiview ? 1 : 0;
+}
+
+unsigned int goatvr_get_multiview_texture(void)
+{
+	return multiview && update_multiview() ? mv_tex : 0;
+}
+
+int goatvr_draw_both_eyes(void)
+{
+	if(!display_module || !multiview || mr_active || !update_multiview()) {
+		return -1;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mv_fbo);
+	glViewport(0, 0, mv_width, mv_height);
+	mv_drawn = true;
+	far_bound = false;
+	return 0;
+}
+
+}	// extern "C"
@@ -0,0 +1,41 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MULTIVIEW_H_
+#define MULTIVIEW_H_
+
+/* layered render target for single-pass stereo with OVR_multiview2 (see
+ * goatvr_set_multiview). Each layer is copied to the module's render texture
+ * by goatvr_draw_done.
+ */
+
+namespace goatvr {
+
+void destroy_multiview();
+
+/* false if goatvr_draw_both_eyes is available, but the multiview depth buffer
+ * can't be blitted to the framebuffer the layers are copied to.
+ */
+bool multiview_zblit();
+
+// called by goatvr_draw_start and goatvr_draw_done
+void multiview_draw_start();
+void multiview_draw_done();
+
+}	// namespace goatvr
+
+#endif	/* MULTIVIEW_H_ */
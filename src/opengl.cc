@@ -16,17 +16,55 @@ You should have received a copy of the GNU Lesser General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "opengl.h"
 
-#ifndef __APPLE__
 typedef int (*glfunc_type)();
 static glfunc_type load_glext(const char *name);
-#endif
 
 namespace goatvr {
 
+#ifndef GL_VERSION_1_2
+GLTexImage3DFunc glTexImage3D;
+#endif
+
+#ifndef GL_VERSION_1_3
+GLActiveTextureFunc glActiveTexture;
+#endif
+
+#ifndef GL_VERSION_1_5
+GLGenBuffersFunc glGenBuffers;
+GLDeleteBuffersFunc glDeleteBuffers;
+GLBindBufferFunc glBindBuffer;
+GLBufferDataFunc glBufferData;
+GLBufferSubDataFunc glBufferSubData;
+GLUnmapBufferFunc glUnmapBuffer;
+#endif
+
 #ifndef GL_VERSION_2_0
 GLUseProgramFunc glUseProgram;
+GLCreateShaderFunc glCreateShader;
+GLDeleteShaderFunc glDeleteShader;
+GLShaderSourceFunc glShaderSource;
+GLCompileShaderFunc glCompileShader;
+GLGetShaderivFunc glGetShaderiv;
+GLGetShaderInfoLogFunc glGetShaderInfoLog;
+GLCreateProgramFunc glCreateProgram;
+GLDeleteProgramFunc glDeleteProgram;
+GLAttachShaderFunc glAttachShader;
+GLLinkProgramFunc glLinkProgram;
+GLGetProgramivFunc glGetProgramiv;
+GLGetProgramInfoLogFunc glGetProgramInfoLog;
+GLGetUniformLocationFunc glGetUniformLocation;
+GLUniform1iFunc glUniform1i;
+GLUniform1fFunc glUniform1f;
+GLUniform2fFunc glUniform2f;
+GLUniform4fFunc glUniform4f;
+GLUniformMatrix4fvFunc glUniformMatrix4fv;
+GLGetAttribLocationFunc glGetAttribLocation;
+GLVertexAttribPointerFunc glVertexAttribPointer;
+GLEnableVertexAttribArrayFunc glEnableVertexAttribArray;
 #endif
 
 #ifndef GL_VERSION_3_0
@@ -42,10 +80,123 @@ GLRenderbufferStorageFunc glRenderbufferStorage;
 GLCheckFramebufferStatusFunc glCheckFramebufferStatus;
 #endif
 
+#ifndef GL_VERSION_3_0
+GLGetFramebufferAttachmentParameterivFunc glGetFramebufferAttachmentParameteriv;
+#endif
+
+#ifndef GL_VERSION_3_0
+GLFramebufferTextureLayerFunc glFramebufferTextureLayer;
+GLBlitFramebufferFunc glBlitFramebuffer;
+#endif
+
+#ifndef GL_VERSION_3_0
+GLGenVertexArraysFunc glGenVertexArrays;
+GLDeleteVertexArraysFunc glDeleteVertexArrays;
+GLBindVertexArrayFunc glBindVertexArray;
+#endif
+
+#ifndef GL_VERSION_3_0
+GLBindBufferBaseFunc glBindBufferBase;
+#endif
+
+#ifndef GL_VERSION_3_0
+GLMapBufferRangeFunc glMapBufferRange;
+#endif
+
+#ifndef GL_VERSION_3_1
+GLCopyBufferSubDataFunc glCopyBufferSubData;
+#endif
+
+#ifndef GL_VERSION_3_2
+GLFenceSyncFunc glFenceSync;
+GLClientWaitSyncFunc glClientWaitSync;
+GLDeleteSyncFunc glDeleteSync;
+GLWaitSyncFunc glWaitSync;
+#endif
+
+#ifndef GL_VERSION_4_4
+GLBufferStorageFunc glBufferStorage;
+#endif
+
+#ifndef GL_VERSION_4_1
+GLViewportIndexedfFunc glViewportIndexedf;
+#endif
+
+#ifndef GL_VERSION_3_0
+GLGetStringiFunc glGetStringi;
+#endif
+
+#ifndef GL_VERSION_4_5
+GLClipControlFunc glClipControl;
+#endif
+
+#ifndef GL_VERSION_4_5
+GLCreateTexturesFunc glCreateTextures;
+GLTextureStorage2DFunc glTextureStorage2D;
+GLTextureParameteriFunc glTextureParameteri;
+GLCreateFramebuffersFunc glCreateFramebuffers;
+GLNamedFramebufferTextureFunc glNamedFramebufferTexture;
+GLNamedFramebufferRenderbufferFunc glNamedFramebufferRenderbuffer;
+GLCheckNamedFramebufferStatusFunc glCheckNamedFramebufferStatus;
+GLCreateRenderbuffersFunc glCreateRenderbuffers;
+GLNamedRenderbufferStorageFunc glNamedRenderbufferStorage;
+#endif
+
+#ifndef GL_OVR_multiview
+GLFramebufferTextureMultiviewOVRFunc glFramebufferTextureMultiviewOVR;
+#endif
+
+GLCaps glcaps;
+
 bool init_opengl()
 {
+	int major = 1, minor = 0;
+	const char *verstr = (const char*)glGetString(GL_VERSION);
+	if(verstr) {
+		sscanf(verstr, "%d.%d", &major, &minor);
+	}
+	glcaps.version = major * 10 + minor;
+
+#ifndef GL_VERSION_1_2
+	glTexImage3D = (GLTexImage3DFunc)load_glext("glTexImage3D");
+#endif	// !GL_VERSION_1_2
+
+#ifndef GL_VERSION_1_3
+	glActiveTexture = (GLActiveTextureFunc)load_glext("glActiveTexture");
+#endif	// !GL_VERSION_1_3
+
+#ifndef GL_VERSION_1_5
+	glGenBuffers = (GLGenBuffersFunc)load_glext("glGenBuffers");
+	glDeleteBuffers = (GLDeleteBuffersFunc)load_glext("glDeleteBuffers");
+	glBindBuffer = (GLBindBufferFunc)load_glext("glBindBuffer");
+	glBufferData = (GLBufferDataFunc)load_glext("glBufferData");
+	glBufferSubData = (GLBufferSubDataFunc)load_glext("glBufferSubData");
+	glUnmapBuffer = (GLUnmapBufferFunc)load_glext("glUnmapBuffer");
+#endif	// !GL_VERSION_1_5
+
 #ifndef GL_VERSION_2_0
 	glUseProgram = (GLUseProgramFunc)load_glext("glUseProgram");
+	glCreateShader = (GLCreateShaderFunc)load_glext("glCreateShader");
+	glDeleteShader = (GLDeleteShaderFunc)load_glext("glDeleteShader");
+	glShaderSource = (GLShaderSourceFunc)load_glext("glShaderSource");
+	glCompileShader = (GLCompileShaderFunc)load_glext("glCompileShader");
+	glGetShaderiv = (GLGetShaderivFunc)load_glext("glGetShaderiv");
+	glGetShaderInfoLog = (GLGetShaderInfoLogFunc)load_glext("glGetShaderInfoLog");
+	glCreateProgram = (GLCreateProgramFunc)load_glext("glCreateProgram");
+	glDeleteProgram = (GLDeleteProgramFunc)load_glext("glDeleteProgram");
+	glAttachShader = (GLAttachShaderFunc)load_glext("glAttachShader");
+	glLinkProgram = (GLLinkProgramFunc)load_glext("glLinkProgram");
+	glGetProgramiv = (GLGetProgramivFunc)load_glext("glGetProgramiv");
+	glGetProgramInfoLog = (GLGetProgramInfoLogFunc)load_glext("glGetProgramInfoLog");
+	glGetUniformLocation = (GLGetUniformLocationFunc)load_glext("glGetUniformLocation");
+	glUniform1i = (GLUniform1iFunc)load_glext("glUniform1i");
+	glUniform1f = (GLUniform1fFunc)load_glext("glUniform1f");
+	glUniform2f = (GLUniform2fFunc)load_glext("glUniform2f");
+	glUniform4f = (GLUniform4fFunc)load_glext("glUniform4f");
+	glUniformMatrix4fv = (GLUniformMatrix4fvFunc)load_glext("glUniformMatrix4fv");
+	glGetAttribLocation = (GLGetAttribLocationFunc)load_glext("glGetAttribLocation");
+	glVertexAttribPointer = (GLVertexAttribPointerFunc)load_glext("glVertexAttribPointer");
+	glEnableVertexAttribArray = (GLEnableVertexAttribArrayFunc)load_glext("glEnableVertexAttribArray");
 #endif	// !GL_VERSION_2_0
 
 #ifndef GL_VERSION_3_0
@@ -64,9 +215,265 @@ bool init_opengl()
 		return false;
 	}
 #endif	// !GL_VERSION_3_0
+
+#ifndef GL_VERSION_3_0
+	glGetFramebufferAttachmentParameteriv = (GLGetFramebufferAttachmentParameterivFunc)
+		load_glext("glGetFramebufferAttachmentParameteriv");
+#endif
+
+#ifndef GL_VERSION_3_0
+	glFramebufferTextureLayer = (GLFramebufferTextureLayerFunc)load_glext("glFramebufferTextureLayerEXT");
+	glBlitFramebuffer = (GLBlitFramebufferFunc)load_glext("glBlitFramebufferEXT");
+#endif
+
+#ifndef GL_VERSION_3_0
+	glGenVertexArrays = (GLGenVertexArraysFunc)load_glext("glGenVertexArrays");
+	glDeleteVertexArrays = (GLDeleteVertexArraysFunc)load_glext("glDeleteVertexArrays");
+	glBindVertexArray = (GLBindVertexArrayFunc)load_glext("glBindVertexArray");
+#endif
+
+#ifndef GL_VERSION_3_0
+	glBindBufferBase = (GLBindBufferBaseFunc)load_glext("glBindBufferBase");
+#endif
+#ifndef GL_VERSION_4_1
+	glViewportIndexedf = (GLViewportIndexedfFunc)load_glext("glViewportIndexedf");
+#endif
+
+#ifndef GL_VERSION_3_0
+	glMapBufferRange = (GLMapBufferRangeFunc)load_glext("glMapBufferRange");
+#endif
+#ifndef GL_VERSION_3_1
+	glCopyBufferSubData = (GLCopyBufferSubDataFunc)load_glext("glCopyBufferSubData");
+#endif
+#ifndef GL_VERSION_3_2
+	glFenceSync = (GLFenceSyncFunc)load_glext("glFenceSync");
+	glClientWaitSync = (GLClientWaitSyncFunc)load_glext("glClientWaitSync");
+	glDeleteSync = (GLDeleteSyncFunc)load_glext("glDeleteSync");
+	glWaitSync = (GLWaitSyncFunc)load_glext("glWaitSync");
+#endif
+#ifndef GL_VERSION_4_4
+	glBufferStorage = (GLBufferStorageFunc)load_glext("glBufferStorage");
+#endif
+
+#ifndef GL_VERSION_3_0
+	glGetStringi = (GLGetStringiFunc)load_glext("glGetStringi");
+#endif
+#ifndef GL_VERSION_4_5
+	glClipControl = (GLClipControlFunc)load_glext("glClipControl");
+#endif
+
+	glcaps.clip_control = glcaps.version >= 45 || have_glext("GL_ARB_clip_control");
+#ifndef GL_VERSION_4_5
+	if(!glClipControl) glcaps.clip_control = false;
+#endif
+
+#ifndef GL_VERSION_4_5
+	glCreateTextures = (GLCreateTexturesFunc)load_glext("glCreateTextures");
+	glTextureStorage2D = (GLTextureStorage2DFunc)load_glext("glTextureStorage2D");
+	glTextureParameteri = (GLTextureParameteriFunc)load_glext("glTextureParameteri");
+	glCreateFramebuffers = (GLCreateFramebuffersFunc)load_glext("glCreateFramebuffers");
+	glNamedFramebufferTexture = (GLNamedFramebufferTextureFunc)load_glext("glNamedFramebufferTexture");
+	glNamedFramebufferRenderbuffer = (GLNamedFramebufferRenderbufferFunc)load_glext("glNamedFramebufferRenderbuffer");
+	glCheckNamedFramebufferStatus = (GLCheckNamedFramebufferStatusFunc)load_glext("glCheckNamedFramebufferStatus");
+	glCreateRenderbuffers = (GLCreateRenderbuffersFunc)load_glext("glCreateRenderbuffers");
+	glNamedRenderbufferStorage = (GLNamedRenderbufferStorageFunc)load_glext("glNamedRenderbufferStorage");
+#endif
+
+	glcaps.dsa = glcaps.version >= 45 || have_glext("GL_ARB_direct_state_access");
+#ifndef GL_VERSION_4_5
+	if(!glCreateTextures || !glTextureStorage2D || !glTextureParameteri || !glCreateFramebuffers ||
+			!glNamedFramebufferTexture || !glNamedFramebufferRenderbuffer ||
+			!glCheckNamedFramebufferStatus || !glCreateRenderbuffers || !glNamedRenderbufferStorage) {
+		glcaps.dsa = false;
+	}
+#endif
+	if(getenv("GOATVR_NO_DSA")) {
+		glcaps.dsa = false;
+	}
+
+#ifndef GL_OVR_multiview
+	glFramebufferTextureMultiviewOVR = (GLFramebufferTextureMultiviewOVRFunc)load_glext("glFramebufferTextureMultiviewOVR");
+#endif
+	glcaps.multiview = glcaps.version >= 30 && have_glext("GL_OVR_multiview2");
+#ifndef GL_OVR_multiview
+	if(!glFramebufferTextureMultiviewOVR) glcaps.multiview = false;
+#endif
+#ifndef GL_VERSION_3_0
+	if(!glFramebufferTextureLayer || !glBlitFramebuffer) glcaps.multiview = false;
+#endif
+
+	glcaps.ubo = glcaps.version >= 31 || have_glext("GL_ARB_uniform_buffer_object");
+#ifndef GL_VERSION_1_5
+	if(!glGenBuffers) glcaps.ubo = false;
+#endif
+#ifndef GL_VERSION_3_0
+	if(!glBindBufferBase) glcaps.ubo = false;
+#endif
+
+	/* viewport arrays are only useful for instanced stereo if the vertex
+	 * shader can select the viewport, without a geometry shader
+	 */
+	glcaps.viewport_array = (glcaps.version >= 41 || have_glext("GL_ARB_viewport_array")) &&
+		(have_glext("GL_ARB_shader_viewport_layer_array") || have_glext("GL_AMD_vertex_shader_viewport_index"));
+#ifndef GL_VERSION_4_1
+	if(!glViewportIndexedf) glcaps.viewport_array = false;
+#endif
+
+	glcaps.shaders = glcaps.version >= 32;
+#ifndef GL_VERSION_2_0
+	if(!glCreateShader) glcaps.shaders = false;
+#endif
+#ifndef GL_VERSION_3_0
+	if(!glGenVertexArrays) glcaps.shaders = false;
+#endif
+
+	glcaps.buffer_storage = glcaps.ubo && glcaps.version >= 32 &&
+		(glcaps.version >= 44 || have_glext("GL_ARB_buffer_storage"));
+#ifndef GL_VERSION_3_0
+	if(!glMapBufferRange) glcaps.buffer_storage = false;
+#endif
+#ifndef GL_VERSION_3_1
+	if(!glCopyBufferSubData) glcaps.buffer_storage = false;
+#endif
+#ifndef GL_VERSION_3_2
+	if(!glFenceSync || !glClientWaitSync || !glDeleteSync) glcaps.buffer_storage = false;
+#endif
+#ifndef GL_VERSION_4_4
+	if(!glBufferStorage) glcaps.buffer_storage = false;
+#endif
+
+	glcaps.sync = glcaps.version >= 32 || have_glext("GL_ARB_sync");
+#ifndef GL_VERSION_3_2
+	if(!glFenceSync || !glClientWaitSync || !glDeleteSync || !glWaitSync) glcaps.sync = false;
+#endif
 	return true;
 }
 
+bool have_glext(const char *name)
+{
+#ifndef __APPLE__
+	if(glcaps.version >= 30) {
+		// the extension string is not available in core profile contexts
+#ifndef GL_VERSION_3_0
+		if(!glGetStringi) return false;
+#endif
+		int num_ext = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &num_ext);
+		for(int i=0; i<num_ext; i++) {
+			const char *ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if(ext && strcmp(ext, name) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+#endif
+
+	const char *extstr = (const char*)glGetString(GL_EXTENSIONS);
+	if(!extstr) return false;
+
+	int len = strlen(name);
+	const char *ptr = extstr;
+	while((ptr = strstr(ptr, name))) {
+		if((ptr == extstr || ptr[-1] == ' ') && (ptr[len] == ' ' || ptr[len] == 0)) {
+			return true;
+		}
+		ptr += len;
+	}
+	return false;
+}
+
+#define MAX_STATE_STACK	4
+
+struct GLState {
+	int vp[4], scissor[4];
+	int prog, vao, vbo, tex[2], active_tex;
+	bool depth_test, blend, cull_face, scissor_test, stencil_test, srgb;
+	int depth_func;
+	int stencil_func, stencil_ref, stencil_mask, stencil_wrmask;
+	int stencil_op[3];
+	GLboolean depth_mask;
+	GLboolean color_mask[4];
+};
+
+// per thread, the compositor thread draws with its own context (see compositor.h)
+static thread_local GLState state_stack[MAX_STATE_STACK];
+static thread_local int state_top;
+
+void push_gl_state()
+{
+	assert(state_top < MAX_STATE_STACK);
+	GLState *st = state_stack + state_top++;
+
+	glGetIntegerv(GL_VIEWPORT, st->vp);
+	glGetIntegerv(GL_SCISSOR_BOX, st->scissor);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &st->prog);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &st->vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &st->vbo);
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &st->active_tex);
+	for(int i=0; i<2; i++) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, st->tex + i);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	st->depth_test = glIsEnabled(GL_DEPTH_TEST);
+	st->blend = glIsEnabled(GL_BLEND);
+	st->cull_face = glIsEnabled(GL_CULL_FACE);
+	st->scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+	st->stencil_test = glIsEnabled(GL_STENCIL_TEST);
+	st->srgb = glIsEnabled(GL_FRAMEBUFFER_SRGB);
+	glGetIntegerv(GL_DEPTH_FUNC, &st->depth_func);
+	glGetIntegerv(GL_STENCIL_FUNC, &st->stencil_func);
+	glGetIntegerv(GL_STENCIL_REF, &st->stencil_ref);
+	glGetIntegerv(GL_STENCIL_VALUE_MASK, &st->stencil_mask);
+	glGetIntegerv(GL_STENCIL_WRITEMASK, &st->stencil_wrmask);
+	glGetIntegerv(GL_STENCIL_FAIL, st->stencil_op);
+	glGetIntegerv(GL_STENCIL_PASS_DEPTH_FAIL, st->stencil_op + 1);
+	glGetIntegerv(GL_STENCIL_PASS_DEPTH_PASS, st->stencil_op + 2);
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &st->depth_mask);
+	glGetBooleanv(GL_COLOR_WRITEMASK, st->color_mask);
+}
+
+static void set_enable(unsigned int cap, bool en)
+{
+	if(en) {
+		glEnable(cap);
+	} else {
+		glDisable(cap);
+	}
+}
+
+void pop_gl_state()
+{
+	assert(state_top > 0);
+	GLState *st = state_stack + --state_top;
+
+	glViewport(st->vp[0], st->vp[1], st->vp[2], st->vp[3]);
+	glScissor(st->scissor[0], st->scissor[1], st->scissor[2], st->scissor[3]);
+	glUseProgram(st->prog);
+	glBindVertexArray(st->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, st->vbo);
+	for(int i=0; i<2; i++) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, st->tex[i]);
+	}
+	glActiveTexture(st->active_tex);
+
+	set_enable(GL_DEPTH_TEST, st->depth_test);
+	set_enable(GL_BLEND, st->blend);
+	set_enable(GL_CULL_FACE, st->cull_face);
+	set_enable(GL_SCISSOR_TEST, st->scissor_test);
+	set_enable(GL_STENCIL_TEST, st->stencil_test);
+	set_enable(GL_FRAMEBUFFER_SRGB, st->srgb);
+	glDepthFunc(st->depth_func);
+	glStencilFunc(st->stencil_func, st->stencil_ref, st->stencil_mask);
+	glStencilOp(st->stencil_op[0], st->stencil_op[1], st->stencil_op[2]);
+	glStencilMask(st->stencil_wrmask);
+	glDepthMask(st->depth_mask);
+	glColorMask(st->color_mask[0], st->color_mask[1], st->color_mask[2], st->color_mask[3]);
+}
+
 }	// namespace goatvr
 
 #ifdef WIN32
@@ -86,4 +493,12 @@ glfunc_type load_glext(const char *name)
 {
 	return (glfunc_type)glXGetProcAddress((unsigned char*)name);
 }
+
+#elif defined(__APPLE__)
+#include <dlfcn.h>
+
+glfunc_type load_glext(const char *name)
+{
+	return (glfunc_type)dlsym(RTLD_DEFAULT, name);
+}
 #endif
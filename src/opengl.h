@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define OPENGL_H_
 
 #include <assert.h>
+#include <stddef.h>
 
 #ifdef WIN32
 
@@ -47,14 +48,140 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <GL/gl.h>
 #endif
 
+#ifndef GL_VERSION_1_5
+typedef ptrdiff_t GLsizeiptr;
+typedef ptrdiff_t GLintptr;
+#endif
+#ifndef GL_VERSION_2_0
+typedef char GLchar;
+#endif
+#ifndef GL_VERSION_3_2
+typedef struct __GLsync *GLsync;
+typedef unsigned long long GLuint64;
+#endif
+
 namespace goatvr {
 
 bool init_opengl();
 
+// OpenGL capabilities of the current context, detected by init_opengl
+struct GLCaps {
+	int version;		// major * 10 + minor
+	bool clip_control;	// GL 4.5 or ARB_clip_control
+	bool dsa;			// GL 4.5 or ARB_direct_state_access
+	bool multiview;		// OVR_multiview2 (and GL 3.0 for texture arrays)
+	bool ubo;			// GL 3.1 or ARB_uniform_buffer_object
+	bool viewport_array;	// ARB_viewport_array, with gl_ViewportIndex in vertex shaders
+	bool shaders;		// GL 3.2 (GLSL 1.50 and VAOs), for the internal compositing shaders
+	bool buffer_storage;	// GL 4.4 or ARB_buffer_storage, on top of GL 3.2 (sync objects)
+	bool sync;			// GL 3.2 or ARB_sync
+};
+
+extern GLCaps glcaps;
+
+bool have_glext(const char *name);
+
+/* save and restore the bits of GL state touched by the internal drawing done
+ * by goatvr (program, vertex array and buffer, texture units 0 and 1,
+ * viewport, scissor box, and the depth, stencil, blending and culling state),
+ * to avoid disturbing the application.
+ */
+void push_gl_state();
+void pop_gl_state();
+
+#ifndef GL_VERSION_1_2
+typedef void (GLAPI *GLTexImage3DFunc)(GLenum target, GLint level, GLint ifmt, GLsizei width,
+		GLsizei height, GLsizei depth, GLint border, GLenum fmt, GLenum type, const void *pixels);
+
+extern GLTexImage3DFunc glTexImage3D;
+#endif	// !GL_VERSION_1_2
+
+#ifndef GL_VERSION_1_3
+#define GL_TEXTURE0				0x84c0
+#define GL_ACTIVE_TEXTURE		0x84e0
+
+typedef void (GLAPI *GLActiveTextureFunc)(GLenum unit);
+
+extern GLActiveTextureFunc glActiveTexture;
+#endif	// !GL_VERSION_1_3
+
+#ifndef GL_VERSION_1_5
+#define GL_ARRAY_BUFFER			0x8892
+#define GL_ARRAY_BUFFER_BINDING	0x8894
+#define GL_STREAM_DRAW			0x88e0
+#define GL_STREAM_READ			0x88e1
+#define GL_STATIC_DRAW			0x88e4
+#define GL_DYNAMIC_DRAW			0x88e8
+
+typedef void (GLAPI *GLGenBuffersFunc)(GLsizei n, GLuint *bufs);
+typedef void (GLAPI *GLDeleteBuffersFunc)(GLsizei n, const GLuint *bufs);
+typedef void (GLAPI *GLBindBufferFunc)(GLenum target, GLuint buf);
+typedef void (GLAPI *GLBufferDataFunc)(GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+typedef void (GLAPI *GLBufferSubDataFunc)(GLenum target, GLintptr offs, GLsizeiptr size, const void *data);
+typedef GLboolean (GLAPI *GLUnmapBufferFunc)(GLenum target);
+
+extern GLGenBuffersFunc glGenBuffers;
+extern GLDeleteBuffersFunc glDeleteBuffers;
+extern GLBindBufferFunc glBindBuffer;
+extern GLBufferDataFunc glBufferData;
+extern GLBufferSubDataFunc glBufferSubData;
+extern GLUnmapBufferFunc glUnmapBuffer;
+#endif	// !GL_VERSION_1_5
+
 #ifndef GL_VERSION_2_0
+#define GL_FRAGMENT_SHADER		0x8b30
+#define GL_VERTEX_SHADER		0x8b31
+#define GL_COMPILE_STATUS		0x8b81
+#define GL_LINK_STATUS			0x8b82
+#define GL_INFO_LOG_LENGTH		0x8b84
+#define GL_CURRENT_PROGRAM		0x8b8d
+
 typedef void (GLAPI *GLUseProgramFunc)(GLuint prog);
+typedef GLuint (GLAPI *GLCreateShaderFunc)(GLenum type);
+typedef void (GLAPI *GLDeleteShaderFunc)(GLuint sdr);
+typedef void (GLAPI *GLShaderSourceFunc)(GLuint sdr, GLsizei count, const GLchar **src, const GLint *len);
+typedef void (GLAPI *GLCompileShaderFunc)(GLuint sdr);
+typedef void (GLAPI *GLGetShaderivFunc)(GLuint sdr, GLenum pname, GLint *val);
+typedef void (GLAPI *GLGetShaderInfoLogFunc)(GLuint sdr, GLsizei bufsz, GLsizei *len, GLchar *buf);
+typedef GLuint (GLAPI *GLCreateProgramFunc)(void);
+typedef void (GLAPI *GLDeleteProgramFunc)(GLuint prog);
+typedef void (GLAPI *GLAttachShaderFunc)(GLuint prog, GLuint sdr);
+typedef void (GLAPI *GLLinkProgramFunc)(GLuint prog);
+typedef void (GLAPI *GLGetProgramivFunc)(GLuint prog, GLenum pname, GLint *val);
+typedef void (GLAPI *GLGetProgramInfoLogFunc)(GLuint prog, GLsizei bufsz, GLsizei *len, GLchar *buf);
+typedef GLint (GLAPI *GLGetUniformLocationFunc)(GLuint prog, const GLchar *name);
+typedef void (GLAPI *GLUniform1iFunc)(GLint loc, GLint v);
+typedef void (GLAPI *GLUniform1fFunc)(GLint loc, GLfloat v);
+typedef void (GLAPI *GLUniform2fFunc)(GLint loc, GLfloat v0, GLfloat v1);
+typedef void (GLAPI *GLUniform4fFunc)(GLint loc, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3);
+typedef void (GLAPI *GLUniformMatrix4fvFunc)(GLint loc, GLsizei count, GLboolean transp, const GLfloat *v);
+typedef GLint (GLAPI *GLGetAttribLocationFunc)(GLuint prog, const GLchar *name);
+typedef void (GLAPI *GLVertexAttribPointerFunc)(GLuint idx, GLint size, GLenum type, GLboolean norm,
+		GLsizei stride, const void *ptr);
+typedef void (GLAPI *GLEnableVertexAttribArrayFunc)(GLuint idx);
 
 extern GLUseProgramFunc glUseProgram;
+extern GLCreateShaderFunc glCreateShader;
+extern GLDeleteShaderFunc glDeleteShader;
+extern GLShaderSourceFunc glShaderSource;
+extern GLCompileShaderFunc glCompileShader;
+extern GLGetShaderivFunc glGetShaderiv;
+extern GLGetShaderInfoLogFunc glGetShaderInfoLog;
+extern GLCreateProgramFunc glCreateProgram;
+extern GLDeleteProgramFunc glDeleteProgram;
+extern GLAttachShaderFunc glAttachShader;
+extern GLLinkProgramFunc glLinkProgram;
+extern GLGetProgramivFunc glGetProgramiv;
+extern GLGetProgramInfoLogFunc glGetProgramInfoLog;
+extern GLGetUniformLocationFunc glGetUniformLocation;
+extern GLUniform1iFunc glUniform1i;
+extern GLUniform1fFunc glUniform1f;
+extern GLUniform2fFunc glUniform2f;
+extern GLUniform4fFunc glUniform4f;
+extern GLUniformMatrix4fvFunc glUniformMatrix4fv;
+extern GLGetAttribLocationFunc glGetAttribLocation;
+extern GLVertexAttribPointerFunc glVertexAttribPointer;
+extern GLEnableVertexAttribArrayFunc glEnableVertexAttribArray;
 #endif	// !GL_VERSION_2_0
 
 #ifndef GL_DEPTH_COMPONENT24
@@ -64,6 +191,35 @@ extern GLUseProgramFunc glUseProgram;
 #ifndef GL_SRGB
 #define GL_SRGB 0x8c40
 #endif
+#ifndef GL_SRGB8
+#define GL_SRGB8 0x8c41
+#endif
+#ifndef GL_SRGB_ALPHA
+#define GL_SRGB_ALPHA 0x8c42
+#define GL_SRGB8_ALPHA8 0x8c43
+#endif
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER	0x88eb
+#endif
+#ifndef GL_TEXTURE_2D_ARRAY
+#define GL_TEXTURE_2D_ARRAY	0x8c1a
+#endif
+#ifndef GL_READ_FRAMEBUFFER
+#define GL_READ_FRAMEBUFFER	0x8ca8
+#define GL_DRAW_FRAMEBUFFER	0x8ca9
+#endif
+
+#ifndef GL_DEPTH_COMPONENT16
+#define GL_DEPTH_COMPONENT16	0x81a5
+#endif
+#ifndef GL_DEPTH_STENCIL
+#define GL_DEPTH_STENCIL		0x84f9
+#define GL_UNSIGNED_INT_24_8	0x84fa
+#define GL_DEPTH24_STENCIL8		0x88f0
+#endif
+#ifndef GL_DEPTH_COMPONENT32F
+#define GL_DEPTH_COMPONENT32F	0x8cac
+#endif
 
 #ifndef GL_VERSION_3_0
 /* ARB_framebuffer_object / EXT_framebuffer_object */
@@ -97,6 +253,174 @@ extern GLRenderbufferStorageFunc glRenderbufferStorage;
 extern GLCheckFramebufferStatusFunc glCheckFramebufferStatus;
 #endif	// !GL_VERSION_3_0
 
+#ifndef GL_VERSION_3_0
+/* ARB_framebuffer_object attachment queries */
+#define GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE		0x8cd0
+#define GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME		0x8cd1
+#define GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE	0x8211
+#define GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE		0x8216
+#define GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE		0x8217
+
+typedef void (GLAPI *GLGetFramebufferAttachmentParameterivFunc)(GLenum target, GLenum attachment, GLenum pname, GLint *val);
+
+extern GLGetFramebufferAttachmentParameterivFunc glGetFramebufferAttachmentParameteriv;
+#endif	// !GL_VERSION_3_0
+
+#ifndef GL_VERSION_3_0
+/* EXT_texture_array / EXT_framebuffer_blit */
+typedef void (GLAPI *GLFramebufferTextureLayerFunc)(GLenum target, GLenum attachment, GLuint tex, GLint level, GLint layer);
+typedef void (GLAPI *GLBlitFramebufferFunc)(GLint sx0, GLint sy0, GLint sx1, GLint sy1, GLint dx0,
+		GLint dy0, GLint dx1, GLint dy1, GLbitfield mask, GLenum filter);
+
+extern GLFramebufferTextureLayerFunc glFramebufferTextureLayer;
+extern GLBlitFramebufferFunc glBlitFramebuffer;
+#endif	// !GL_VERSION_3_0
+
+#ifndef GL_VERSION_3_0
+#define GL_VERTEX_ARRAY_BINDING	0x85b5
+
+typedef void (GLAPI *GLGenVertexArraysFunc)(GLsizei n, GLuint *vao);
+typedef void (GLAPI *GLDeleteVertexArraysFunc)(GLsizei n, const GLuint *vao);
+typedef void (GLAPI *GLBindVertexArrayFunc)(GLuint vao);
+
+extern GLGenVertexArraysFunc glGenVertexArrays;
+extern GLDeleteVertexArraysFunc glDeleteVertexArrays;
+extern GLBindVertexArrayFunc glBindVertexArray;
+#endif	// !GL_VERSION_3_0
+
+#ifndef GL_FRAMEBUFFER_SRGB
+#define GL_FRAMEBUFFER_SRGB		0x8db9
+#endif
+#ifndef GL_DEPTH_STENCIL_ATTACHMENT
+#define GL_DEPTH_STENCIL_ATTACHMENT	0x821a
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE		0x812f
+#endif
+
+#ifndef GL_VERSION_3_0
+typedef void (GLAPI *GLBindBufferBaseFunc)(GLenum target, GLuint idx, GLuint buf);
+
+extern GLBindBufferBaseFunc glBindBufferBase;
+#endif	// !GL_VERSION_3_0
+
+#ifndef GL_VERSION_3_0
+/* ARB_map_buffer_range */
+#define GL_MAP_READ_BIT			0x0001
+#define GL_MAP_WRITE_BIT		0x0002
+
+typedef void *(GLAPI *GLMapBufferRangeFunc)(GLenum target, GLintptr offs, GLsizeiptr size, GLbitfield access);
+
+extern GLMapBufferRangeFunc glMapBufferRange;
+#endif	// !GL_VERSION_3_0
+
+#ifndef GL_VERSION_3_1
+/* ARB_copy_buffer */
+#define GL_COPY_READ_BUFFER		0x8f36
+#define GL_COPY_WRITE_BUFFER	0x8f37
+
+typedef void (GLAPI *GLCopyBufferSubDataFunc)(GLenum rtarget, GLenum wtarget, GLintptr roffs,
+		GLintptr woffs, GLsizeiptr size);
+
+extern GLCopyBufferSubDataFunc glCopyBufferSubData;
+#endif	// !GL_VERSION_3_1
+
+#ifndef GL_VERSION_3_2
+/* ARB_sync */
+#define GL_SYNC_GPU_COMMANDS_COMPLETE	0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT		0x0001
+#define GL_ALREADY_SIGNALED		0x911a
+#define GL_TIMEOUT_EXPIRED		0x911b
+#define GL_CONDITION_SATISFIED	0x911c
+#define GL_WAIT_FAILED			0x911d
+#define GL_TIMEOUT_IGNORED		0xffffffffffffffffull
+
+typedef GLsync (GLAPI *GLFenceSyncFunc)(GLenum cond, GLbitfield flags);
+typedef GLenum (GLAPI *GLClientWaitSyncFunc)(GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (GLAPI *GLDeleteSyncFunc)(GLsync sync);
+typedef void (GLAPI *GLWaitSyncFunc)(GLsync sync, GLbitfield flags, GLuint64 timeout);
+
+extern GLFenceSyncFunc glFenceSync;
+extern GLClientWaitSyncFunc glClientWaitSync;
+extern GLDeleteSyncFunc glDeleteSync;
+extern GLWaitSyncFunc glWaitSync;
+#endif	// !GL_VERSION_3_2
+
+#ifndef GL_VERSION_4_4
+/* ARB_buffer_storage */
+#define GL_MAP_PERSISTENT_BIT	0x0040
+#define GL_MAP_COHERENT_BIT		0x0080
+
+typedef void (GLAPI *GLBufferStorageFunc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+extern GLBufferStorageFunc glBufferStorage;
+#endif	// !GL_VERSION_4_4
+
+#ifndef GL_UNIFORM_BUFFER
+#define GL_UNIFORM_BUFFER		0x8a11
+#endif
+#ifndef GL_CLIP_DISTANCE0
+#define GL_CLIP_DISTANCE0		0x3000
+#endif
+
+#ifndef GL_VERSION_4_1
+/* ARB_viewport_array */
+typedef void (GLAPI *GLViewportIndexedfFunc)(GLuint idx, GLfloat x, GLfloat y, GLfloat w, GLfloat h);
+
+extern GLViewportIndexedfFunc glViewportIndexedf;
+#endif	// !GL_VERSION_4_1
+
+#ifndef GL_VERSION_3_0
+#define GL_NUM_EXTENSIONS		0x821d
+
+typedef const GLubyte *(GLAPI *GLGetStringiFunc)(GLenum name, GLuint idx);
+
+extern GLGetStringiFunc glGetStringi;
+#endif	// !GL_VERSION_3_0
+
+#ifndef GL_VERSION_4_5
+/* ARB_clip_control */
+#define GL_LOWER_LEFT				0x8ca1
+#define GL_NEGATIVE_ONE_TO_ONE		0x935e
+#define GL_ZERO_TO_ONE				0x935f
+#define GL_CLIP_ORIGIN				0x935c
+#define GL_CLIP_DEPTH_MODE			0x935d
+
+typedef void (GLAPI *GLClipControlFunc)(GLenum origin, GLenum depth);
+
+extern GLClipControlFunc glClipControl;
+#endif	// !GL_VERSION_4_5
+
+#ifndef GL_VERSION_4_5
+/* ARB_direct_state_access */
+typedef void (GLAPI *GLCreateTexturesFunc)(GLenum target, GLsizei n, GLuint *tex);
+typedef void (GLAPI *GLTextureStorage2DFunc)(GLuint tex, GLsizei levels, GLenum ifmt, GLsizei width, GLsizei height);
+typedef void (GLAPI *GLTextureParameteriFunc)(GLuint tex, GLenum pname, GLint val);
+typedef void (GLAPI *GLCreateFramebuffersFunc)(GLsizei n, GLuint *fbo);
+typedef void (GLAPI *GLNamedFramebufferTextureFunc)(GLuint fbo, GLenum attachment, GLuint tex, GLint level);
+typedef void (GLAPI *GLNamedFramebufferRenderbufferFunc)(GLuint fbo, GLenum attachment, GLenum rbtarget, GLuint rbuf);
+typedef GLenum (GLAPI *GLCheckNamedFramebufferStatusFunc)(GLuint fbo, GLenum target);
+typedef void (GLAPI *GLCreateRenderbuffersFunc)(GLsizei n, GLuint *rbuf);
+typedef void (GLAPI *GLNamedRenderbufferStorageFunc)(GLuint rbuf, GLenum ifmt, GLsizei width, GLsizei height);
+
+extern GLCreateTexturesFunc glCreateTextures;
+extern GLTextureStorage2DFunc glTextureStorage2D;
+extern GLTextureParameteriFunc glTextureParameteri;
+extern GLCreateFramebuffersFunc glCreateFramebuffers;
+extern GLNamedFramebufferTextureFunc glNamedFramebufferTexture;
+extern GLNamedFramebufferRenderbufferFunc glNamedFramebufferRenderbuffer;
+extern GLCheckNamedFramebufferStatusFunc glCheckNamedFramebufferStatus;
+extern GLCreateRenderbuffersFunc glCreateRenderbuffers;
+extern GLNamedRenderbufferStorageFunc glNamedRenderbufferStorage;
+#endif	// !GL_VERSION_4_5
+
+#ifndef GL_OVR_multiview
+typedef void (GLAPI *GLFramebufferTextureMultiviewOVRFunc)(GLenum target, GLenum attachment,
+		GLuint tex, GLint level, GLint base_view, GLsizei num_views);
+
+extern GLFramebufferTextureMultiviewOVRFunc glFramebufferTextureMultiviewOVR;
+#endif	// !GL_OVR_multiview
+
 }	// namespace goatvr
 
 #define CHECK_GLERROR	assert(glGetError() == GL_NO_ERROR)
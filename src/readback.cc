@@ -0,0 +1,253 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "readback.h"
+#include "rtex.h"
+
+#ifndef GL_DRAW_FRAMEBUFFER_BINDING
+#define GL_DRAW_FRAMEBUFFER_BINDING	0x8ca6
+#define GL_READ_FRAMEBUFFER_BINDING	0x8caa
+#endif
+#ifndef GL_PIXEL_PACK_BUFFER_BINDING
+#define GL_PIXEL_PACK_BUFFER_BINDING	0x88ed
+#endif
+
+using namespace goatvr;
+
+Readback::Readback()
+{
+	for(int i=0; i<READBACK_SLOTS; i++) {
+		slot[i].pbo = 0;
+		slot[i].size = 0;
+		slot[i].width = slot[i].height = 0;
+		slot[i].id = 0;
+		slot[i].fence = 0;
+		slot[i].busy = false;
+		slot[i].seq = 0;
+	}
+	mapped = -1;
+	fbo = 0;
+	seq = 0;
+	stex = sfbo[0] = sfbo[1] = 0;
+	stex_width = stex_height = 0;
+}
+
+void Readback::destroy()
+{
+	if(mapped >= 0) {
+		unmap();
+	}
+	for(int i=0; i<READBACK_SLOTS; i++) {
+		if(slot[i].fence) {
+			glDeleteSync(slot[i].fence);
+			slot[i].fence = 0;
+		}
+		if(slot[i].pbo) {
+			glDeleteBuffers(1, &slot[i].pbo);
+			slot[i].pbo = 0;
+		}
+		slot[i].size = 0;
+		slot[i].busy = false;
+	}
+	if(fbo) {
+		glDeleteFramebuffers(1, &fbo);
+		fbo = 0;
+	}
+	if(stex) {
+		glDeleteTextures(1, &stex);
+		stex = 0;
+		stex_width = stex_height = 0;
+	}
+	if(sfbo[0]) {
+		glDeleteFramebuffers(2, sfbo);
+		sfbo[0] = sfbo[1] = 0;
+	}
+}
+
+bool Readback::read(unsigned int tex, int x, int y, int width, int height, long id)
+{
+	int idx = -1;
+	for(int i=0; i<READBACK_SLOTS; i++) {
+		if(!slot[i].busy) {
+			idx = i;
+			break;
+		}
+	}
+	if(idx == -1) {
+		return false;
+	}
+	Slot *s = slot + idx;
+
+	if(!fbo) {
+		glGenFramebuffers(1, &fbo);
+	}
+
+	int prev_read_fb, prev_pbo;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_read_fb);
+	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &prev_pbo);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+
+	int size = width * height * 4;
+	if(!s->pbo) {
+		glGenBuffers(1, &s->pbo);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo);
+	if(size > s->size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
+		s->size = size;
+	}
+
+	glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, prev_pbo);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_read_fb);
+
+	s->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	s->width = width;
+	s->height = height;
+	s->id = id;
+	s->busy = true;
+	s->seq = seq++;
+	return true;
+}
+
+bool Readback::read_scaled(unsigned int tex, int tex_width, int tex_height, int width, int height,
+		long id, const RenderTexture *layout)
+{
+	if(width == tex_width && height == tex_height) {
+		return read(tex, 0, 0, width, height, id);
+	}
+
+	if(!sfbo[0]) {
+		glGenFramebuffers(2, sfbo);
+	}
+
+	if(width != stex_width || height != stex_height) {
+		int prev_tex;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &prev_tex);
+		if(!stex) {
+			glGenTextures(1, &stex);
+		}
+		glBindTexture(GL_TEXTURE_2D, stex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glBindTexture(GL_TEXTURE_2D, prev_tex);
+		stex_width = width;
+		stex_height = height;
+	}
+
+	int prev_draw_fb, prev_read_fb;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_draw_fb);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_read_fb);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, sfbo[0]);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sfbo[1]);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, stex, 0);
+
+	bool scissor = glIsEnabled(GL_SCISSOR_TEST);
+	bool srgb = glIsEnabled(GL_FRAMEBUFFER_SRGB);
+	if(scissor) glDisable(GL_SCISSOR_TEST);
+	if(srgb) glDisable(GL_FRAMEBUFFER_SRGB);
+
+	if(layout) {
+		float sx = (float)width / (float)tex_width;
+		float sy = (float)height / (float)tex_height;
+		for(int i=0; i<2; i++) {
+			int x0 = layout->eye_xoffs[i];
+			int y0 = layout->eye_yoffs[i];
+			int x1 = x0 + layout->eye_width[i];
+			int y1 = y0 + layout->eye_height[i];
+			glBlitFramebuffer(x0, y0, x1, y1, (int)(x0 * sx + 0.5f), (int)(y0 * sy + 0.5f),
+					(int)(x1 * sx + 0.5f), (int)(y1 * sy + 0.5f), GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		}
+	} else {
+		glBlitFramebuffer(0, 0, tex_width, tex_height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	}
+
+	if(scissor) glEnable(GL_SCISSOR_TEST);
+	if(srgb) glEnable(GL_FRAMEBUFFER_SRGB);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prev_draw_fb);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_read_fb);
+
+	return read(stex, 0, 0, width, height, id);
+}
+
+const void *Readback::map(int *width, int *height, long *id, bool wait)
+{
+	int idx = -1;
+	for(int i=0; i<READBACK_SLOTS; i++) {
+		if(slot[i].fence && (idx == -1 || slot[i].seq < slot[idx].seq)) {
+			idx = i;
+		}
+	}
+	if(idx == -1) {
+		return 0;
+	}
+	Slot *s = slot + idx;
+
+	GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+	GLenum res = glClientWaitSync(s->fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+	if(res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED) {
+		return 0;
+	}
+	glDeleteSync(s->fence);
+	s->fence = 0;
+
+	int prev_pbo;
+	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &prev_pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, s->pbo);
+	void *ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, s->width * s->height * 4, GL_MAP_READ_BIT);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, prev_pbo);
+
+	if(!ptr) {
+		s->busy = false;
+		return 0;
+	}
+	mapped = idx;
+
+	*width = s->width;
+	*height = s->height;
+	*id = s->id;
+	return ptr;
+}
+
+void Readback::unmap()
+{
+	if(mapped < 0) return;
+
+	int prev_pbo;
+	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &prev_pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot[mapped].pbo);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, prev_pbo);
+
+	slot[mapped].busy = false;
+	mapped = -1;
+}
+
+bool Readback::pending() const
+{
+	for(int i=0; i<READBACK_SLOTS; i++) {
+		if(slot[i].fence) return true;
+	}
+	return false;
+}
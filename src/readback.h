@@ -0,0 +1,79 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef READBACK_H_
+#define READBACK_H_
+
+#include "opengl.h"
+
+namespace goatvr {
+
+class RenderTexture;
+
+#define READBACK_SLOTS	3
+
+/* asynchronous texture readback, through a ring of pixel pack buffers. read
+ * queues a glReadPixels into the next free buffer, and map returns the
+ * oldest one once its fence has signalled, a few frames later, without ever
+ * waiting for the GPU. Pixels are 8-bit RGBA, bottom row first.
+ */
+class Readback {
+public:
+	struct Slot {
+		unsigned int pbo;
+		int size;		// allocated size of pbo in bytes
+		int width, height;
+		long id;		// passed to read, returned by map
+		GLsync fence;
+		bool busy;		// queued, or mapped
+		long seq;		// order of queueing
+	};
+	Slot slot[READBACK_SLOTS];
+	int mapped;		// index of the mapped slot, or -1
+	unsigned int fbo;
+	long seq;
+	unsigned int stex, sfbo[2];	// downscaling target, see read_scaled
+	int stex_width, stex_height;
+
+	Readback();
+
+	void destroy();
+
+	/* read a region of tex. Returns false if all the buffers are still
+	 * waiting to be mapped, in which case the frame should be skipped.
+	 */
+	bool read(unsigned int tex, int x, int y, int width, int height, long id);
+	/* read the bottom-left tex_width x tex_height part of tex, downscaled to
+	 * width x height on the GPU first. If layout is not null, each eye
+	 * rectangle is scaled on its own, so filtering doesn't bleed across them.
+	 */
+	bool read_scaled(unsigned int tex, int tex_width, int tex_height, int width, int height,
+			long id, const RenderTexture *layout = 0);
+
+	/* map the oldest completed readback. Returns null if none has completed
+	 * yet, or wait is false and the GPU is not done with it. Unmap before
+	 * calling map again.
+	 */
+	const void *map(int *width, int *height, long *id, bool wait);
+	void unmap();
+
+	bool pending() const;
+};
+
+}	// namespace goatvr
+
+#endif	// READBACK_H_
@@ -0,0 +1,139 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GOATVR_REMOTE_H_
+#define GOATVR_REMOTE_H_
+
+/* Protocol between the remote module (mod_remote.cc) and the goatvrd
+ * compositor daemon. Shared with goatvrd, so it's plain C.
+ *
+ * Clients connect to the daemon's UNIX socket, and get a REMOTE_MSG_HELLO
+ * carrying a read-only shared memory block with the poses (struct
+ * remote_poses), updated by the daemon every frame. A client renders each
+ * frame into its own eye buffer, reads it back asynchronously into one of
+ * REMOTE_FRAME_SLOTS shared memory framebuffers (sent to the daemon once
+ * with REMOTE_MSG_FRAMEBUF), and submits it with REMOTE_MSG_FRAME. The
+ * daemon answers with REMOTE_MSG_RELEASE when it's done with the slot. All
+ * messages are struct remote_msg, file descriptors are passed as
+ * SCM_RIGHTS ancillary data.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define REMOTE_DEF_SOCKET	"/tmp/goatvrd.socket"
+#define REMOTE_FRAME_SLOTS	2
+
+enum {
+	REMOTE_MSG_HELLO,		/* daemon -> client, fd: pose block */
+	REMOTE_MSG_FRAMEBUF,	/* client -> daemon, fd: framebuffer slot */
+	REMOTE_MSG_FRAME,		/* client -> daemon, a new frame is in slot */
+	REMOTE_MSG_RELEASE		/* daemon -> client, slot is free again */
+};
+
+struct remote_msg {
+	uint32_t type;
+	uint32_t slot;
+	uint32_t width, height;	/* both eyes side by side, RGBA, bottom row first */
+	uint64_t frame;
+};
+
+/* Written by the daemon every frame, as a sequence lock: seq is odd while
+ * it's being updated, and readers retry if it's odd, or changed while they
+ * were reading. Distances are in meters.
+ */
+struct remote_poses {
+	volatile uint32_t seq;
+	uint32_t eye_width, eye_height;	/* per-eye framebuffer size at scale 1 */
+	uint64_t frame;
+	float head_pos[3], head_rot[4];
+	float view[2][16];		/* per-eye view matrices, OpenGL order */
+	float fov[2][4];		/* per-eye frustum tangents: left, right, bottom, top */
+};
+
+/* send a message, with an optional file descriptor (-1 for none) */
+static int remote_send(int s, const struct remote_msg *msg, int fd)
+{
+	struct msghdr mh;
+	struct iovec iov;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} cbuf;
+
+	memset(&mh, 0, sizeof mh);
+	iov.iov_base = (void*)msg;
+	iov.iov_len = sizeof *msg;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+
+	if(fd >= 0) {
+		struct cmsghdr *cmsg;
+		memset(&cbuf, 0, sizeof cbuf);
+		mh.msg_control = cbuf.buf;
+		mh.msg_controllen = sizeof cbuf.buf;
+		cmsg = CMSG_FIRSTHDR(&mh);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	}
+	return sendmsg(s, &mh, 0) == (ssize_t)sizeof *msg ? 0 : -1;
+}
+
+/* receive a message, and the file descriptor passed with it in *fd (-1 if
+ * none). Returns 0 on success, 1 if nothing is there on a non-blocking
+ * socket, and -1 on error or if the other end hung up.
+ */
+static int remote_recv(int s, struct remote_msg *msg, int *fd)
+{
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	ssize_t sz;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} cbuf;
+
+	memset(&mh, 0, sizeof mh);
+	iov.iov_base = msg;
+	iov.iov_len = sizeof *msg;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cbuf.buf;
+	mh.msg_controllen = sizeof cbuf.buf;
+
+	*fd = -1;
+	if((sz = recvmsg(s, &mh, MSG_DONTWAIT)) == -1) {
+		return errno == EAGAIN || errno == EWOULDBLOCK ? 1 : -1;
+	}
+	if(sz != (ssize_t)sizeof *msg) {
+		return -1;
+	}
+
+	if((cmsg = CMSG_FIRSTHDR(&mh)) && cmsg->cmsg_level == SOL_SOCKET &&
+			cmsg->cmsg_type == SCM_RIGHTS) {
+		memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+	}
+	return 0;
+}
+
+#endif	/* GOATVR_REMOTE_H_ */
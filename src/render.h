@@ -0,0 +1,76 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include "goatvr_impl.h"
+
+/* VR framebuffer state in goatvr.cc, shared with the rendering features in
+ * their own files (multiview.cc, ...)
+ */
+
+namespace goatvr {
+
+// texture formats for each goatvr_depth_format
+struct DepthFormat {
+	unsigned int ifmt, fmt, type;
+	bool stencil;
+};
+extern const DepthFormat zfmt[];
+
+// user-supplied framebuffer size
+extern int cur_fbwidth, cur_fbheight;
+// application-provided framebuffer, see goatvr_set_fbo
+extern unsigned int user_fbo;
+extern goatvr_depth_format depth_fmt;
+
+extern unsigned int proj_flags;
+extern float clip_near, clip_far;
+
+extern float ident_mat[16];
+
+// the VR framebuffer: the application's, or ours
+unsigned int vr_fbo();
+// the framebuffer the eyes are drawn into
+unsigned int render_fbo();
+
+/* viewport of each eye in the framebuffer it's drawn into: x, y, width, height,
+ * and the extents of both eyes together
+ */
+void get_eye_rect(int eye, int *rect);
+void get_render_size(int *width, int *height);
+
+/* index in zfmt of the depth format of the VR framebuffer. Depth can only be
+ * blitted between identical formats, so the intermediate buffers we blit depth
+ * from or to are allocated in this format. Returns -1 if the application
+ * framebuffer has no depth buffer, or one we don't have a format entry for.
+ */
+int vr_depth_format();
+/* the depth attachment of the application framebuffer, if it's a texture.
+ * Valid after vr_depth_format.
+ */
+unsigned int vr_depth_texture();
+
+/* view matrices and frusta of both eyes, returns the distance of the right
+ * eye from the left eye along the x axis of the left eye
+ */
+float get_stereo_setup(Mat4 *eye_view, EyeFov *fov);
+
+}	// namespace goatvr
+
+#endif	/* RENDER_H_ */
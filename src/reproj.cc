@@ -0,0 +1,417 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include "opengl.h"
+#include "sdr.h"
+#include "modman.h"
+#include "render.h"
+#include "multires.h"
+#include "upscale.h"
+#include "reproj.h"
+
+using namespace goatvr;
+
+/* stereo reprojection: the left eye color and depth are copied to rp_tex and
+ * rp_ztex, and warped to the right eye with a grid of rp_grid_width by
+ * rp_grid_height vertices, one every REPROJ_GRID_STEP pixels. Depth is blitted
+ * if rp_ztex matches the depth format of the VR framebuffer, otherwise it's
+ * copied with rp_zcopy_prog, from the application's depth texture.
+ */
+#define REPROJ_GRID_STEP	2
+#define REPROJ_EDGE_THRES	0.1f
+static int rp_mode;
+static unsigned int rp_fbo, rp_tex, rp_ztex, rp_prog, rp_zcopy_prog, rp_vao;
+static int rp_width, rp_height;
+static int rp_grid_width, rp_grid_height;
+static int rp_zfmt = -1;	// zfmt index of rp_ztex
+static bool rp_zblit;
+static unsigned int rp_zsrc_tex;	// application depth texture, copied with rp_zcopy_prog
+static int rp_zsrc_width, rp_zsrc_height;	// ... and its size
+
+static const char *rp_vsdr =
+	"#version 150\n"
+	"uniform sampler2D depth_tex;\n"
+	"uniform mat4 reproj;\n"		// left eye NDC to right eye clip space
+	"uniform mat4 inv_proj;\n"		// left eye NDC to view space
+	"uniform vec2 grid_size;\n"
+	"uniform vec2 depth_xform;\n"	// depth texture value to NDC z
+	"uniform float edge_thres;\n"	// 0 to skip disocclusion detection
+	"uniform int fill;\n"			// fill disocclusions with the background
+	"out vec2 tc;\n"
+	"out float edge;\n"
+	"const int corner_x[6] = int[6](0, 1, 1, 0, 1, 0);\n"
+	"const int corner_y[6] = int[6](0, 0, 1, 0, 1, 1);\n"
+	"const vec2 nbdir[4] = vec2[4](vec2(1.0, 0.0), vec2(-1.0, 0.0), vec2(0.0, 1.0), vec2(0.0, -1.0));\n"
+	"vec4 ndc_pos(vec2 uv)\n"
+	"{\n"
+	"	float z = texture(depth_tex, uv).x * depth_xform.x + depth_xform.y;\n"
+	"	return vec4(uv * 2.0 - 1.0, z, 1.0);\n"
+	"}\n"
+	"float view_z(vec2 uv)\n"
+	"{\n"
+	"	vec4 p = inv_proj * ndc_pos(uv);\n"
+	"	return p.z / p.w;\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"	int cols = int(grid_size.x) - 1;\n"
+	"	int quad = gl_VertexID / 6;\n"
+	"	int corner = gl_VertexID - quad * 6;\n"
+	"	vec2 gpos = vec2(float(quad % cols + corner_x[corner]), float(quad / cols + corner_y[corner]));\n"
+	"	vec2 dt = 1.0 / (grid_size - 1.0);\n"
+	"	tc = gpos * dt;\n"
+	"	vec4 pos = ndc_pos(tc);\n"
+	"	edge = 0.0;\n"
+	"	if(edge_thres > 0.0) {\n"
+	"		float z = view_z(tc);\n"
+	"		float dz = 0.0, far_z = z;\n"
+	"		vec2 far_tc = tc;\n"
+	"		for(int i=0; i<4; i++) {\n"
+	"			vec2 nbtc = tc + nbdir[i] * dt;\n"
+	"			float nz = view_z(nbtc);\n"
+	"			dz = max(dz, abs(nz - z));\n"
+	"			if(abs(nz) > abs(far_z)) {\n"
+	"				far_z = nz;\n"
+	"				far_tc = nbtc;\n"
+	"			}\n"
+	"		}\n"
+	"		if(dz > edge_thres * abs(z)) {\n"
+	"			if(fill != 0) {\n"
+	/* push the vertices along depth edges back to the background, so that
+	 * the triangles stretched over the disocclusion are behind the
+	 * foreground, and take the background color.
+	 */
+	"				pos.z = ndc_pos(far_tc).z;\n"
+	"				tc = far_tc;\n"
+	"			} else {\n"
+	"				edge = 1.0;\n"
+	"			}\n"
+	"		}\n"
+	"	}\n"
+	"	gl_Position = reproj * pos;\n"
+	"}\n";
+
+static const char *rp_psdr =
+	"#version 150\n"
+	"uniform sampler2D tex;\n"
+	"in vec2 tc;\n"
+	"in float edge;\n"
+	"out vec4 color;\n"
+	"void main()\n"
+	"{\n"
+	"	if(edge > 0.0) discard;\n"
+	"	color = texture(tex, tc);\n"
+	"}\n";
+
+// full viewport quad, to copy depth between incompatible formats
+static const char *rp_zcopy_vsdr =
+	"#version 150\n"
+	"uniform vec4 tc_rect;\n"
+	"out vec2 tc;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 pos = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));\n"
+	"	tc = mix(tc_rect.xy, tc_rect.zw, pos);\n"
+	"	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+static const char *rp_zcopy_psdr =
+	"#version 150\n"
+	"uniform sampler2D depth_tex;\n"
+	"in vec2 tc;\n"
+	"void main()\n"
+	"{\n"
+	"	gl_FragDepth = texture(depth_tex, tc).x;\n"
+	"}\n";
+
+static bool update_reproj()
+{
+	RenderTexture *rtex = display_module->get_render_texture();
+	if(!rtex) {
+		return false;
+	}
+
+	if(!rp_prog) {
+		if(!(rp_prog = create_program_load(rp_vsdr, rp_psdr))) {
+			fprintf(stderr, "goatvr: failed to create the stereo reprojection program, disabling\n");
+			rp_mode = GOATVR_REPROJ_OFF;
+			return false;
+		}
+		glUseProgram(rp_prog);
+		set_uniform_int(rp_prog, "tex", 0);
+		set_uniform_int(rp_prog, "depth_tex", 1);
+		glUseProgram(0);
+	}
+	if(!rp_vao) {
+		glGenVertexArrays(1, &rp_vao);	// attribute-less, vertices from gl_VertexID
+	}
+
+	int rect[4];
+	get_eye_rect(GOATVR_LEFT, rect);
+	int width = rect[2];
+	int height = rect[3];
+	if(width <= 0 || height <= 0) {
+		return false;
+	}
+
+	/* blit depth if we can match the format of the framebuffer we're drawing
+	 * into (the upscale framebuffer is always one of ours), otherwise fall
+	 * back to copying it with a shader, which needs the application's depth
+	 * buffer to be a texture.
+	 */
+	int zf = ups_active ? ups_zfmt : vr_depth_format();
+	rp_zblit = zf >= 0;
+	if(!rp_zblit) {
+		rp_zsrc_tex = vr_depth_texture();
+		if(!rp_zsrc_tex) {
+			fprintf(stderr, "goatvr: can't copy depth out of the application framebuffer for"
+					" stereo reprojection, disabling\n");
+			rp_mode = GOATVR_REPROJ_OFF;
+			return false;
+		}
+		if(!rp_zcopy_prog) {
+			if(!(rp_zcopy_prog = create_program_load(rp_zcopy_vsdr, rp_zcopy_psdr))) {
+				fprintf(stderr, "goatvr: failed to create the depth copy program, disabling stereo reprojection\n");
+				rp_mode = GOATVR_REPROJ_OFF;
+				return false;
+			}
+			glUseProgram(rp_zcopy_prog);
+			set_uniform_int(rp_zcopy_prog, "depth_tex", 0);
+			glUseProgram(0);
+		}
+		glBindTexture(GL_TEXTURE_2D, rp_zsrc_tex);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &rp_zsrc_width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &rp_zsrc_height);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		zf = (int)depth_fmt;
+	}
+
+	if(rp_fbo && width == rp_width && height == rp_height && zf == rp_zfmt) {
+		return true;
+	}
+	rp_width = width;
+	rp_height = height;
+	rp_zfmt = zf;
+	rp_grid_width = rp_width / REPROJ_GRID_STEP + 1;
+	rp_grid_height = rp_height / REPROJ_GRID_STEP + 1;
+
+	if(!rp_fbo) {
+		glGenFramebuffers(1, &rp_fbo);
+		glGenTextures(1, &rp_tex);
+		glGenTextures(1, &rp_ztex);
+
+		unsigned int tex[] = {rp_tex, rp_ztex};
+		for(int i=0; i<2; i++) {
+			glBindTexture(GL_TEXTURE_2D, tex[i]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		}
+	}
+
+	int fidx = rp_zfmt;
+	glBindTexture(GL_TEXTURE_2D, rp_tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, rp_width, rp_height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	glBindTexture(GL_TEXTURE_2D, rp_ztex);
+	glTexImage2D(GL_TEXTURE_2D, 0, zfmt[fidx].ifmt, rp_width, rp_height, 0, zfmt[fidx].fmt,
+			zfmt[fidx].type, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, rp_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rp_tex, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, rp_ztex, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D,
+			zfmt[fidx].stencil ? rp_ztex : 0, 0);
+
+	GLenum fbst = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, render_fbo());
+	if(fbst != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "goatvr: incomplete reprojection framebuffer! (status: %x)\n", (unsigned int)fbst);
+		destroy_reproj();
+		return false;
+	}
+	return true;
+}
+
+void goatvr::destroy_reproj()
+{
+	if(rp_fbo) {
+		glDeleteFramebuffers(1, &rp_fbo);
+		glDeleteTextures(1, &rp_tex);
+		glDeleteTextures(1, &rp_ztex);
+		rp_fbo = rp_tex = rp_ztex = 0;
+	}
+	rp_width = rp_height = 0;
+	rp_zfmt = -1;
+
+	if(rp_prog) {
+		free_program(rp_prog);
+		rp_prog = 0;
+	}
+	if(rp_zcopy_prog) {
+		free_program(rp_zcopy_prog);
+		rp_zcopy_prog = 0;
+	}
+	if(rp_vao) {
+		glDeleteVertexArrays(1, &rp_vao);
+		rp_vao = 0;
+	}
+}
+
+/* Warp the left eye into the right eye viewport (set by goatvr_draw_eye), with
+ * a grid mesh displaced by the left eye depth. The VR framebuffer textures
+ * can't be sampled while we're rendering into them, so the left eye is copied
+ * out first.
+ */
+static void draw_reproj()
+{
+	unsigned int vrfbo = render_fbo();
+
+	int rect[4];
+	get_eye_rect(GOATVR_LEFT, rect);
+	int x = rect[0];
+	int y = rect[1];
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, vrfbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, rp_fbo);
+	glBlitFramebuffer(x, y, x + rp_width, y + rp_height, 0, 0, rp_width, rp_height,
+			rp_zblit ? GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT : GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	if(!rp_zblit) {
+		push_gl_state();
+
+		glUseProgram(rp_zcopy_prog);
+		glBindVertexArray(rp_vao);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, rp_zsrc_tex);
+		set_uniform_float4(rp_zcopy_prog, "tc_rect", (float)x / rp_zsrc_width,
+				(float)y / rp_zsrc_height, (float)(x + rp_width) / rp_zsrc_width,
+				(float)(y + rp_height) / rp_zsrc_height);
+
+		glViewport(0, 0, rp_width, rp_height);
+		glDisable(GL_BLEND);
+		glDisable(GL_CULL_FACE);
+		glDisable(GL_SCISSOR_TEST);
+		glDisable(GL_STENCIL_TEST);
+		glColorMask(0, 0, 0, 0);
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_ALWAYS);
+		glDepthMask(1);
+
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+		pop_gl_state();
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, vrfbo);
+
+	// left eye NDC -> left eye view -> world -> right eye view -> right eye clip
+	Mat4 lview, rview, lproj, rproj;
+	display_module->get_view_matrix(lview, GOATVR_LEFT);
+	display_module->get_view_matrix(rview, GOATVR_RIGHT);
+	display_module->get_proj_matrix(lproj, GOATVR_LEFT, clip_near, clip_far, proj_flags);
+	display_module->get_proj_matrix(rproj, GOATVR_RIGHT, clip_near, clip_far, proj_flags);
+	Mat4 inv_lproj = inverse(lproj);
+	Mat4 reproj = inv_lproj * inverse(lview) * rview * rproj;
+
+	bool zero_to_one = (proj_flags & GOATVR_PROJ_REVERSE_Z) && glcaps.clip_control;
+	bool stencil = rp_mode == GOATVR_REPROJ_STENCIL;
+
+	push_gl_state();
+
+	glUseProgram(rp_prog);
+	glBindVertexArray(rp_vao);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, rp_ztex);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, rp_tex);
+
+	set_uniform_matrix4(rp_prog, "reproj", reproj[0]);
+	set_uniform_matrix4(rp_prog, "inv_proj", inv_lproj[0]);
+	set_uniform_float2(rp_prog, "grid_size", rp_grid_width, rp_grid_height);
+	set_uniform_float2(rp_prog, "depth_xform", zero_to_one ? 1.0f : 2.0f, zero_to_one ? 0.0f : -1.0f);
+	set_uniform_float(rp_prog, "edge_thres", REPROJ_EDGE_THRES);
+	set_uniform_int(rp_prog, "fill", stencil ? 0 : 1);
+
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glColorMask(1, 1, 1, 1);
+	glEnable(GL_FRAMEBUFFER_SRGB);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(proj_flags & GOATVR_PROJ_REVERSE_Z ? GL_GEQUAL : GL_LEQUAL);
+	glDepthMask(1);
+
+	if(stencil) {
+		// mark the whole right eye as a hole, and clear the mark wherever we draw
+		int vp[4], clear_val;
+		glGetIntegerv(GL_VIEWPORT, vp);
+		glGetIntegerv(GL_STENCIL_CLEAR_VALUE, &clear_val);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(vp[0], vp[1], vp[2], vp[3]);
+		glStencilMask(0xff);
+		glClearStencil(1);
+		glClear(GL_STENCIL_BUFFER_BIT);
+		glClearStencil(clear_val);
+
+		glEnable(GL_STENCIL_TEST);
+		glStencilFunc(GL_ALWAYS, 0, 0xff);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+	} else {
+		glDisable(GL_SCISSOR_TEST);
+		glDisable(GL_STENCIL_TEST);
+	}
+
+	glDrawArrays(GL_TRIANGLES, 0, (rp_grid_width - 1) * (rp_grid_height - 1) * 6);
+
+	pop_gl_state();
+}
+
+extern "C" {
+
+int goatvr_set_reprojection(int mode)
+{
+	if(mode != GOATVR_REPROJ_OFF && !glcaps.shaders) {
+		fprintf(stderr, "goatvr: can't enable stereo reprojection, needs OpenGL 3.2\n");
+		return -1;
+	}
+	if(mode == GOATVR_REPROJ_STENCIL && !user_fbo && !zfmt[depth_fmt].stencil) {
+		fprintf(stderr, "goatvr: stereo reprojection stencil mode needs a depth format with stencil\n");
+	}
+	rp_mode = mode;
+	if(!rp_mode) {
+		destroy_reproj();
+	}
+	return 0;
+}
+
+int goatvr_get_reprojection(void)
+{
+	return rp_mode;
+}
+
+int goatvr_reproject_eye(void)
+{
+	if(!display_module || !rp_mode || mr_active || !update_reproj()) {
+		return -1;
+	}
+
+	goatvr_draw_eye(GOATVR_RIGHT);
+	draw_reproj();
+	return rp_mode == GOATVR_REPROJ_STENCIL ? 1 : 0;
+}
+
+}	// extern "C"
@@ -0,0 +1,31 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef REPROJ_H_
+#define REPROJ_H_
+
+/* stereo reprojection of the left eye to the right eye, by goatvr_reproject_eye
+ * (see goatvr_set_reprojection).
+ */
+
+namespace goatvr {
+
+void destroy_reproj();
+
+}	// namespace goatvr
+
+#endif	/* REPROJ_H_ */
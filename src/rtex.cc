@@ -16,6 +16,7 @@ You should have received a copy of the GNU Lesser General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <stdio.h>
+#include <algorithm>
 #include "opengl.h"
 #include "rtex.h"
 #include "goatvr_impl.h"
@@ -27,6 +28,8 @@ RenderTexture::RenderTexture()
 	tex = 0;
 	width = height = 0;
 	tex_width = tex_height = 0;
+	external = false;
+	alpha = false;
 
 	for(int i=0; i<2; i++) {
 		eye_xoffs[i] = eye_yoffs[i] = 0;
@@ -35,13 +38,66 @@ RenderTexture::RenderTexture()
 	}
 }
 
+void RenderTexture::destroy()
+{
+	if(tex && !external) {
+		glDeleteTextures(1, &tex);
+		tex = 0;
+	}
+}
+
+void RenderTexture::set_external(unsigned int xtex, int tex_xsz, int tex_ysz)
+{
+	destroy();
+	tex = xtex;
+	tex_width = tex_xsz;
+	tex_height = tex_ysz;
+	external = xtex != 0;
+}
+
 void RenderTexture::update(int xsz, int ysz)
+{
+	update(xsz, ysz, xsz, ysz);
+}
+
+void RenderTexture::update(int xsz, int ysz, int alloc_xsz, int alloc_ysz)
 {
 	width = xsz;
 	height = ysz;
 
-	int new_tex_width = next_pow2(xsz);
-	int new_tex_height = next_pow2(ysz);
+	if(external) {
+		if(xsz > tex_width || ysz > tex_height) {
+			fprintf(stderr, "goatvr: external texture (%dx%d) too small for %dx%d framebuffer\n",
+					tex_width, tex_height, xsz, ysz);
+		}
+		return;
+	}
+
+	int new_tex_width = next_pow2(std::max(xsz, alloc_xsz));
+	int new_tex_height = next_pow2(std::max(ysz, alloc_ysz));
+
+	if(glcaps.dsa) {
+		if(tex && tex_width == new_tex_width && tex_height == new_tex_height) {
+			return;
+		}
+		tex_width = new_tex_width;
+		tex_height = new_tex_height;
+
+		/* immutable storage can't be respecified, so we need a new texture
+		 * every time the size changes, but it saves the driver from validating
+		 * it every time it's used. Also the DSA calls leave the texture binding
+		 * of the application alone.
+		 */
+		printf("goatvr: creating %dx%d texture for %dx%d framebuffer\n", tex_width, tex_height, xsz, ysz);
+		if(tex) {
+			glDeleteTextures(1, &tex);
+		}
+		glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+		glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureStorage2D(tex, 1, alpha ? GL_SRGB8_ALPHA8 : GL_SRGB8, tex_width, tex_height);
+		return;
+	}
 
 	if(!tex) {
 		glGenTextures(1, &tex);
@@ -57,6 +113,7 @@ void RenderTexture::update(int xsz, int ysz)
 
 		printf("goatvr: creating %dx%d texture for %dx%d framebuffer\n", tex_width, tex_height, xsz, ysz);
 		glBindTexture(GL_TEXTURE_2D, tex);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, tex_width, tex_height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+		glTexImage2D(GL_TEXTURE_2D, 0, alpha ? GL_SRGB_ALPHA : GL_SRGB, tex_width, tex_height, 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, 0);
 	}
 }
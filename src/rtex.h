@@ -28,10 +28,24 @@ public:
 	int eye_xoffs[2], eye_yoffs[2];
 	int eye_width[2], eye_height[2];
 	float fbscale;
+	bool external;	// tex was provided by the application, not allocated by us
+	bool alpha;		// allocate with an alpha channel (set before the first update)
 
 	RenderTexture();
 
+	// delete the texture, unless it's external (which is kept)
+	void destroy();
+	/* use an application-provided texture of the given size, instead of
+	 * allocating one in update. Passing 0 reverts to allocating our own.
+	 */
+	void set_external(unsigned int tex, int tex_xsz, int tex_ysz);
+
+	/* xsz/ysz is the size of the part of the texture used for rendering, while
+	 * alloc_xsz/alloc_ysz is the minimum size to allocate, so that later
+	 * resolution changes up to that size can be done without reallocating.
+	 */
 	void update(int xsz, int ysz);
+	void update(int xsz, int ysz, int alloc_xsz, int alloc_ysz);
 };
 
 }	// namespace goatvr
@@ -0,0 +1,155 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "opengl.h"
+#include "sdr.h"
+
+using namespace goatvr;
+
+unsigned int goatvr::create_vertex_shader(const char *src)
+{
+	return create_shader(src, GL_VERTEX_SHADER);
+}
+
+unsigned int goatvr::create_pixel_shader(const char *src)
+{
+	return create_shader(src, GL_FRAGMENT_SHADER);
+}
+
+unsigned int goatvr::create_shader(const char *src, unsigned int sdr_type)
+{
+	unsigned int sdr = glCreateShader(sdr_type);
+	glShaderSource(sdr, 1, &src, 0);
+	glCompileShader(sdr);
+
+	int status, loglen;
+	glGetShaderiv(sdr, GL_COMPILE_STATUS, &status);
+	glGetShaderiv(sdr, GL_INFO_LOG_LENGTH, &loglen);
+
+	if(loglen > 1) {
+		char *buf = (char*)malloc(loglen + 1);
+		if(buf) {
+			glGetShaderInfoLog(sdr, loglen, 0, buf);
+			buf[loglen] = 0;
+			fprintf(stderr, "goatvr: %s shader compilation %s:\n%s\n",
+					sdr_type == GL_VERTEX_SHADER ? "vertex" : "pixel",
+					status ? "warnings" : "failed", buf);
+			free(buf);
+		}
+	}
+
+	if(!status) {
+		glDeleteShader(sdr);
+		return 0;
+	}
+	return sdr;
+}
+
+void goatvr::free_shader(unsigned int sdr)
+{
+	glDeleteShader(sdr);
+}
+
+unsigned int goatvr::create_program_link(unsigned int vsdr, unsigned int psdr)
+{
+	unsigned int prog = glCreateProgram();
+	glAttachShader(prog, vsdr);
+	glAttachShader(prog, psdr);
+	glLinkProgram(prog);
+
+	int status, loglen;
+	glGetProgramiv(prog, GL_LINK_STATUS, &status);
+	glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &loglen);
+
+	if(loglen > 1) {
+		char *buf = (char*)malloc(loglen + 1);
+		if(buf) {
+			glGetProgramInfoLog(prog, loglen, 0, buf);
+			buf[loglen] = 0;
+			fprintf(stderr, "goatvr: shader program linking %s:\n%s\n", status ? "warnings" : "failed", buf);
+			free(buf);
+		}
+	}
+
+	if(!status) {
+		glDeleteProgram(prog);
+		return 0;
+	}
+	return prog;
+}
+
+unsigned int goatvr::create_program_load(const char *vsrc, const char *psrc)
+{
+	unsigned int vsdr, psdr, prog = 0;
+
+	if(!(vsdr = create_vertex_shader(vsrc))) {
+		return 0;
+	}
+	if((psdr = create_pixel_shader(psrc))) {
+		prog = create_program_link(vsdr, psdr);
+		free_shader(psdr);
+	}
+	free_shader(vsdr);	// deletion is deferred until the program is deleted
+	return prog;
+}
+
+void goatvr::free_program(unsigned int prog)
+{
+	glDeleteProgram(prog);
+}
+
+bool goatvr::set_uniform_int(unsigned int prog, const char *name, int val)
+{
+	int loc = glGetUniformLocation(prog, name);
+	if(loc == -1) return false;
+	glUniform1i(loc, val);
+	return true;
+}
+
+bool goatvr::set_uniform_float(unsigned int prog, const char *name, float val)
+{
+	int loc = glGetUniformLocation(prog, name);
+	if(loc == -1) return false;
+	glUniform1f(loc, val);
+	return true;
+}
+
+bool goatvr::set_uniform_float2(unsigned int prog, const char *name, float x, float y)
+{
+	int loc = glGetUniformLocation(prog, name);
+	if(loc == -1) return false;
+	glUniform2f(loc, x, y);
+	return true;
+}
+
+bool goatvr::set_uniform_float4(unsigned int prog, const char *name, float x, float y, float z, float w)
+{
+	int loc = glGetUniformLocation(prog, name);
+	if(loc == -1) return false;
+	glUniform4f(loc, x, y, z, w);
+	return true;
+}
+
+bool goatvr::set_uniform_matrix4(unsigned int prog, const char *name, const float *mat)
+{
+	int loc = glGetUniformLocation(prog, name);
+	if(loc == -1) return false;
+	glUniformMatrix4fv(loc, 1, GL_FALSE, mat);
+	return true;
+}
@@ -0,0 +1,48 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SDR_H_
+#define SDR_H_
+
+/* Shader helpers for the internal drawing done by goatvr (compositing, mirror,
+ * etc). All internal shaders target GLSL 1.50, check glcaps.shaders first.
+ * Compile and link errors are printed to stderr, and 0 is returned.
+ */
+
+namespace goatvr {
+
+unsigned int create_vertex_shader(const char *src);
+unsigned int create_pixel_shader(const char *src);
+unsigned int create_shader(const char *src, unsigned int sdr_type);
+void free_shader(unsigned int sdr);
+
+// link a program out of a vertex and a pixel shader
+unsigned int create_program_link(unsigned int vsdr, unsigned int psdr);
+// compile both shaders and link them, the shader objects are freed afterwards
+unsigned int create_program_load(const char *vsrc, const char *psrc);
+void free_program(unsigned int prog);
+
+// the set_uniform functions expect the program to be bound
+bool set_uniform_int(unsigned int prog, const char *name, int val);
+bool set_uniform_float(unsigned int prog, const char *name, float val);
+bool set_uniform_float2(unsigned int prog, const char *name, float x, float y);
+bool set_uniform_float4(unsigned int prog, const char *name, float x, float y, float z, float w);
+bool set_uniform_matrix4(unsigned int prog, const char *name, const float *mat);
+
+}	// namespace goatvr
+
+#endif	/* SDR_H_ */
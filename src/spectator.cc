@@ -0,0 +1,297 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <deque>
+#include <algorithm>
+#include <string>
+#include <atomic>
+#include "opengl.h"
+#include "spectator.h"
+#include "readback.h"
+#include "rtex.h"
+#include "goatvr.h"
+#include "goatvr_spectator.h"
+
+#if defined(__unix__)
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#endif
+
+#define MAX_SPEC_SIZE	16384
+
+using namespace goatvr;
+
+// frame metadata, kept until its readback completes
+struct SpecFrame {
+	long id;
+	uint32_t source;
+	uint64_t time_ns;
+	float head_pos[3], head_rot[4];
+	float view[2][16];
+	int32_t eye_rect[2][4];
+};
+
+static void publish();
+static void write_slot(const SpecFrame &frm, const void *pixels, int width, int height);
+static uint64_t time_nsec();
+
+static goatvr_spectator_header *spec_hdr;
+static std::string spec_name;
+static std::deque<SpecFrame> spec_pending;
+static long spec_seq;
+static Readback readback;
+
+// spectator camera view for the next frame, see goatvr_spectator_camera
+static unsigned int cam_tex;
+static int cam_width, cam_height;
+static float cam_view[16];
+
+void goatvr::destroy_spectator()
+{
+	goatvr_spectator_stop();
+}
+
+void goatvr::spectator_frame(const RenderTexture *rtex)
+{
+	if(!spec_hdr) {
+		cam_tex = 0;
+		return;
+	}
+	publish();
+
+	SpecFrame frm;
+	memset(&frm, 0, sizeof frm);
+	frm.time_ns = time_nsec();
+	goatvr_head_position(frm.head_pos);
+	goatvr_head_orientation(frm.head_rot);
+
+	unsigned int tex;
+	int tex_width, tex_height;
+	const RenderTexture *layout;
+	if(cam_tex) {
+		frm.source = GOATVR_SPECTATOR_CAMERA;
+		memcpy(frm.view[0], cam_view, sizeof cam_view);
+		tex = cam_tex;
+		tex_width = cam_width;
+		tex_height = cam_height;
+		layout = 0;
+		cam_tex = 0;
+	} else {
+		frm.source = GOATVR_SPECTATOR_MIRROR;
+		for(int i=0; i<2; i++) {
+			memcpy(frm.view[i], goatvr_view_matrix(i), sizeof frm.view[i]);
+		}
+		tex = rtex->tex;
+		tex_width = rtex->width;
+		tex_height = rtex->height;
+		layout = rtex;
+	}
+
+	// fit in the slot size, keeping the aspect ratio
+	float scale = 1.0f;
+	if(tex_width > (int)spec_hdr->max_width) {
+		scale = (float)spec_hdr->max_width / (float)tex_width;
+	}
+	if(tex_height * scale > spec_hdr->max_height) {
+		scale = (float)spec_hdr->max_height / (float)tex_height;
+	}
+	int width = std::max((int)(tex_width * scale), 1);
+	int height = std::max((int)(tex_height * scale), 1);
+
+	if(layout) {
+		for(int i=0; i<2; i++) {
+			frm.eye_rect[i][0] = (int)(rtex->eye_xoffs[i] * scale + 0.5f);
+			frm.eye_rect[i][1] = (int)(rtex->eye_yoffs[i] * scale + 0.5f);
+			frm.eye_rect[i][2] = (int)((rtex->eye_xoffs[i] + rtex->eye_width[i]) * scale + 0.5f) - frm.eye_rect[i][0];
+			frm.eye_rect[i][3] = (int)((rtex->eye_yoffs[i] + rtex->eye_height[i]) * scale + 0.5f) - frm.eye_rect[i][1];
+		}
+	}
+
+	// skipped if all the readback buffers are still in flight
+	if(readback.read_scaled(tex, tex_width, tex_height, width, height, spec_seq, layout)) {
+		frm.id = spec_seq++;
+		spec_pending.push_back(frm);
+	}
+}
+
+// write all the frames whose readback has completed to the ring
+static void publish()
+{
+	int width, height;
+	long id;
+	const void *pixels;
+
+	while((pixels = readback.map(&width, &height, &id, false))) {
+		// older ones can only be missing if their buffer failed to map
+		while(!spec_pending.empty() && spec_pending.front().id < id) {
+			spec_pending.pop_front();
+		}
+		if(!spec_pending.empty() && spec_pending.front().id == id) {
+			write_slot(spec_pending.front(), pixels, width, height);
+			spec_pending.pop_front();
+		}
+		readback.unmap();
+	}
+}
+
+static void write_slot(const SpecFrame &frm, const void *pixels, int width, int height)
+{
+	uint64_t fid = spec_hdr->latest;
+	goatvr_spectator_frame *slot = spec_hdr->slot + fid % spec_hdr->num_slots;
+
+	slot->seq++;
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot->source = frm.source;
+	slot->width = width;
+	slot->height = height;
+	slot->frame = fid;
+	slot->time_ns = frm.time_ns;
+	memcpy(slot->head_pos, frm.head_pos, sizeof slot->head_pos);
+	memcpy(slot->head_rot, frm.head_rot, sizeof slot->head_rot);
+	memcpy(slot->view, frm.view, sizeof slot->view);
+	memcpy(slot->eye_rect, frm.eye_rect, sizeof slot->eye_rect);
+	memcpy((char*)spec_hdr + slot->offset, pixels, width * height * 4);
+
+	std::atomic_thread_fence(std::memory_order_release);
+	slot->seq++;
+	std::atomic_thread_fence(std::memory_order_release);
+	spec_hdr->latest = fid + 1;
+}
+
+#if defined(__unix__)
+static uint64_t time_nsec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#else
+static uint64_t time_nsec()
+{
+	return 0;
+}
+#endif
+
+extern "C" {
+
+int goatvr_spectator_start(const char *name, int max_width, int max_height)
+{
+#if defined(__unix__)
+	goatvr_spectator_stop();
+
+	if(!name) name = GOATVR_SPECTATOR_DEF_NAME;
+	if(max_width <= 0 || max_height <= 0) {
+		fprintf(stderr, "goatvr: invalid spectator frame size: %dx%d\n", max_width, max_height);
+		return -1;
+	}
+	if(!glcaps.sync) {
+		fprintf(stderr, "goatvr: spectator output needs fence sync objects (GL 3.2 or ARB_sync)\n");
+		return -1;
+	}
+
+	// the header stores the size and slot offsets in 32 bits
+	uint64_t hdrsize = (sizeof(goatvr_spectator_header) + 4095) & ~4095;
+	uint64_t slotsize = (uint64_t)max_width * (uint64_t)max_height * 4;
+	uint64_t size = hdrsize + slotsize * GOATVR_SPECTATOR_SLOTS;
+	if(max_width > MAX_SPEC_SIZE || max_height > MAX_SPEC_SIZE || size > UINT32_MAX) {
+		fprintf(stderr, "goatvr: spectator frame size too large: %dx%d\n", max_width, max_height);
+		return -1;
+	}
+
+	/* don't take over shared memory of another instance, or of a reader's
+	 * idea of one; a stale name left by a crashed process must be removed
+	 * with shm_unlink (or by deleting it from /dev/shm) first.
+	 * readers map it read-only.
+	 */
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if(fd == -1) {
+		if(errno == EEXIST) {
+			fprintf(stderr, "goatvr: spectator shared memory %s already exists (in use, or left by a crashed process)\n", name);
+		} else {
+			fprintf(stderr, "goatvr: failed to create spectator shared memory %s: %s\n", name, strerror(errno));
+		}
+		return -1;
+	}
+	void *mem = MAP_FAILED;
+	if(ftruncate(fd, size) != -1) {
+		mem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if(mem == MAP_FAILED) {
+		fprintf(stderr, "goatvr: failed to map spectator shared memory %s: %s\n", name, strerror(errno));
+		shm_unlink(name);
+		return -1;
+	}
+
+	goatvr_spectator_header *hdr = (goatvr_spectator_header*)mem;
+	memset(hdr, 0, sizeof *hdr);
+	hdr->version = GOATVR_SPECTATOR_VERSION;
+	hdr->size = (uint32_t)size;
+	hdr->num_slots = GOATVR_SPECTATOR_SLOTS;
+	hdr->max_width = max_width;
+	hdr->max_height = max_height;
+	for(int i=0; i<GOATVR_SPECTATOR_SLOTS; i++) {
+		hdr->slot[i].offset = (uint32_t)(hdrsize + i * slotsize);
+	}
+	// readers check the magic number last, to see that the header is valid
+	std::atomic_thread_fence(std::memory_order_release);
+	hdr->magic = GOATVR_SPECTATOR_MAGIC;
+
+	spec_hdr = hdr;
+	spec_name = name;
+	return 0;
+#else
+	fprintf(stderr, "goatvr: spectator output is not supported on this platform\n");
+	return -1;
+#endif
+}
+
+void goatvr_spectator_stop(void)
+{
+	readback.destroy();
+	spec_pending.clear();
+	cam_tex = 0;
+
+#if defined(__unix__)
+	if(spec_hdr) {
+		munmap(spec_hdr, spec_hdr->size);
+		shm_unlink(spec_name.c_str());
+		spec_hdr = 0;
+	}
+#endif
+}
+
+void goatvr_spectator_camera(unsigned int tex, int width, int height, const float *view_mat)
+{
+	cam_tex = tex;
+	cam_width = width;
+	cam_height = height;
+	if(view_mat) {
+		memcpy(cam_view, view_mat, sizeof cam_view);
+	} else {
+		memset(cam_view, 0, sizeof cam_view);
+		cam_view[0] = cam_view[5] = cam_view[10] = cam_view[15] = 1.0f;
+	}
+}
+
+}	// extern "C"
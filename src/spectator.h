@@ -0,0 +1,38 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SPECTATOR_H_
+#define SPECTATOR_H_
+
+/* Spectator output (see goatvr_spectator_start). Frames are read back
+ * asynchronously, downscaled to fit the ring, and published in a POSIX shared
+ * memory frame ring (include/goatvr_spectator.h) as soon as the readback
+ * completes, a few frames later.
+ */
+
+namespace goatvr {
+
+class RenderTexture;
+
+void destroy_spectator();
+
+// publish completed frames, and queue this one. Called by goatvr_draw_done.
+void spectator_frame(const RenderTexture *rtex);
+
+}	// namespace goatvr
+
+#endif	// SPECTATOR_H_
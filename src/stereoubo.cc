@@ -0,0 +1,369 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "opengl.h"
+#include "modman.h"
+#include "render.h"
+#include "jitter.h"
+#include "farlayer.h"
+#include "multires.h"
+#include "stereoubo.h"
+
+using namespace goatvr;
+
+/* uniform buffer with the per-eye matrices for instanced stereo, updated by
+ * goatvr_draw_start. The layout must match the std140 block documented in
+ * goatvr.h.
+ */
+struct StereoUniforms {
+	float view[2][16];
+	float proj[2][16];
+	float viewproj[2][16];
+	float viewport[2][4];
+	float clip_xform[2][4];
+};
+static unsigned int stereo_ubo;
+static int inst_mode;	// instanced stereo mode set up for this frame
+
+/* late latching: the stereo UBO is filled by a GPU copy at the start of each
+ * frame, out of a ring of LATCH_SLOTS staging copies in a persistently mapped
+ * buffer. goatvr_draw_done rewrites the current slot with a fresh pose, if the
+ * fence after the copy shows the GPU didn't get to it yet. The UBO is copied
+ * back to the second half of the buffer after each frame's copy, to find out
+ * which of the two poses the GPU actually picked up, once its fence signals.
+ * We never wait for the GPU: if it's LATCH_SLOTS frames behind, the frame is
+ * uploaded without latching instead.
+ */
+#define LATCH_SLOTS		3
+enum { LATCH_NONE, LATCH_SKIPPED, LATCH_WRITTEN };
+static bool latch_enabled;
+static unsigned int latch_buf;
+static StereoUniforms *latch_map;
+static GLsync latch_fence[LATCH_SLOTS];
+static int latch_state[LATCH_SLOTS];	// what late_latch_poses did with each slot, until verified
+static int latch_slot;
+static bool latch_pending;	// the copy for this frame was issued by goatvr_draw_start
+static bool latched;		// the last verified frame was drawn with late-latched poses
+
+static void calc_stereo_uniforms(StereoUniforms *u);
+static bool update_latch();
+static bool latch_copied(int slot);
+static void verify_latches();
+
+void goatvr::update_stereo_ubo()
+{
+	if(!stereo_ubo) return;
+
+	int next = (latch_slot + 1) % LATCH_SLOTS;
+	if(latch_enabled && update_latch() && (!latch_fence[next] || latch_copied(next))) {
+		verify_latches();	// done with the slot we're about to reuse
+		latch_slot = next;
+		if(latch_fence[latch_slot]) {
+			glDeleteSync(latch_fence[latch_slot]);
+		}
+
+		calc_stereo_uniforms(latch_map + latch_slot);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, latch_buf);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, stereo_ubo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+				latch_slot * sizeof(StereoUniforms), 0, sizeof(StereoUniforms));
+		// ... and back, for late_latch_poses to check what the copy got
+		glCopyBufferSubData(GL_COPY_WRITE_BUFFER, GL_COPY_READ_BUFFER, 0,
+				(LATCH_SLOTS + latch_slot) * sizeof(StereoUniforms), sizeof(StereoUniforms));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		latch_fence[latch_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		latch_pending = true;
+		return;
+	}
+
+	StereoUniforms u;
+	calc_stereo_uniforms(&u);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, stereo_ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof u, &u);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+static void calc_stereo_uniforms(StereoUniforms *u)
+{
+	Mat4 view, proj;
+
+	RenderTexture *rtex = display_module ? display_module->get_render_texture() : 0;
+
+	for(int i=0; i<2; i++) {
+		if(display_module) {
+			display_module->get_view_matrix(view, i);
+			display_module->get_proj_matrix(proj, i, clip_near, clip_far, proj_flags);
+			jitter_eye_proj(proj, i);
+		} else {
+			view = proj = Mat4::identity;
+		}
+		Mat4 viewproj = view * proj;
+
+		memcpy(u->view[i], view[0], sizeof u->view[i]);
+		memcpy(u->proj[i], proj[0], sizeof u->proj[i]);
+		memcpy(u->viewproj[i], viewproj[0], sizeof u->viewproj[i]);
+
+		float *vp = u->viewport[i];
+		float *cx = u->clip_xform[i];
+		if(rtex) {
+			int rect[4], width, height;
+			get_eye_rect(i, rect);
+			get_render_size(&width, &height);
+			vp[0] = rect[0];
+			vp[1] = rect[1];
+			vp[2] = rect[2];
+			vp[3] = rect[3];
+
+			/* maps the clip-space xy of this eye from its own viewport, to the
+			 * viewport covering both eyes set by goatvr_draw_instanced_stereo
+			 */
+			float fbw = width > 0 ? width : 1;
+			float fbh = height > 0 ? height : 1;
+			cx[0] = vp[2] / fbw;
+			cx[1] = vp[3] / fbh;
+			cx[2] = (2.0f * vp[0] + vp[2]) / fbw - 1.0f;
+			cx[3] = (2.0f * vp[1] + vp[3]) / fbh - 1.0f;
+		} else {
+			vp[0] = i == 0 ? 0 : cur_fbwidth / 2;
+			vp[1] = 0;
+			vp[2] = cur_fbwidth / 2;
+			vp[3] = cur_fbheight;
+
+			cx[0] = 0.5f;
+			cx[1] = 1.0f;
+			cx[2] = i == 0 ? -0.5f : 0.5f;
+			cx[3] = 0.0f;
+		}
+	}
+}
+
+static bool update_latch()
+{
+	if(latch_buf) return true;
+
+	unsigned int flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+		GL_MAP_COHERENT_BIT;
+	GLsizeiptr size = LATCH_SLOTS * 2 * sizeof(StereoUniforms);
+
+	glGenBuffers(1, &latch_buf);
+	glBindBuffer(GL_COPY_READ_BUFFER, latch_buf);
+	glBufferStorage(GL_COPY_READ_BUFFER, size, 0, flags);
+	latch_map = (StereoUniforms*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, flags);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	if(!latch_map) {
+		fprintf(stderr, "goatvr: failed to map the late latching buffer, disabling late latching\n");
+		glDeleteBuffers(1, &latch_buf);
+		latch_buf = 0;
+		latch_enabled = false;
+		return false;
+	}
+	return true;
+}
+
+void goatvr::destroy_latch()
+{
+	for(int i=0; i<LATCH_SLOTS; i++) {
+		if(latch_fence[i]) {
+			glDeleteSync(latch_fence[i]);
+			latch_fence[i] = 0;
+		}
+	}
+	if(latch_buf) {
+		// deleting a buffer implicitly unmaps it
+		glDeleteBuffers(1, &latch_buf);
+		latch_buf = 0;
+		latch_map = 0;
+	}
+	for(int i=0; i<LATCH_SLOTS; i++) {
+		latch_state[i] = LATCH_NONE;
+	}
+	latch_pending = false;
+	latched = false;
+}
+
+// the GPU is done with the copies of slot, without waiting for it
+static bool latch_copied(int slot)
+{
+	return glClientWaitSync(latch_fence[slot], 0, 0) != GL_TIMEOUT_EXPIRED;
+}
+
+/* check the copy-back of each frame the GPU got through, oldest first, to
+ * find out if it picked up the late-latched poses, or the ones it had before.
+ */
+static void verify_latches()
+{
+	for(int i=1; i<=LATCH_SLOTS; i++) {
+		int slot = (latch_slot + i) % LATCH_SLOTS;
+		if(latch_state[slot] == LATCH_WRITTEN) {
+			if(!latch_copied(slot)) break;
+
+			const StereoUniforms *used = latch_map + LATCH_SLOTS + slot;
+			latched = memcmp(used->viewproj, latch_map[slot].viewproj, sizeof used->viewproj) == 0;
+		} else if(latch_state[slot] == LATCH_SKIPPED) {
+			latched = false;
+		}
+		latch_state[slot] = LATCH_NONE;
+	}
+}
+
+/* called by goatvr_draw_done, as late as possible before the frame is
+ * submitted, to give the GPU the least time to get to the copy before the
+ * fresh pose lands in the slot. An unsignaled fence doesn't guarantee the copy
+ * will see it: the driver might submit queued work at any point, and coherent
+ * writes are only guaranteed visible to commands issued after them. So the
+ * copy-back is checked, without waiting: right away if the GPU got to the
+ * copy in the meantime, in which case the display module reverts to the poses
+ * the frame was drawn with, or otherwise by the next frames, which is what
+ * goatvr_late_latched reports.
+ */
+void goatvr::late_latch_poses()
+{
+	verify_latches();
+
+	if(!latch_pending) return;
+	latch_pending = false;
+
+	if(latch_copied(latch_slot) || !display_module->late_latch()) {
+		// too late, this frame is drawn with the poses of goatvr_draw_start
+		latch_state[latch_slot] = LATCH_SKIPPED;
+		return;
+	}
+
+	StereoUniforms u;
+	calc_stereo_uniforms(&u);
+	StereoUniforms *slot = latch_map + latch_slot;
+	for(int i=0; i<2; i++) {
+		memcpy(slot->view[i], u.view[i], sizeof u.view[i]);
+		memcpy(slot->viewproj[i], u.viewproj[i], sizeof u.viewproj[i]);
+	}
+	latch_state[latch_slot] = LATCH_WRITTEN;
+
+	if(latch_copied(latch_slot)) {
+		// the GPU got to the copy while we were writing the slot
+		verify_latches();
+		if(!latched) {
+			display_module->unlatch();
+		}
+	}
+
+	// the motion vectors of the next frame must be relative to the pose we used
+	jitter_update_view();
+}
+
+void goatvr::instanced_stereo_done()
+{
+	if(inst_mode == GOATVR_STEREO_CLIP_DISTANCE) {
+		for(int i=0; i<4; i++) {
+			glDisable(GL_CLIP_DISTANCE0 + i);
+		}
+	}
+	inst_mode = 0;
+}
+
+void goatvr::destroy_stereo_ubo()
+{
+	destroy_latch();
+	if(stereo_ubo) {
+		glDeleteBuffers(1, &stereo_ubo);
+		stereo_ubo = 0;
+	}
+}
+
+extern "C" {
+
+unsigned int goatvr_get_stereo_ubo(void)
+{
+	if(!stereo_ubo && glcaps.ubo) {
+		glGenBuffers(1, &stereo_ubo);
+		glBindBuffer(GL_UNIFORM_BUFFER, stereo_ubo);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(StereoUniforms), 0, GL_STREAM_DRAW);
+		update_stereo_ubo();
+	}
+	return stereo_ubo;
+}
+
+void goatvr_bind_stereo_ubo(unsigned int binding)
+{
+	unsigned int ubo = goatvr_get_stereo_ubo();
+	if(ubo) {
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+	}
+}
+
+int goatvr_set_late_latch(int enable)
+{
+	if(enable && !glcaps.buffer_storage) {
+		fprintf(stderr, "goatvr: late latching needs OpenGL 4.4 or GL_ARB_buffer_storage\n");
+		return -1;
+	}
+	latch_enabled = enable != 0;
+	if(!latch_enabled) {
+		latched = false;
+	}
+	return 0;
+}
+
+int goatvr_get_late_latch(void)
+{
+	return latch_enabled ? 1 : 0;
+}
+
+int goatvr_late_latched(void)
+{
+	return latched ? 1 : 0;
+}
+
+int goatvr_draw_instanced_stereo(void)
+{
+	RenderTexture *rtex = display_module ? display_module->get_render_texture() : 0;
+	if(!rtex || !glcaps.ubo || mr_active) {
+		return -1;
+	}
+
+	if(far_bound) {
+		// switch back from the far layer to the VR framebuffer
+		glBindFramebuffer(GL_FRAMEBUFFER, render_fbo());
+		far_bound = false;
+	}
+	if(glcaps.viewport_array) {
+		for(int i=0; i<2; i++) {
+			int rect[4];
+			get_eye_rect(i, rect);
+			glViewportIndexedf(i, rect[0], rect[1], rect[2], rect[3]);
+		}
+		inst_mode = GOATVR_STEREO_VIEWPORT_ARRAY;
+	} else {
+		// one viewport covering both eyes, clip distances keep each eye in its half
+		int width, height;
+		get_render_size(&width, &height);
+		glViewport(0, 0, width, height);
+		for(int i=0; i<4; i++) {
+			glEnable(GL_CLIP_DISTANCE0 + i);
+		}
+		inst_mode = GOATVR_STEREO_CLIP_DISTANCE;
+	}
+	return inst_mode;
+}
+
+}	// extern "C"
@@ -0,0 +1,40 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef STEREOUBO_H_
+#define STEREOUBO_H_
+
+/* uniform buffer with the per-eye matrices for instanced stereo (see
+ * goatvr_get_stereo_ubo), optionally filled with late-latched poses
+ * (see goatvr_set_late_latch).
+ */
+
+namespace goatvr {
+
+// called by goatvr_draw_start, after the module update
+void update_stereo_ubo();
+// called by goatvr_draw_done, before the frame is submitted
+void late_latch_poses();
+// undo the state set by goatvr_draw_instanced_stereo. Called by goatvr_draw_done.
+void instanced_stereo_done();
+
+void destroy_latch();
+void destroy_stereo_ubo();
+
+}	// namespace goatvr
+
+#endif	/* STEREOUBO_H_ */
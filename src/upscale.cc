@@ -0,0 +1,474 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <math.h>
+#include "opengl.h"
+#include "sdr.h"
+#include "modman.h"
+#include "render.h"
+#include "farlayer.h"
+#include "upscale.h"
+
+using namespace goatvr;
+
+static bool update_mid(int width, int height);
+static bool update_upscale();
+static void upscale_eyes();
+
+static unsigned int easu_prog, rcas_prog, vao;
+// full resolution intermediate between the two passes
+static unsigned int mid_fbo, mid_tex;
+static int mid_width, mid_height;
+
+// low resolution render target, the eyes are drawn at the rectangles of get_eye_rect
+static float ups_scale = 1.0f, ups_sharpness = 0.2f;	// ups_scale 1 disables upscaling
+bool goatvr::ups_active;
+static unsigned int ups_fbo, ups_tex, ups_zbuf;
+static int ups_width, ups_height;	// current size of the render target
+static int ups_alloc_width, ups_alloc_height;	// allocated size
+int goatvr::ups_zfmt = -1;
+bool goatvr::ups_zblit;
+
+static const char *vsdr =
+	"#version 150\n"
+	"out vec2 tc;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 pos = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));\n"
+	"	tc = pos;\n"
+	"	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+/* edge-adaptive spatial upsampling: the local gradient direction and edge
+ * length of the 4 texels nearest to the sample, shape an approximate lanczos2
+ * kernel over a 12-tap footprint, stretched along the edge. The result is
+ * clamped to the 4 nearest texels to avoid ringing.
+ */
+static const char *easu_psdr =
+	"#version 150\n"
+	"uniform sampler2D tex;\n"
+	"uniform vec4 src_rect;\n"
+	"in vec2 tc;\n"
+	"out vec4 color;\n"
+	"vec3 fetch(ivec2 p)\n"
+	"{\n"
+	"	ivec2 lo = ivec2(src_rect.xy);\n"
+	"	return texelFetch(tex, clamp(p, lo, lo + ivec2(src_rect.zw) - 1), 0).rgb;\n"
+	"}\n"
+	"float luma(vec3 c)\n"
+	"{\n"
+	"	return c.g + 0.5 * (c.r + c.b);\n"
+	"}\n"
+	"void edge(inout vec2 dir, inout float len, float w, float lb, float ll, float lc, float lr, float lt)\n"
+	"{\n"
+	"	float dirx = lr - ll;\n"
+	"	float diry = lt - lb;\n"
+	"	float lenx = clamp(abs(dirx) / max(max(abs(lr - lc), abs(lc - ll)), 1.0 / 32768.0), 0.0, 1.0);\n"
+	"	float leny = clamp(abs(diry) / max(max(abs(lt - lc), abs(lc - lb)), 1.0 / 32768.0), 0.0, 1.0);\n"
+	"	dir += vec2(dirx, diry) * w;\n"
+	"	len += (lenx * lenx + leny * leny) * w;\n"
+	"}\n"
+	"void tap(inout vec3 acc, inout float accw, vec2 off, vec2 dir, vec2 len2, float lob, float clp, vec3 c)\n"
+	"{\n"
+	"	vec2 v = vec2(dot(off, dir), dot(off, vec2(-dir.y, dir.x))) * len2;\n"
+	"	float d2 = min(dot(v, v), clp);\n"
+	"	float wb = 0.4 * d2 - 1.0;\n"
+	"	float wa = lob * d2 - 1.0;\n"
+	"	float w = (1.5625 * wb * wb - 0.5625) * wa * wa;\n"
+	"	acc += c * w;\n"
+	"	accw += w;\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 pp = src_rect.xy + tc * src_rect.zw - 0.5;\n"
+	"	vec2 fp = floor(pp);\n"
+	"	vec2 f = pp - fp;\n"
+	"	ivec2 ip = ivec2(fp);\n"
+	"	vec3 c[12];\n"
+	"	c[0] = fetch(ip + ivec2(0, -1));\n"
+	"	c[1] = fetch(ip + ivec2(1, -1));\n"
+	"	c[2] = fetch(ip + ivec2(-1, 0));\n"
+	"	c[3] = fetch(ip);\n"
+	"	c[4] = fetch(ip + ivec2(1, 0));\n"
+	"	c[5] = fetch(ip + ivec2(2, 0));\n"
+	"	c[6] = fetch(ip + ivec2(-1, 1));\n"
+	"	c[7] = fetch(ip + ivec2(0, 1));\n"
+	"	c[8] = fetch(ip + ivec2(1, 1));\n"
+	"	c[9] = fetch(ip + ivec2(2, 1));\n"
+	"	c[10] = fetch(ip + ivec2(0, 2));\n"
+	"	c[11] = fetch(ip + ivec2(1, 2));\n"
+	"	float l[12];\n"
+	"	for(int i=0; i<12; i++) {\n"
+	"		l[i] = luma(c[i]);\n"
+	"	}\n"
+	"	vec2 dir = vec2(0.0);\n"
+	"	float len = 0.0;\n"
+	"	edge(dir, len, (1.0 - f.x) * (1.0 - f.y), l[0], l[2], l[3], l[4], l[7]);\n"
+	"	edge(dir, len, f.x * (1.0 - f.y), l[1], l[3], l[4], l[5], l[8]);\n"
+	"	edge(dir, len, (1.0 - f.x) * f.y, l[3], l[6], l[7], l[8], l[10]);\n"
+	"	edge(dir, len, f.x * f.y, l[4], l[7], l[8], l[9], l[11]);\n"
+	"	float dirsq = dot(dir, dir);\n"
+	"	dir = dirsq < 1.0 / 32768.0 ? vec2(1.0, 0.0) : dir * inversesqrt(dirsq);\n"
+	"	len *= 0.5;\n"
+	"	len *= len;\n"
+	"	float stretch = 1.0 / max(abs(dir.x), abs(dir.y));\n"
+	"	vec2 len2 = vec2(1.0 + (stretch - 1.0) * len, 1.0 - 0.5 * len);\n"
+	"	float lob = 0.5 - 0.29 * len;\n"
+	"	float clp = 1.0 / lob;\n"
+	"	vec3 acc = vec3(0.0);\n"
+	"	float accw = 0.0;\n"
+	"	tap(acc, accw, vec2(0.0, -1.0) - f, dir, len2, lob, clp, c[0]);\n"
+	"	tap(acc, accw, vec2(1.0, -1.0) - f, dir, len2, lob, clp, c[1]);\n"
+	"	tap(acc, accw, vec2(-1.0, 0.0) - f, dir, len2, lob, clp, c[2]);\n"
+	"	tap(acc, accw, -f, dir, len2, lob, clp, c[3]);\n"
+	"	tap(acc, accw, vec2(1.0, 0.0) - f, dir, len2, lob, clp, c[4]);\n"
+	"	tap(acc, accw, vec2(2.0, 0.0) - f, dir, len2, lob, clp, c[5]);\n"
+	"	tap(acc, accw, vec2(-1.0, 1.0) - f, dir, len2, lob, clp, c[6]);\n"
+	"	tap(acc, accw, vec2(0.0, 1.0) - f, dir, len2, lob, clp, c[7]);\n"
+	"	tap(acc, accw, vec2(1.0, 1.0) - f, dir, len2, lob, clp, c[8]);\n"
+	"	tap(acc, accw, vec2(2.0, 1.0) - f, dir, len2, lob, clp, c[9]);\n"
+	"	tap(acc, accw, vec2(0.0, 2.0) - f, dir, len2, lob, clp, c[10]);\n"
+	"	tap(acc, accw, vec2(1.0, 2.0) - f, dir, len2, lob, clp, c[11]);\n"
+	"	vec3 mn = min(min(c[3], c[4]), min(c[7], c[8]));\n"
+	"	vec3 mx = max(max(c[3], c[4]), max(c[7], c[8]));\n"
+	"	vec3 res = accw > 0.0 ? acc / accw : c[3];\n"
+	"	color = vec4(clamp(res, mn, mx), 1.0);\n"
+	"}\n";
+
+/* contrast-adaptive sharpening: a 5-tap cross with the largest negative lobe
+ * which doesn't push the result out of the range of the neighbourhood.
+ */
+static const char *rcas_psdr =
+	"#version 150\n"
+	"uniform sampler2D tex;\n"
+	"uniform vec4 rect;\n"
+	"uniform float sharp;\n"
+	"out vec4 color;\n"
+	"vec3 fetch(ivec2 p)\n"
+	"{\n"
+	"	ivec2 lo = ivec2(rect.xy);\n"
+	"	return texelFetch(tex, clamp(p, lo, lo + ivec2(rect.zw) - 1), 0).rgb;\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"	ivec2 p = ivec2(gl_FragCoord.xy);\n"
+	"	vec3 b = fetch(p + ivec2(0, 1));\n"
+	"	vec3 d = fetch(p + ivec2(-1, 0));\n"
+	"	vec3 e = fetch(p);\n"
+	"	vec3 f = fetch(p + ivec2(1, 0));\n"
+	"	vec3 h = fetch(p + ivec2(0, -1));\n"
+	"	vec3 mn4 = min(min(b, d), min(f, h));\n"
+	"	vec3 mx4 = max(max(b, d), max(f, h));\n"
+	"	vec3 hit_min = min(mn4, e) / max(4.0 * mx4, 1.0 / 32768.0);\n"
+	"	vec3 hit_max = (1.0 - max(mx4, e)) / min(4.0 * mn4 - 4.0, -1.0 / 32768.0);\n"
+	"	vec3 lobe3 = max(-hit_min, hit_max);\n"
+	"	float lobe = max(-0.1875, min(max(lobe3.r, max(lobe3.g, lobe3.b)), 0.0)) * sharp;\n"
+	"	color = vec4((lobe * (b + d + f + h) + e) / (4.0 * lobe + 1.0), 1.0);\n"
+	"}\n";
+
+bool goatvr::init_upscale()
+{
+	if(easu_prog) {
+		return true;
+	}
+	if(!glcaps.shaders) {
+		return false;
+	}
+
+	if(!(easu_prog = create_program_load(vsdr, easu_psdr))) {
+		fprintf(stderr, "goatvr: failed to create the upscaling program\n");
+		return false;
+	}
+	if(!(rcas_prog = create_program_load(vsdr, rcas_psdr))) {
+		fprintf(stderr, "goatvr: failed to create the sharpening program\n");
+		free_program(easu_prog);
+		easu_prog = 0;
+		return false;
+	}
+	glUseProgram(easu_prog);
+	set_uniform_int(easu_prog, "tex", 0);
+	glUseProgram(rcas_prog);
+	set_uniform_int(rcas_prog, "tex", 0);
+	glUseProgram(0);
+
+	glGenVertexArrays(1, &vao);	// attribute-less, vertices from gl_VertexID
+	return true;
+}
+
+void goatvr::destroy_upscale()
+{
+	if(easu_prog) {
+		free_program(easu_prog);
+		free_program(rcas_prog);
+		glDeleteVertexArrays(1, &vao);
+		easu_prog = rcas_prog = vao = 0;
+	}
+	if(mid_fbo) {
+		glDeleteFramebuffers(1, &mid_fbo);
+		glDeleteTextures(1, &mid_tex);
+		mid_fbo = mid_tex = 0;
+	}
+	mid_width = mid_height = 0;
+}
+
+bool goatvr::upscale(unsigned int dst_fbo, int dst_width, int dst_height, const int (*dst_rect)[4],
+		unsigned int src_tex, const int (*src_rect)[4], int count, float sharpness)
+{
+	push_gl_state();
+
+	if(!init_upscale() || !update_mid(dst_width, dst_height)) {
+		pop_gl_state();
+		return false;
+	}
+
+	glBindVertexArray(vao);
+	glActiveTexture(GL_TEXTURE0);
+
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glDisable(GL_SCISSOR_TEST);
+	glColorMask(1, 1, 1, 1);
+	glEnable(GL_FRAMEBUFFER_SRGB);
+
+	// upsample to the intermediate texture, with the same layout as the destination
+	glBindFramebuffer(GL_FRAMEBUFFER, mid_fbo);
+	glUseProgram(easu_prog);
+	glBindTexture(GL_TEXTURE_2D, src_tex);
+	for(int i=0; i<count; i++) {
+		const int *src = src_rect[i];
+		const int *dst = dst_rect[i];
+		glViewport(dst[0], dst[1], dst[2], dst[3]);
+		set_uniform_float4(easu_prog, "src_rect", src[0], src[1], src[2], src[3]);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+
+	// sharpen into the destination
+	glBindFramebuffer(GL_FRAMEBUFFER, dst_fbo);
+	glUseProgram(rcas_prog);
+	set_uniform_float(rcas_prog, "sharp", pow(2.0f, -sharpness));
+	glBindTexture(GL_TEXTURE_2D, mid_tex);
+	for(int i=0; i<count; i++) {
+		const int *dst = dst_rect[i];
+		glViewport(dst[0], dst[1], dst[2], dst[3]);
+		set_uniform_float4(rcas_prog, "rect", dst[0], dst[1], dst[2], dst[3]);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+
+	pop_gl_state();
+	return true;
+}
+
+static bool update_mid(int width, int height)
+{
+	if(mid_fbo && width == mid_width && height == mid_height) {
+		return true;
+	}
+	mid_width = width;
+	mid_height = height;
+
+	if(!mid_fbo) {
+		glGenFramebuffers(1, &mid_fbo);
+		glGenTextures(1, &mid_tex);
+
+		glBindTexture(GL_TEXTURE_2D, mid_tex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	glBindTexture(GL_TEXTURE_2D, mid_tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, mid_width, mid_height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mid_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mid_tex, 0);
+
+	GLenum fbst = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if(fbst != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "goatvr: incomplete upscaling framebuffer! (status: %x)\n", (unsigned int)fbst);
+		glDeleteFramebuffers(1, &mid_fbo);
+		glDeleteTextures(1, &mid_tex);
+		mid_fbo = mid_tex = 0;
+		mid_width = mid_height = 0;
+		return false;
+	}
+	return true;
+}
+
+bool goatvr::upscaling()
+{
+	if(ups_scale >= 1.0f || goatvr_get_multires(0, 0) || !display_module) {
+		return false;
+	}
+	return display_module->get_render_texture() != 0;
+}
+
+unsigned int goatvr::upscale_fbo()
+{
+	return ups_fbo;
+}
+
+static bool update_upscale()
+{
+	get_render_size(&ups_width, &ups_height);
+	if(ups_width <= 0 || ups_height <= 0) {
+		return false;
+	}
+	// depth is blitted to the VR framebuffer for the far layer composite
+	int zf = vr_depth_format();
+	ups_zblit = zf >= 0;
+	if(zf < 0) zf = (int)depth_fmt;
+
+	if(ups_fbo && ups_width == ups_alloc_width && ups_height == ups_alloc_height &&
+			zf == ups_zfmt) {
+		return true;
+	}
+	ups_alloc_width = ups_width;
+	ups_alloc_height = ups_height;
+	ups_zfmt = zf;
+
+	if(!ups_fbo) {
+		glGenFramebuffers(1, &ups_fbo);
+		glGenTextures(1, &ups_tex);
+		glGenRenderbuffers(1, &ups_zbuf);
+
+		glBindTexture(GL_TEXTURE_2D, ups_tex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+	printf("goatvr: creating %dx%d low resolution framebuffer for upscaling\n", ups_width, ups_height);
+
+	glBindTexture(GL_TEXTURE_2D, ups_tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, ups_width, ups_height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, ups_zbuf);
+	glRenderbufferStorage(GL_RENDERBUFFER, zfmt[ups_zfmt].ifmt, ups_width, ups_height);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, ups_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ups_tex, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, ups_zbuf);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+			zfmt[ups_zfmt].stencil ? ups_zbuf : 0);
+
+	GLenum fbst = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if(fbst != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "goatvr: incomplete upscaling framebuffer! (status: %x), disabling upscaling\n",
+				(unsigned int)fbst);
+		destroy_upscale_fbo();
+		/* turn it off for good, otherwise get_eye_rect would keep handing out
+		 * the scaled down layout for the full resolution framebuffer
+		 */
+		ups_scale = 1.0f;
+		return false;
+	}
+	return true;
+}
+
+void goatvr::destroy_upscale_fbo()
+{
+	if(ups_fbo) {
+		glDeleteFramebuffers(1, &ups_fbo);
+		glDeleteTextures(1, &ups_tex);
+		glDeleteRenderbuffers(1, &ups_zbuf);
+		ups_fbo = ups_tex = ups_zbuf = 0;
+	}
+	ups_alloc_width = ups_alloc_height = 0;
+	ups_zfmt = -1;
+	ups_active = false;
+}
+
+static void upscale_eyes()
+{
+	RenderTexture *rtex = display_module->get_render_texture();
+	if(!rtex) return;
+
+	unsigned int vrfbo = vr_fbo();
+	int src[2][4], dst[2][4];
+	for(int i=0; i<2; i++) {
+		get_eye_rect(i, src[i]);
+		dst[i][0] = rtex->eye_xoffs[i];
+		dst[i][1] = rtex->eye_yoffs[i];
+		dst[i][2] = rtex->eye_width[i];
+		dst[i][3] = rtex->eye_height[i];
+	}
+
+	bool done = upscale(vrfbo, rtex->width, rtex->height, dst, ups_tex, src, 2, ups_sharpness);
+
+	if(!done || far_drawn) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, ups_fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, vrfbo);
+		for(int i=0; i<2; i++) {
+			const int *s = src[i];
+			const int *d = dst[i];
+			if(!done) {
+				// no shaders, fall back to a bilinear stretch
+				glBlitFramebuffer(s[0], s[1], s[0] + s[2], s[1] + s[3], d[0], d[1], d[0] + d[2],
+						d[1] + d[3], GL_COLOR_BUFFER_BIT, GL_LINEAR);
+			}
+			if(far_drawn && ups_zblit) {
+				// the far layer composite needs the depth of the near-field
+				glBlitFramebuffer(s[0], s[1], s[0] + s[2], s[1] + s[3], d[0], d[1], d[0] + d[2],
+						d[1] + d[3], GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			}
+		}
+	}
+}
+
+bool goatvr::upscale_draw_start()
+{
+	ups_active = upscaling() && update_upscale();
+	if(ups_active) {
+		glBindFramebuffer(GL_FRAMEBUFFER, ups_fbo);
+		glViewport(0, 0, ups_width, ups_height);
+	}
+	return ups_active;
+}
+
+void goatvr::upscale_draw_done()
+{
+	if(ups_active) {
+		upscale_eyes();
+		ups_active = false;
+	}
+}
+
+extern "C" {
+
+int goatvr_set_upscale(float scale, float sharpness)
+{
+	if(scale <= 0.0f || scale > 1.0f) {
+		return -1;
+	}
+	if(scale < 1.0f && !glcaps.shaders) {
+		fprintf(stderr, "goatvr: can't enable upscaling, needs OpenGL 3.2\n");
+		return -1;
+	}
+	ups_scale = scale;
+	ups_sharpness = sharpness < 0.0f ? 0.0f : sharpness;
+	if(ups_scale >= 1.0f) {
+		destroy_upscale_fbo();
+	}
+	return 0;
+}
+
+float goatvr_get_upscale(void)
+{
+	return ups_scale;
+}
+
+}	// extern "C"
@@ -0,0 +1,62 @@
+/*
+GoatVR - a modular virtual reality abstraction library
+Copyright (C) 2014-2016  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef UPSCALE_H_
+#define UPSCALE_H_
+
+/* FSR1-style spatial upscaling, used by goatvr_draw_done to bring eyes drawn at
+ * a reduced resolution up to the size of the VR framebuffer: an edge-adaptive
+ * upsampling pass (EASU) into an intermediate texture, followed by a robust
+ * contrast-adaptive sharpening pass (RCAS). Needs glcaps.shaders.
+ */
+
+namespace goatvr {
+
+bool init_upscale();
+void destroy_upscale();
+
+/* upscale each of the count rectangles (x, y, width, height) of src_tex, to
+ * the matching rectangle of dst_fbo, which is dst_width x dst_height pixels.
+ * sharpness is in stops: 0 is the sharpest, and each unit halves it.
+ */
+bool upscale(unsigned int dst_fbo, int dst_width, int dst_height, const int (*dst_rect)[4],
+		unsigned int src_tex, const int (*src_rect)[4], int count, float sharpness);
+
+/* low resolution render target (see goatvr_set_upscale). While upscaling, the
+ * eyes are drawn there instead of the VR framebuffer, and goatvr_draw_done
+ * upscales them to the VR framebuffer.
+ */
+extern bool ups_active;	// goatvr_draw_start bound the low resolution framebuffer
+extern bool ups_zblit;	// its depth buffer can be blitted to the VR framebuffer
+extern int ups_zfmt;	// zfmt index of its depth buffer
+
+// upscaling is enabled, and there's a render texture to upscale to
+bool upscaling();
+// the low resolution framebuffer
+unsigned int upscale_fbo();
+void destroy_upscale_fbo();
+
+/* bind the low resolution framebuffer if upscaling, and return true if it
+ * did. Called by goatvr_draw_start.
+ */
+bool upscale_draw_start();
+// upscale the eyes to the VR framebuffer. Called by goatvr_draw_done.
+void upscale_draw_done();
+
+}	// namespace goatvr
+
+#endif	/* UPSCALE_H_ */